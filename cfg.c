@@ -21,9 +21,13 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <libgen.h>
+#include <dirent.h>
 #include "common.h"
 #include "cfg.h"
 
+/* Class directory of tty devices in sysfs */
+#define SYS_TTY_DIR "/sys/class/tty"
+
 enum DEV_SKU g_dev_sku = SKU_CCM;
 
 /* Syncing flag: When this flag is 1, everything operation to the ttyS1 should
@@ -65,9 +69,54 @@ int g_running = 1;
 /* Board number (SIM) */
 uint8_t g_port_num = MAX_SIM_PORT_COUNT;
 
+/* Devices of SIM ports given by -sim-ports, NULL: ttyS2 ~ ttyS17 */
+char **g_sim_port_list = NULL;
+
 /* Baudrate of serial port (SIM) */
 int g_baudrate = 115200;
 
+/* Baudrate is given by -sim-baud, don't ask for it */
+static int baudrate_given = 0;
+
+/* I/O engine of serial port (SIM) */
+int g_sim_engine = SIM_ENGINE_THREAD;
+
+/* TX pacing of serial port (SIM) */
+int g_sim_pacing = SIM_PACING_SEGMENT;
+
+/* Pacing is given by -sim-pacing, otherwise no pacing with flow control */
+static int pacing_given = 0;
+
+/* Flow control of serial port (SIM) */
+int g_sim_flow = SIM_FLOW_NONE;
+
+/* Latency measurement of serial port (SIM) */
+int g_sim_latency = SIM_LATENCY_OFF;
+
+/* Seconds per step of baud sweep of serial port (SIM), 0: no sweep */
+int g_sim_sweep = 0;
+
+/* Packet length of serial port (SIM), and seconds per step of its sweep */
+int g_sim_frame = SIM_FRAME_DEFAULT;
+int g_sim_frame_sweep = 0;
+
+/* Topology discovery of serial ports (SIM) */
+int g_sim_topology = SIM_TOPOLOGY_OFF;
+
+/* Compressed RX capture of each serial port (SIM) in KB, 0: no capture */
+int g_sim_capture = 0;
+
+/* Payload of serial port (SIM) packets, and seed of random payload */
+int g_sim_payload = SIM_PAYLOAD_RAMP;
+uint64_t g_sim_seed = 1;
+
+/* ASYNC_LOW_LATENCY of serial ports (SIM, HSM) */
+int g_ser_low_latency = 0;
+
+/* VMIN/VTIME of serial port (SIM), -1: default of tc_init() */
+int g_sim_vmin = -1;
+int g_sim_vtime = -1;
+
 /* HSM: test loop */
 uint64_t g_hsm_test_loop = 100;
 uint8_t g_hsm_switching = 0;
@@ -75,11 +124,39 @@ uint8_t g_hsm_switching = 0;
 /* NIM: port test flag, set by user input */
 uint8_t g_nim_test_eth[MAX_NIC_COUNT] = {0};
 
+/* NIM: packets per batch, sent every 1 ms */
+int g_nim_batch = 1;
+
+/* NIM: rate of each NIC in pps or Mbps, 0: a batch every 1 ms */
+uint64_t g_nim_pps = 0;
+double g_nim_mbps = 0;
+
+/* NIM: load profile, with seconds of ramp or of each step */
+int g_nim_profile = NIM_PROFILE_CONST;
+int g_nim_profile_secs = 0;
+int g_nim_profile_steps = 0;
+
+/* NIM: seconds per trial of RFC 2544 benchmark, 0: off */
+int g_nim_rfc2544 = 0;
+
+/* NIM: RTT probes per second of each NIC, 0: off */
+int g_nim_rtt = 0;
+
+/* NIM: path of test traffic */
+int g_nim_engine = NIM_ENGINE_UDP;
+
+/* NIM: queue of NIC bound by -nim-engine xdp */
+int g_nim_xdp_queue = 0;
+
+/* NIM: offload of UDP packets */
+int g_nim_offload = NIM_OFFLOAD_NONE;
+
 //Function Prototype
 static char *right_trim(char *str);
 static char *left_trim(const char *str);
 static int is_board_num_valid(int board_num);
 static int is_product_sn_valid(char *psn);
+static int scan_sim_ports(const char *spec);
 static int is_board_sn_valid(char *bsn);
 static int decode_time(unsigned char *value, int vlen);
 static int input_str(const char *hint, char *str, uint8_t len);
@@ -172,6 +249,230 @@ static int is_board_num_valid(int board_num)
     return 0;
 }
 
+/******************************************************************************
+ * NAME:
+ *      read_tty_attr
+ *
+ * DESCRIPTION:
+ *      Read an attribute of tty device from sysfs, without the newline.
+ *
+ * PARAMETERS:
+ *      tty - Name of tty device, e.g. "ttyS2".
+ *      attr - Name of attribute, e.g. "type".
+ *      buf - Save the attribute.
+ *      len - Size of buf.
+ *
+ * RETURN:
+ *      0 - OK
+ *      -1 - Not exist or read error
+ ******************************************************************************/
+static int read_tty_attr(const char *tty, const char *attr, char *buf, int len)
+{
+    char path[PATH_MAX];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s/%s", SYS_TTY_DIR, tty, attr);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    if (fgets(buf, len, fp) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    right_trim(buf);
+    return 0;
+}
+
+/******************************************************************************
+ * NAME:
+ *      is_sim_port
+ *
+ * DESCRIPTION:
+ *      Check if the tty device is a SIM port selected by spec of -sim-ports.
+ *      Only the ports with a UART are selected, the kernel console and the
+ *      CCM port are never selected.
+ *
+ * PARAMETERS:
+ *      tty - Name of tty device, e.g. "ttyS2".
+ *      spec - "auto", "driver=<name>" or "io=<start>-<end>".
+ *      console - Active consoles of kernel, separated by space.
+ *
+ * RETURN:
+ *      1 - Selected
+ *      0 - Not selected
+ ******************************************************************************/
+static int is_sim_port(const char *tty, const char *spec, const char *console)
+{
+    char buf[MAX_STR_LENGTH];
+    char path[PATH_MAX];
+    char link[PATH_MAX];
+    unsigned long start;
+    unsigned long end;
+    unsigned long base;
+    const char *p;
+    int n;
+
+    /* UART type 0 is PORT_UNKNOWN, no UART at this line */
+    if (read_tty_attr(tty, "type", buf, sizeof(buf)) != 0 || atoi(buf) == 0) {
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), "/dev/%s", tty);
+    if (strcmp(path, CCM_SERIAL_PORT) == 0) {
+        return 0;
+    }
+
+    n = strlen(tty);
+    for (p = strstr(console, tty); p; p = strstr(p + 1, tty)) {
+        if ((p == console || p[-1] == ' ') && (p[n] == '\0' || p[n] == ' ')) {
+            return 0;
+        }
+    }
+
+    if (strncmp(spec, "driver=", 7) == 0) {
+        snprintf(path, sizeof(path), "%s/%s/device/driver", SYS_TTY_DIR, tty);
+        n = readlink(path, link, sizeof(link) - 1);
+        if (n < 0) {
+            return 0;
+        }
+        link[n] = '\0';
+
+        return strcmp(basename(link), spec + 7) == 0;
+    }
+
+    if (strncmp(spec, "io=", 3) == 0) {
+        if (sscanf(spec + 3, "%lx-%lx", &start, &end) != 2
+                || read_tty_attr(tty, "port", buf, sizeof(buf)) != 0) {
+            return 0;
+        }
+        base = strtoul(buf, NULL, 16);
+
+        return base >= start && base <= end;
+    }
+
+    return 1;
+}
+
+/*
+ * Sort the device names by prefix, then by line number, so that ttyS10 is
+ * after ttyS9.
+ */
+static int compare_port_name(const void *a, const void *b)
+{
+    const char *s1 = *(const char **)a;
+    const char *s2 = *(const char **)b;
+    int n1 = strcspn(s1, "0123456789");
+    int n2 = strcspn(s2, "0123456789");
+    int ret;
+
+    ret = strncmp(s1, s2, (n1 < n2) ? n1 : n2);
+    if (ret != 0 || n1 != n2) {
+        return (ret != 0) ? ret : n1 - n2;
+    }
+
+    return atoi(s1 + n1) - atoi(s2 + n2);
+}
+
+/******************************************************************************
+ * NAME:
+ *      scan_sim_ports
+ *
+ * DESCRIPTION:
+ *      Find the SIM ports for -sim-ports, and set g_sim_port_list and
+ *      g_port_num. The spec is a list of devices separated by ',', or a
+ *      filter of the serial ports in sysfs:
+ *          auto - all ports with a UART
+ *          driver=<name> - ports of the driver, e.g. "driver=exar_serial"
+ *          io=<start>-<end> - ports with I/O base in range (hex)
+ *
+ * PARAMETERS:
+ *      spec - Value of -sim-ports.
+ *
+ * RETURN:
+ *      0 - OK
+ *      -1 - No port found, or error
+ ******************************************************************************/
+static int scan_sim_ports(const char *spec)
+{
+    char console[MAX_STR_LENGTH] = "";
+    char path[PATH_MAX];
+    char **list;
+    char *names;
+    char *tok;
+    struct dirent *ent;
+    DIR *dir;
+    int count = 0;
+
+    list = calloc(MAX_SIM_SCAN_PORT, sizeof(char *));
+    if (list == NULL) {
+        return -1;
+    }
+
+    if (strcmp(spec, "auto") == 0 || strchr(spec, '=') != NULL) {
+        dir = opendir(SYS_TTY_DIR);
+        if (dir == NULL) {
+            printf("Open %s error\n", SYS_TTY_DIR);
+            free(list);
+            return -1;
+        }
+
+        read_tty_attr("console", "active", console, sizeof(console));
+
+        while ((ent = readdir(dir)) != NULL) {
+            if (ent->d_name[0] == '.' || !is_sim_port(ent->d_name, spec, console)) {
+                continue;
+            }
+
+            if (count >= MAX_SIM_SCAN_PORT) {
+                printf("Too many SIM ports, max %d\n", MAX_SIM_SCAN_PORT);
+                break;
+            }
+
+            snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
+            list[count++] = strdup(path);
+        }
+        closedir(dir);
+
+        qsort(list, count, sizeof(char *), compare_port_name);
+    } else {
+        names = strdup(spec);
+        for (tok = strtok(names, ","); tok; tok = strtok(NULL, ",")) {
+            if (count >= MAX_SIM_SCAN_PORT) {
+                printf("Too many SIM ports, max %d\n", MAX_SIM_SCAN_PORT);
+                break;
+            }
+
+            if (tok[0] == '/') {
+                strncpy0(path, tok, sizeof(path));
+            } else {
+                snprintf(path, sizeof(path), "/dev/%s", tok);
+            }
+
+            if (access(path, F_OK) != 0) {
+                printf("SIM port %s does not exist\n", path);
+                continue;
+            }
+            list[count++] = strdup(path);
+        }
+        free(names);
+    }
+
+    if (count == 0) {
+        printf("No SIM port found by \"%s\"\n", spec);
+        free(list);
+        return -1;
+    }
+
+    g_sim_port_list = list;
+    g_port_num = count;
+
+    return 0;
+}
+
 /******************************************************************************
  * NAME:
  *      is_product_sn_valid
@@ -444,6 +745,11 @@ static int input_sim_port_num(uint8_t *num)
         return -1;
     }
 
+    /* The SIM ports are given by -sim-ports */
+    if (g_sim_port_list) {
+        return 0;
+    }
+
     do {
         /* Get the number of SIM board && check it */
         if (0 != input_num("Please input SIM Port Number(1/2/3):\n"
@@ -552,6 +858,10 @@ static int input_baudrate(int *baud)
         return -1;
     }
 
+    if (baudrate_given) {
+        return 0;
+    }
+
     do {
         printf("Please select baudrate:\n");
         for (i = 0; i < baudrate_count; i++) {
@@ -795,7 +1105,7 @@ int get_parameter(void)
                 if (0 != input_sim_port_num(&g_port_num))
                   return -1;
 
-                for (i = 0; i < get_sim_board_num(); i++) {
+                for (i = 0; i < get_sim_board_num() && i < MAX_SIM_COUNT; i++) {
                     if (0 != input_board_sn("SIM", g_sim_sn[i], sizeof(g_sim_sn[i])))
                         return -1;
                 }
@@ -858,7 +1168,7 @@ int get_parameter(void)
 
     if (g_dev_sku != SKU_CIM) {
         //If use two SIM board, disable CPU/memory test
-        if (g_test_sim && g_port_num == MAX_SIM_PORT_COUNT) {
+        if (g_test_sim && g_port_num >= MAX_SIM_PORT_COUNT) {
             g_test_cpu = 0;
             g_test_mem = 0;
         }
@@ -914,21 +1224,300 @@ int get_parameter(void)
  ******************************************************************************/
 int parse_params(int argc, char **argv)
 {
+    int i;
+    int sku_given = 0;
+
+    g_dev_sku = SKU_CCM;
+
     //Check parameter
-    if (argc == 1) {
-        g_dev_sku = SKU_CCM;
-    } else if (argc == 2){
-        if (strcmp("-msm", argv[1]) == 0) {
-            g_dev_sku = SKU_CCM_MSM;
-        } else if (strcmp("-cim", argv[1]) == 0) {
-            g_dev_sku = SKU_CIM;
-        } else if (strcmp("-nim", argv[1]) == 0) {
-            g_dev_sku = SKU_CCM_LEGACY;
+    for (i = 1; i < argc; i++) {
+        if (strcmp("-msm", argv[i]) == 0
+                || strcmp("-cim", argv[i]) == 0
+                || strcmp("-nim", argv[i]) == 0) {
+            /* One SKU only */
+            if (sku_given++) {
+                return -EINVAL;
+            }
+
+            if (strcmp("-msm", argv[i]) == 0) {
+                g_dev_sku = SKU_CCM_MSM;
+            } else if (strcmp("-cim", argv[i]) == 0) {
+                g_dev_sku = SKU_CIM;
+            } else {
+                g_dev_sku = SKU_CCM_LEGACY;
+            }
+        } else if (strcmp("-nim-batch", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_nim_batch = atoi(argv[i]);
+            if (g_nim_batch < 1 || g_nim_batch > MAX_NIM_BATCH) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-nim-rate", argv[i]) == 0) {
+            char *unit;
+
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_nim_pps = 0;
+            g_nim_mbps = strtod(argv[i], &unit);
+            if (g_nim_mbps <= 0) {
+                return -EINVAL;
+            }
+            if (*unit == '\0' || strcasecmp("pps", unit) == 0) {
+                g_nim_pps = (uint64_t)g_nim_mbps;
+                g_nim_mbps = 0;
+                if (g_nim_pps == 0) {
+                    return -EINVAL;
+                }
+            } else if (strcasecmp("mbps", unit) != 0) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-nim-profile", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (strcmp("const", argv[i]) == 0) {
+                g_nim_profile = NIM_PROFILE_CONST;
+            } else if (sscanf(argv[i], "ramp:%d", &g_nim_profile_secs) == 1
+                    && g_nim_profile_secs > 0) {
+                g_nim_profile = NIM_PROFILE_RAMP;
+            } else if (sscanf(argv[i], "step:%d:%d", &g_nim_profile_secs,
+                        &g_nim_profile_steps) == 2
+                    && g_nim_profile_secs > 0 && g_nim_profile_steps > 1) {
+                g_nim_profile = NIM_PROFILE_STEP;
+            } else {
+                return -EINVAL;
+            }
+        } else if (strcmp("-nim-rfc2544", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_nim_rfc2544 = atoi(argv[i]);
+            if (g_nim_rfc2544 < 1 || g_nim_rfc2544 > MAX_NIM_TRIAL_SECS) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-nim-engine", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (strcmp("udp", argv[i]) == 0) {
+                g_nim_engine = NIM_ENGINE_UDP;
+            } else if (strcmp("packet", argv[i]) == 0) {
+                g_nim_engine = NIM_ENGINE_PACKET;
+            } else if (strcmp("xdp", argv[i]) == 0) {
+                g_nim_engine = NIM_ENGINE_XDP;
+            } else if (strncmp("xdp:", argv[i], 4) == 0) {
+                g_nim_engine = NIM_ENGINE_XDP;
+                g_nim_xdp_queue = atoi(argv[i] + 4);
+                if (g_nim_xdp_queue < 0 || g_nim_xdp_queue >= MAX_NIM_XDP_QUEUES) {
+                    return -EINVAL;
+                }
+            } else {
+                return -EINVAL;
+            }
+        } else if (strcmp("-nim-offload", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (strcmp("none", argv[i]) == 0) {
+                g_nim_offload = NIM_OFFLOAD_NONE;
+            } else if (strcmp("gso", argv[i]) == 0) {
+                g_nim_offload = NIM_OFFLOAD_GSO;
+            } else {
+                return -EINVAL;
+            }
+        } else if (strcmp("-nim-rtt", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_nim_rtt = atoi(argv[i]);
+            if (g_nim_rtt < 1 || g_nim_rtt > MAX_NIM_RTT_PPS) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-engine", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (strcmp("thread", argv[i]) == 0) {
+                g_sim_engine = SIM_ENGINE_THREAD;
+            } else if (strcmp("epoll", argv[i]) == 0) {
+                g_sim_engine = SIM_ENGINE_EPOLL;
+            } else if (strcmp("uring", argv[i]) == 0) {
+                g_sim_engine = SIM_ENGINE_URING;
+            } else {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-pacing", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (strcmp("segment", argv[i]) == 0) {
+                g_sim_pacing = SIM_PACING_SEGMENT;
+            } else if (strcmp("outq", argv[i]) == 0) {
+                g_sim_pacing = SIM_PACING_OUTQ;
+            } else if (strcmp("none", argv[i]) == 0) {
+                g_sim_pacing = SIM_PACING_NONE;
+            } else {
+                return -EINVAL;
+            }
+            pacing_given = 1;
+        } else if (strcmp("-sim-flow", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (strcmp("none", argv[i]) == 0) {
+                g_sim_flow = SIM_FLOW_NONE;
+            } else if (strcmp("rtscts", argv[i]) == 0) {
+                g_sim_flow = SIM_FLOW_RTSCTS;
+            } else if (strcmp("xonxoff", argv[i]) == 0) {
+                g_sim_flow = SIM_FLOW_XONXOFF;
+            } else {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-latency", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (strcmp("off", argv[i]) == 0) {
+                g_sim_latency = SIM_LATENCY_OFF;
+            } else if (strcmp("loopback", argv[i]) == 0) {
+                g_sim_latency = SIM_LATENCY_LOOPBACK;
+            } else if (strcmp("echo", argv[i]) == 0) {
+                g_sim_latency = SIM_LATENCY_ECHO;
+            } else {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-sweep", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_sim_sweep = atoi(argv[i]);
+            if (g_sim_sweep <= 0) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-frame", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_sim_frame = atoi(argv[i]);
+            if (g_sim_frame < SIM_FRAME_MIN || g_sim_frame > SIM_FRAME_MAX) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-frame-sweep", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_sim_frame_sweep = atoi(argv[i]);
+            if (g_sim_frame_sweep <= 0) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-baud", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            /* Any baudrate, non-standard ones are set by termios2 */
+            g_baudrate = atoi(argv[i]);
+            if (g_baudrate <= 0) {
+                return -EINVAL;
+            }
+            baudrate_given = 1;
+        } else if (strcmp("-sim-ports", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (scan_sim_ports(argv[i]) < 0) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-vmin", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_sim_vmin = atoi(argv[i]);
+            if (g_sim_vmin < 0 || g_sim_vmin > 255) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-vtime", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_sim_vtime = atoi(argv[i]);
+            if (g_sim_vtime < 0 || g_sim_vtime > 255) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-topology", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            if (strcmp("off", argv[i]) == 0) {
+                g_sim_topology = SIM_TOPOLOGY_OFF;
+            } else if (strcmp("report", argv[i]) == 0) {
+                g_sim_topology = SIM_TOPOLOGY_REPORT;
+            } else if (strcmp("remap", argv[i]) == 0) {
+                g_sim_topology = SIM_TOPOLOGY_REMAP;
+            } else {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-capture", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_sim_capture = atoi(argv[i]);
+            if (g_sim_capture <= 0) {
+                return -EINVAL;
+            }
+        } else if (strcmp("-sim-payload", argv[i]) == 0) {
+            const char *payload_name[] = {
+                "ramp", "zeros", "ones", "alt",
+                "prbs7", "prbs15", "prbs31", "random"
+            };
+            int k;
+
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            for (k = 0; k < sizeof(payload_name)/sizeof(char *); k++) {
+                if (strcmp(payload_name[k], argv[i]) == 0) {
+                    break;
+                }
+            }
+            if (k == sizeof(payload_name)/sizeof(char *)) {
+                return -EINVAL;
+            }
+            g_sim_payload = k;
+        } else if (strcmp("-sim-seed", argv[i]) == 0) {
+            if (++i >= argc) {
+                return -EINVAL;
+            }
+
+            g_sim_seed = strtoull(argv[i], NULL, 0);
+        } else if (strcmp("-low-latency", argv[i]) == 0) {
+            g_ser_low_latency = 1;
         } else {
             return -EINVAL;
         }
-    } else {
-        return -EINVAL;
     }
 
     switch (g_dev_sku) {
@@ -946,6 +1535,55 @@ int parse_params(int argc, char **argv)
             return -EINVAL;
     }
 
+    if (g_sim_flow != SIM_FLOW_NONE && !pacing_given) {
+        g_sim_pacing = SIM_PACING_NONE;
+    }
+
+    /* The TX timestamp needs room in the payload */
+    if (g_sim_latency != SIM_LATENCY_OFF && g_sim_frame < SIM_FRAME_TS_MIN) {
+        return -EINVAL;
+    }
+
+    /* A load profile is a fraction of the rate */
+    if (g_nim_profile != NIM_PROFILE_CONST && g_nim_pps == 0 && g_nim_mbps == 0) {
+        return -EINVAL;
+    }
+
+    /* The benchmark sets the load of each trial */
+    if (g_nim_rfc2544 > 0 && g_nim_profile != NIM_PROFILE_CONST) {
+        return -EINVAL;
+    }
+
+    /* The benchmark has its own latency trials */
+    if (g_nim_rfc2544 > 0 && g_nim_rtt > 0) {
+        return -EINVAL;
+    }
+
+    /* The benchmark and RTT probes are on UDP */
+    if (g_nim_engine != NIM_ENGINE_UDP && (g_nim_rfc2544 > 0 || g_nim_rtt > 0)) {
+        return -EINVAL;
+    }
+
+    /* GSO is of the UDP test traffic, the benchmark sends frames of all sizes */
+    if (g_nim_offload != NIM_OFFLOAD_NONE
+            && (g_nim_engine != NIM_ENGINE_UDP || g_nim_rfc2544 > 0)) {
+        return -EINVAL;
+    }
+
+    /*
+     * A read of the thread engine returns at once with VTIME 0, and with
+     * VMIN > 0 never before the first byte, so a dead port would hang its
+     * RX thread
+     */
+    if (g_sim_engine == SIM_ENGINE_THREAD && (g_sim_vtime == 0 || g_sim_vmin > 0)) {
+        return -EINVAL;
+    }
+
+    /* One sweep at a time, the other parameter is fixed */
+    if (g_sim_sweep > 0 && g_sim_frame_sweep > 0) {
+        return -EINVAL;
+    }
+
     return 0;
 }
 
@@ -997,17 +1635,18 @@ void input_y(char *hint)
     } while (ret == -1);
 }
 
+int get_sim_board_ports(void)
+{
+    return (g_port_num == 4) ? 4 : MAX_SIM_PORT_COUNT / MAX_SIM_COUNT;
+}
+
+/* One board at least, also for the ports of -sim-ports */
 int get_sim_board_num(void)
 {
-    switch (g_port_num) {
-        case 4:
-        case 8:
-            return 1;
-        case MAX_SIM_PORT_COUNT:
-            return 2;
-        default:
-            return 0;
-    }
+    int per_board = get_sim_board_ports();
+    int num = (g_port_num + per_board - 1) / per_board;
+
+    return (num > 0) ? num : 1;
 }
 
 int get_sim_port_num(int index)
@@ -27,8 +27,22 @@
 #define MAX_SIM_COUNT       2
 #define MAX_SIM_PORT_COUNT  16
 
+/* Max ports found by -sim-ports, port_id of SIM packets is one byte */
+#define MAX_SIM_SCAN_PORT   255
+
 #define MAX_NIC_COUNT 4
 
+/* Max packets per sendmmsg()/recvmmsg() of NIM test, UIO_MAXIOV */
+#define MAX_NIM_BATCH 1024
+#define MAX_NIM_TRIAL_SECS 600
+#define MAX_NIM_RTT_PPS 100000
+
+/* Queues of NIC by -nim-engine xdp, entries of the XSKMAP */
+#define MAX_NIM_XDP_QUEUES 64
+
+/* EtherType of NIM frames by -nim-engine packet|xdp, IEEE local experimental */
+#define NIM_ETHERTYPE 0x88B5
+
 #define APPNAME_CCM         "lirc-itest"
 
 enum DEV_SKU {
@@ -40,10 +54,88 @@ enum DEV_SKU {
 
 extern enum DEV_SKU g_dev_sku;
 
+/* I/O engine of SIM test */
+enum SIM_ENGINE {
+    SIM_ENGINE_THREAD = 0,  /* Two blocking threads per port */
+    SIM_ENGINE_EPOLL,       /* One epoll reactor for all ports */
+    SIM_ENGINE_URING,       /* One io_uring for all ports */
+};
+
+/* TX pacing of SIM test */
+enum SIM_PACING {
+    SIM_PACING_SEGMENT = 0, /* Fixed size segment per fixed interval */
+    SIM_PACING_OUTQ,        /* Keep the TX queue of UART at a fill level */
+    SIM_PACING_NONE,        /* Write at once, rely on flow control */
+};
+
+/* Flow control of SIM ports */
+enum SIM_FLOW {
+    SIM_FLOW_NONE = 0,
+    SIM_FLOW_RTSCTS,        /* Hardware RTS/CTS */
+    SIM_FLOW_XONXOFF,       /* Software XON/XOFF, packet bytes are escaped */
+};
+
+/* Latency measurement of SIM test */
+enum SIM_LATENCY {
+    SIM_LATENCY_OFF = 0,
+    SIM_LATENCY_LOOPBACK,   /* One-way, sender and receiver on same host */
+    SIM_LATENCY_ECHO,       /* Round trip, machine B echoes packets of A */
+};
+
+/* Topology discovery of SIM ports before test */
+enum SIM_TOPOLOGY {
+    SIM_TOPOLOGY_OFF = 0,
+    SIM_TOPOLOGY_REPORT,    /* Log wiring matrix, fail SIM if miswired */
+    SIM_TOPOLOGY_REMAP,     /* Log wiring matrix, test ports as wired */
+};
+
+/*
+ * Length of SIM packets on the wire: 6 bytes of head and port ID, 9 bytes of
+ * tail, number and CRC, 1 byte of payload at least, and 8 more bytes for the
+ * TX timestamp if latency is measured
+ */
+#define SIM_FRAME_DEFAULT   265
+#define SIM_FRAME_MIN       16
+#define SIM_FRAME_MAX       1024
+#define SIM_FRAME_TS_MIN    (SIM_FRAME_MIN + 8)
+
+/* Payload of SIM packets, the PRBS ones change from packet to packet */
+enum SIM_PAYLOAD {
+    SIM_PAYLOAD_RAMP = 0,   /* 0x00 ~ 0xF9 */
+    SIM_PAYLOAD_ZEROS,
+    SIM_PAYLOAD_ONES,
+    SIM_PAYLOAD_ALT,        /* 0x55 */
+    SIM_PAYLOAD_PRBS7,
+    SIM_PAYLOAD_PRBS15,
+    SIM_PAYLOAD_PRBS31,
+    SIM_PAYLOAD_RANDOM,     /* Seeded by -sim-seed */
+};
+
+/* Offered load of NIM test over time, up to the rate of -nim-rate */
+enum NIM_PROFILE {
+    NIM_PROFILE_CONST = 0,
+    NIM_PROFILE_RAMP,       /* From 0 to the rate linearly */
+    NIM_PROFILE_STEP,       /* In equal steps of rate up to the rate */
+};
+
+/* Path of NIM test traffic */
+enum NIM_ENGINE {
+    NIM_ENGINE_UDP = 0,     /* UDP sockets over IP */
+    NIM_ENGINE_PACKET,      /* Ethernet frames by TPACKET_V3 rings */
+    NIM_ENGINE_XDP,         /* Ethernet frames by AF_XDP rings */
+};
+
+/* Offload of UDP packets of NIM test to the stack */
+enum NIM_OFFLOAD {
+    NIM_OFFLOAD_NONE = 0,
+    NIM_OFFLOAD_GSO,        /* UDP_SEGMENT on send, UDP_GRO on receive */
+};
+
 int get_parameter(void);
 int parse_params(int argc, char **argv);
 int get_eth_num(enum DEV_SKU sku);
 void input_y(char *hint);
 int get_sim_board_num(void);
+int get_sim_board_ports(void);
 
 #endif /* _CFG_H_ */
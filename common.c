@@ -15,6 +15,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include "common.h"
 #include "term.h"
 
@@ -23,6 +24,8 @@
 #include <netinet/in.h>
 #include <net/if.h>
 #include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netpacket/packet.h>
 
 #ifdef DEBUG
 #include <errno.h>
@@ -81,6 +84,10 @@ int ser_open(char *dev)
         return -1;
     }
 
+    if (g_ser_low_latency && tc_set_low_latency(fd, TRUE) < 0) {
+        DBG_PRINT("Set low latency of %s fail\n", dev);
+    }
+
     return fd;
 }
 
@@ -262,6 +269,51 @@ int sleep_ms(unsigned int ms)
 }
 
 
+/******************************************************************************
+ * NAME:
+ *      get_time_ns
+ *
+ * DESCRIPTION:
+ *      Get the time of monotonic clock in nanoseconds.
+ *
+ * PARAMETERS:
+ *      None
+ *
+ * RETURN:
+ *      Time in nanoseconds
+ ******************************************************************************/
+uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/******************************************************************************
+ * NAME:
+ *      get_thread_cpu_ns
+ *
+ * DESCRIPTION:
+ *      Get the CPU time of calling thread in nanoseconds.
+ *
+ * PARAMETERS:
+ *      None
+ *
+ * RETURN:
+ *      CPU time in nanoseconds
+ ******************************************************************************/
+uint64_t get_thread_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
 /******************************************************************************
  * NAME:
  *      is_exe_exist
@@ -509,19 +561,47 @@ int socket_init(int *sockfd, char *ipaddr, uint16_t portid)
     return 0;
 }
 
-static int send_sync_data_eth(int sockfd, char snt_char, char* target_ip)
+/*
+ * Open a packet socket of NIM_ETHERTYPE on eth<ethid>, with the broadcast
+ * address of it to send to. The address of NIC is not touched.
+ */
+int l2_socket_init(int *sockfd, uint32_t ethid, int type, struct sockaddr_ll *addr)
 {
-    char buf[2] = {snt_char, 0};
+    char ifname[20];
+
+    snprintf(ifname, sizeof(ifname), "eth%d", ethid);
+
+    memset(addr, 0, sizeof(struct sockaddr_ll));
+    addr->sll_family = AF_PACKET;
+    addr->sll_protocol = htons(NIM_ETHERTYPE);
+    addr->sll_ifindex = if_nametoindex(ifname);
+    addr->sll_halen = ETH_ALEN;
+    memset(addr->sll_addr, 0xff, ETH_ALEN);
+    if (addr->sll_ifindex == 0) {
+        DBG_PRINT("no interface %s!\n", ifname);
+
+        return -1;
+    }
+
+    *sockfd = socket(AF_PACKET, type, htons(NIM_ETHERTYPE));
+    if (*sockfd == -1) {
+        return -1;
+    }
 
-    //Set target addr for sendto
-    struct sockaddr_in taddr;
-    memset(&taddr, 0, sizeof(taddr));
-    taddr.sin_family = AF_INET;
-    taddr.sin_port = htons(UDP_PORT);
-    taddr.sin_addr.s_addr = inet_addr(target_ip);
+    if (bind(*sockfd, (struct sockaddr *)addr, sizeof(struct sockaddr_ll)) == -1) {
+        close(*sockfd);
 
-    int size = sendto(sockfd, buf, sizeof(buf), 0,
-            (struct sockaddr*)&taddr, sizeof(taddr));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int send_sync_data_eth(int sockfd, char snt_char, struct sockaddr *taddr, socklen_t tlen)
+{
+    char buf[2] = {snt_char, 0};
+
+    int size = sendto(sockfd, buf, sizeof(buf), 0, taddr, tlen);
     if (size > 0){
         return TRUE;
     } else {
@@ -544,10 +624,10 @@ static int recv_sync_data_eth(int sockfd, char rcv_char, char snt_char)
     tv.tv_sec = 3;
     tv.tv_usec = 0;
 
-    struct sockaddr_in raddr;
+    struct sockaddr_storage raddr;
     socklen_t len;
     memset(&raddr, 0, sizeof(raddr));
-    len = sizeof(struct sockaddr_in);
+    len = sizeof(raddr);
 
     retval = select(sockfd+1, &rfds, NULL, NULL, &tv);
     /* Don't rely on the value of tv now! */
@@ -590,6 +670,10 @@ int wait_other_side_ready_eth(void)
 
     char local_ip[IPSTR_LEN];
     char target_ip[IPSTR_LEN];
+    struct sockaddr_in taddr_in;
+    struct sockaddr_ll taddr_ll;
+    struct sockaddr *taddr;
+    socklen_t tlen;
     char rcv_char;
     char snt_char;
     char eth_id;
@@ -615,26 +699,43 @@ int wait_other_side_ready_eth(void)
         return TRUE;
     }
 
-    if (0 != set_ipaddr(eth_id, local_ip, "255.255.255.0")) {
-        printf("Set IP address fail\n");
-        return FALSE;
-    }
+    if (g_nim_engine != NIM_ENGINE_UDP) {
+        /* Broadcast frames, the address of NIC is kept */
+        if (0 != l2_socket_init(&sockfd, eth_id, SOCK_DGRAM, &taddr_ll)) {
+            printf("Open packet socket fail\n");
+            return FALSE;
+        }
+        taddr = (struct sockaddr *)&taddr_ll;
+        tlen = sizeof(taddr_ll);
+    } else {
+        if (0 != set_ipaddr(eth_id, local_ip, "255.255.255.0")) {
+            printf("Set IP address fail\n");
+            return FALSE;
+        }
 
-    if (0 != socket_init(&sockfd, local_ip, UDP_PORT)) {
-        printf("Set IP address fail\n");
-        return FALSE;
+        if (0 != socket_init(&sockfd, local_ip, UDP_PORT)) {
+            printf("Set IP address fail\n");
+            return FALSE;
+        }
+
+        memset(&taddr_in, 0, sizeof(taddr_in));
+        taddr_in.sin_family = AF_INET;
+        taddr_in.sin_port = htons(UDP_PORT);
+        taddr_in.sin_addr.s_addr = inet_addr(target_ip);
+        taddr = (struct sockaddr *)&taddr_in;
+        tlen = sizeof(taddr_in);
     }
 
     int rc = FALSE;
     while (g_running) {
         /* Send sync request */
-        if (send_sync_data_eth(sockfd, snt_char, target_ip) == 0) {
+        if (send_sync_data_eth(sockfd, snt_char, taddr, tlen) == 0) {
             continue;
         }
 
         int ch = recv_sync_data_eth(sockfd, rcv_char, snt_char);
         if (ch == 1) {
-            send_sync_data_eth(sockfd, snt_char, target_ip);
+            send_sync_data_eth(sockfd, snt_char, taddr, tlen);
             rc = TRUE;
             break;
         } else if (ch == -1) {
@@ -39,13 +39,39 @@ extern char g_machine;
 extern uint64_t g_duration;
 extern int g_running;
 extern uint8_t g_port_num;
+extern char **g_sim_port_list;
 extern int g_baudrate;
+extern int g_sim_engine;
+extern int g_sim_pacing;
+extern int g_sim_flow;
+extern int g_sim_latency;
+extern int g_sim_sweep;
+extern int g_sim_frame;
+extern int g_sim_frame_sweep;
+extern int g_sim_topology;
+extern int g_sim_capture;
+extern int g_sim_payload;
+extern uint64_t g_sim_seed;
+extern int g_ser_low_latency;
+extern int g_sim_vmin;
+extern int g_sim_vtime;
 extern char g_progam_path[];
 
 extern uint64_t g_hsm_test_loop;
 extern uint8_t g_hsm_switching;
 
 extern uint8_t g_nim_test_eth[MAX_NIC_COUNT];
+extern int g_nim_batch;
+extern uint64_t g_nim_pps;
+extern double g_nim_mbps;
+extern int g_nim_profile;
+extern int g_nim_profile_secs;
+extern int g_nim_profile_steps;
+extern int g_nim_rfc2544;
+extern int g_nim_rtt;
+extern int g_nim_engine;
+extern int g_nim_xdp_queue;
+extern int g_nim_offload;
 
 extern int g_test_mode;
 
@@ -115,6 +141,8 @@ typedef struct _test_mod {
 void kill_process(char *name);
 int wait_other_side_ready(int fd);
 int sleep_ms(unsigned int ms);
+uint64_t get_time_ns(void);
+uint64_t get_thread_cpu_ns(void);
 int is_exe_exist(char *exe);
 int ser_open(char *dev);
 void send_exit_sync(void);
@@ -123,6 +151,8 @@ int send_packet(int fd, char *buf, uint8_t len);
 
 int set_ipaddr(uint32_t ethid, char *ipaddr, char *netmask);
 int socket_init(int *sockfd, char *ipaddr, uint16_t portid);
+struct sockaddr_ll;
+int l2_socket_init(int *sockfd, uint32_t ethid, int type, struct sockaddr_ll *addr);
 int wait_other_side_ready_eth(void);
 void set_if_up_all(void);
 void wait_link_status_all(uint8_t num);
@@ -0,0 +1,225 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     errmap.c
+ *
+ * DESCRIPTION:
+ *     Define functions of bit error map for corrupted payloads
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "errmap.h"
+#include "log.h"
+
+/* Bytes per bucket of offset histogram printed, and top offsets printed */
+#define ERRMAP_PRINT_BIN    16
+#define ERRMAP_PRINT_TOP    4
+
+/* Count a burst from bit first to bit last into its bucket */
+static void errmap_burst(errmap_t *m, int first, int last)
+{
+    int index = 31 - __builtin_clz(last - first + 1);
+
+    if (index >= ERRMAP_BURST_COUNT) {
+        index = ERRMAP_BURST_COUNT - 1;
+    }
+    m->burst[index]++;
+}
+
+/******************************************************************************
+ * NAME:
+ *      errmap_init
+ *
+ * DESCRIPTION:
+ *      Clear a bit error map.
+ *
+ * PARAMETERS:
+ *      m - The bit error map
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void errmap_init(errmap_t *m)
+{
+    memset(m, 0, sizeof(errmap_t));
+}
+
+/******************************************************************************
+ * NAME:
+ *      errmap_add
+ *
+ * DESCRIPTION:
+ *      Compare a received payload with the expected one, 64 bits at a time,
+ *      and record the different bits into the map. Equal words cost one
+ *      XOR, only the words with errors are walked bit by bit.
+ *
+ * PARAMETERS:
+ *      m      - The bit error map
+ *      rx     - The received payload
+ *      expect - The expected payload
+ *      len    - Bytes to compare
+ *
+ * RETURN:
+ *      Number of different bits
+ ******************************************************************************/
+uint64_t errmap_add(errmap_t *m, const uint8_t *rx, const uint8_t *expect,
+        int len)
+{
+    uint64_t errs = 0;
+    uint64_t x;
+    uint64_t y;
+    int first = -1;
+    int last = -1;
+    int end;
+    int bit;
+    int i;
+    int j;
+
+    for (i = 0; i < len; i += 8) {
+        end = (i + 8 <= len) ? i + 8 : len;
+        if (end - i == 8) {
+            memcpy(&x, rx + i, 8);
+            memcpy(&y, expect + i, 8);
+            if (x == y) {
+                continue;
+            }
+        }
+
+        for (j = i; j < end; j++) {
+            unsigned int d = rx[j] ^ expect[j];
+
+            while (d) {
+                bit = __builtin_ctz(d);
+                d &= d - 1;
+
+                m->bit_pos[bit]++;
+                m->offset[(j < ERRMAP_MAX_LEN) ? j : ERRMAP_MAX_LEN - 1]++;
+                errs++;
+
+                bit += j * 8;
+                if (first >= 0 && bit - last > ERRMAP_GUARD_BITS) {
+                    errmap_burst(m, first, last);
+                    first = -1;
+                }
+                if (first < 0) {
+                    first = bit;
+                }
+                last = bit;
+            }
+        }
+    }
+
+    if (errs) {
+        errmap_burst(m, first, last);
+        m->frames++;
+        m->bits += errs;
+    }
+
+    return errs;
+}
+
+/******************************************************************************
+ * NAME:
+ *      errmap_print
+ *
+ * DESCRIPTION:
+ *      Print the histograms of a bit error map: errors by bit of byte, by
+ *      burst length, by byte offset in groups of 16 bytes, and the byte
+ *      offsets with the most errors. A stuck bit shows in one bit position,
+ *      a clock slip as errors of every offset from some byte to the end,
+ *      and noise as short bursts at random offsets.
+ *
+ * PARAMETERS:
+ *      fd   - The file to print to
+ *      name - The name of map
+ *      m    - The bit error map
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void errmap_print(int fd, char *name, errmap_t *m)
+{
+    int top[ERRMAP_PRINT_TOP];
+    uint64_t sum;
+    int col;
+    int i;
+    int j;
+    int k;
+
+    if (m->frames == 0) {
+        write_file(fd, "    %s: no bit error\n", name);
+        return;
+    }
+
+    write_file(fd, "    %s: %llu bit errors in %llu frames\n", name,
+            (unsigned long long)m->bits, (unsigned long long)m->frames);
+
+    write_file(fd, "        bit of byte(LSB first):");
+    for (i = 0; i < 8; i++) {
+        write_file(fd, " %llu", (unsigned long long)m->bit_pos[i]);
+    }
+    write_file(fd, "\n");
+
+    write_file(fd, "        burst length(bits):");
+    for (i = 0; i < ERRMAP_BURST_COUNT; i++) {
+        if (m->burst[i] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            write_file(fd, " 1: %llu", (unsigned long long)m->burst[i]);
+        } else if (i == ERRMAP_BURST_COUNT - 1) {
+            write_file(fd, " %d+: %llu", 1 << i,
+                    (unsigned long long)m->burst[i]);
+        } else {
+            write_file(fd, " %d-%d: %llu", 1 << i, (2 << i) - 1,
+                    (unsigned long long)m->burst[i]);
+        }
+    }
+    write_file(fd, "\n");
+
+    write_file(fd, "        byte offset:");
+    col = 0;
+    for (i = 0; i < ERRMAP_MAX_LEN; i += ERRMAP_PRINT_BIN) {
+        sum = 0;
+        for (j = i; j < i + ERRMAP_PRINT_BIN; j++) {
+            sum += m->offset[j];
+        }
+        if (sum == 0) {
+            continue;
+        }
+        if (col > 0 && col % 4 == 0) {
+            write_file(fd, "\n                    ");
+        }
+        write_file(fd, " %03X-%03X: %8llu", i, i + ERRMAP_PRINT_BIN - 1,
+                (unsigned long long)sum);
+        col++;
+    }
+    write_file(fd, "\n");
+
+    /* Offsets with the most errors, in descending order */
+    for (k = 0; k < ERRMAP_PRINT_TOP; k++) {
+        top[k] = -1;
+        for (i = 0; i < ERRMAP_MAX_LEN; i++) {
+            if (m->offset[i] == 0) {
+                continue;
+            }
+            for (j = 0; j < k && top[j] != i; j++) {
+            }
+            if (j == k && (top[k] < 0 || m->offset[i] > m->offset[top[k]])) {
+                top[k] = i;
+            }
+        }
+    }
+
+    write_file(fd, "        top offsets:");
+    for (k = 0; k < ERRMAP_PRINT_TOP && top[k] >= 0; k++) {
+        write_file(fd, " %03X: %llu", top[k],
+                (unsigned long long)m->offset[top[k]]);
+    }
+    write_file(fd, "\n");
+}
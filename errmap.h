@@ -0,0 +1,44 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     errmap.h
+ *
+ * DESCRIPTION:
+ *     Define bit error map of corrupted payloads, with histograms of error
+ *     bit position, byte offset and burst length
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#ifndef _ERRMAP_H_
+#define _ERRMAP_H_
+
+#include <stdint.h>
+
+/* Byte offsets from ERRMAP_MAX_LEN - 1 on share the last bucket */
+#define ERRMAP_MAX_LEN      1024
+
+/*
+ * Bits are numbered in the order sent, LSB of each byte first. A burst
+ * ends after ERRMAP_GUARD_BITS good bits, its length is from the first to
+ * the last error bit. The burst buckets are powers of 2: 1, 2-3, 4-7 ...
+ */
+#define ERRMAP_GUARD_BITS   8
+#define ERRMAP_BURST_COUNT  14
+
+typedef struct _errmap {
+    uint64_t frames;                    /* Frames with bit errors */
+    uint64_t bits;                      /* Bit errors of all frames */
+    uint64_t bit_pos[8];                /* Bit errors at bit n of byte */
+    uint64_t offset[ERRMAP_MAX_LEN];    /* Bit errors at byte offset */
+    uint64_t burst[ERRMAP_BURST_COUNT];
+} errmap_t;
+
+void errmap_init(errmap_t *m);
+uint64_t errmap_add(errmap_t *m, const uint8_t *rx, const uint8_t *expect,
+        int len);
+void errmap_print(int fd, char *name, errmap_t *m);
+
+#endif /* _ERRMAP_H_ */
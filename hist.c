@@ -0,0 +1,172 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     hist.c
+ *
+ * DESCRIPTION:
+ *     Define functions of log-linear histogram for latency statistics
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#include <string.h>
+#include "hist.h"
+#include "log.h"
+
+/*
+ * Values below HIST_SUB_COUNT have their own bucket. For others, the bucket
+ * is chosen by the position of the most significant bit and the next
+ * HIST_SUB_BITS bits.
+ */
+static int hist_index(uint64_t value)
+{
+    int msb;
+
+    if (value < HIST_SUB_COUNT) {
+        return (int)value;
+    }
+
+    msb = 63 - __builtin_clzll(value);
+
+    return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+        + (int)((value >> (msb - HIST_SUB_BITS)) - HIST_SUB_COUNT);
+}
+
+/* The largest value falls into the bucket */
+static uint64_t hist_bucket_max(int index)
+{
+    int shift;
+    uint64_t low;
+
+    if (index < HIST_SUB_COUNT) {
+        return index;
+    }
+
+    shift = (index >> HIST_SUB_BITS) - 1;
+    low = (uint64_t)((index & (HIST_SUB_COUNT - 1)) + HIST_SUB_COUNT) << shift;
+
+    return low + ((1ULL << shift) - 1);
+}
+
+/******************************************************************************
+ * NAME:
+ *      hist_init
+ *
+ * DESCRIPTION:
+ *      Clear a histogram.
+ *
+ * PARAMETERS:
+ *      h - The histogram
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void hist_init(hist_t *h)
+{
+    memset(h, 0, sizeof(hist_t));
+    h->min = UINT64_MAX;
+}
+
+/******************************************************************************
+ * NAME:
+ *      hist_add
+ *
+ * DESCRIPTION:
+ *      Record a value into histogram.
+ *
+ * PARAMETERS:
+ *      h     - The histogram
+ *      value - The value to record
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void hist_add(hist_t *h, uint64_t value)
+{
+    h->bucket[hist_index(value)]++;
+    h->count++;
+
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+/******************************************************************************
+ * NAME:
+ *      hist_percentile
+ *
+ * DESCRIPTION:
+ *      Get the value at given percentile of histogram.
+ *
+ * PARAMETERS:
+ *      h   - The histogram
+ *      pct - The percentile (0 ~ 100)
+ *
+ * RETURN:
+ *      The upper bound of the bucket holding the percentile, 0 if empty
+ ******************************************************************************/
+uint64_t hist_percentile(hist_t *h, double pct)
+{
+    uint64_t rank;
+    uint64_t sum = 0;
+    uint64_t value;
+    int i;
+
+    if (h->count == 0) {
+        return 0;
+    }
+
+    rank = (uint64_t)(h->count * pct / 100.0);
+    if (rank >= h->count) {
+        rank = h->count - 1;
+    }
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        sum += h->bucket[i];
+        if (sum > rank) {
+            break;
+        }
+    }
+
+    value = hist_bucket_max(i);
+    if (value > h->max) {
+        value = h->max;
+    }
+
+    return value;
+}
+
+/******************************************************************************
+ * NAME:
+ *      hist_print
+ *
+ * DESCRIPTION:
+ *      Print percentiles of a histogram of nanoseconds in microseconds.
+ *
+ * PARAMETERS:
+ *      fd   - The file to print to
+ *      name - The name of histogram
+ *      h    - The histogram
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void hist_print(int fd, char *name, hist_t *h)
+{
+    if (h->count == 0) {
+        write_file(fd, "    %s(us): no sample\n", name);
+        return;
+    }
+
+    write_file(fd, "    %s(us): p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+            name,
+            hist_percentile(h, 50) / 1000.0,
+            hist_percentile(h, 99) / 1000.0,
+            hist_percentile(h, 99.9) / 1000.0,
+            h->max / 1000.0);
+}
@@ -0,0 +1,39 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     hist.h
+ *
+ * DESCRIPTION:
+ *     Define log-linear histogram for latency statistics
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#ifndef _HIST_H_
+#define _HIST_H_
+
+#include <stdint.h>
+
+/*
+ * Each power of 2 range of value is split into 2^HIST_SUB_BITS linear
+ * buckets, so the relative error of a value read back is below 1/16.
+ */
+#define HIST_SUB_BITS       4
+#define HIST_SUB_COUNT      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS        ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct _hist {
+    uint64_t bucket[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+} hist_t;
+
+void hist_init(hist_t *h);
+void hist_add(hist_t *h, uint64_t value);
+uint64_t hist_percentile(hist_t *h, double pct);
+void hist_print(int fd, char *name, hist_t *h);
+
+#endif /* _HIST_H_ */
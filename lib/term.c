@@ -5,11 +5,13 @@
 #include <termios.h>
 #include "term.h"
 
-void tc_set_baudrate(int fd, int speed)
+int tc_set_baudrate(int fd, int speed)
 {
     struct termios opt;
 
-    tcgetattr(fd, &opt);
+    if (tcgetattr(fd, &opt) != 0) {
+        return -1;
+    }
 
     switch(speed)
     {
@@ -81,13 +83,24 @@ void tc_set_baudrate(int fd, int speed)
 #endif
 
         default:
+#ifdef __linux__
+            /* Non-standard baudrate by termios2 with BOTHER */
+            if (speed > 0 && tc_set_custom_baudrate(fd, speed) == 0) {
+                return 0;
+            }
+#endif
             printf("Invalid baudrate(%d), use 9600 instead.\n", speed);
             cfsetispeed(&opt,B9600);
             cfsetospeed(&opt,B9600);
-            break;
+            tcsetattr(fd, TCSAFLUSH, &opt);
+            return -1;
+    }
+
+    if (tcsetattr(fd, TCSAFLUSH, &opt) != 0) {
+        return -1;
     }
 
-    tcsetattr(fd, TCSAFLUSH, &opt);
+    return 0;
 }
 
 int tc_set_port(int fd, int databits, int stopbits, int parity)
@@ -204,6 +217,64 @@ int tc_init(char *dev)
     return fd;
 }
 
+int tc_set_timeout(int fd, int vmin, int vtime)
+{
+    struct termios options;
+
+    if (tcgetattr(fd, &options) != 0) {
+        printf("Fail to get setup of serial port\n");
+        return -1;
+    }
+
+    options.c_cc[VMIN] = vmin;
+    options.c_cc[VTIME] = vtime;
+
+    if (tcsetattr(fd, TCSANOW, &options) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int tc_set_flow_control(int fd, int mode)
+{
+    struct termios options;
+
+    if (tcgetattr(fd, &options) != 0) {
+        printf("Fail to get setup of serial port\n");
+        return -1;
+    }
+
+#ifdef CRTSCTS
+    options.c_cflag &= ~CRTSCTS;
+#endif
+    options.c_iflag &= ~(IXON | IXOFF | IXANY);
+
+    switch (mode) {
+        case TC_FLOW_RTSCTS:
+#ifdef CRTSCTS
+            options.c_cflag |= CRTSCTS;
+            break;
+#else
+            return -1;
+#endif
+        case TC_FLOW_XONXOFF:
+            options.c_iflag |= (IXON | IXOFF);
+            options.c_cc[VSTART] = 0x11;
+            options.c_cc[VSTOP] = 0x13;
+            break;
+        case TC_FLOW_NONE:
+        default:
+            break;
+    }
+
+    if (tcsetattr(fd, TCSANOW, &options) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
 void tc_deinit(int fd)
 {
     close(fd);
@@ -8,7 +8,7 @@
 #define FALSE       0
 #endif
 
-void tc_set_baudrate(int fd, int speed);
+int tc_set_baudrate(int fd, int speed);
 int tc_set_port(int fd, int databits, int stopbits, int parity);
 void tc_set_rts(int fd, char enabled);
 void tc_set_dtr(int fd, char enabled);
@@ -16,5 +16,18 @@ int tc_init(char *dev);
 void tc_deinit(int fd);
 int tc_get_cts(int fd);
 int tc_get_rts(int fd);
+int tc_set_timeout(int fd, int vmin, int vtime);
+
+/* Mode of tc_set_flow_control() */
+#define TC_FLOW_NONE        0
+#define TC_FLOW_RTSCTS      1
+#define TC_FLOW_XONXOFF     2
+
+int tc_set_flow_control(int fd, int mode);
+
+#ifdef __linux__
+int tc_set_custom_baudrate(int fd, int speed);
+int tc_set_low_latency(int fd, char enabled);
+#endif
 
 #endif /* __TERM_H__ */
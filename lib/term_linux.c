@@ -0,0 +1,52 @@
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+#include <linux/serial.h>
+#include "term.h"
+
+/*
+ * Linux specific controls. <asm/termbits.h> conflicts with <termios.h> of C
+ * library, so they are kept out of term.c.
+ */
+
+int tc_set_custom_baudrate(int fd, int speed)
+{
+    struct termios2 opt;
+
+    if (ioctl(fd, TCGETS2, &opt) < 0) {
+        return -1;
+    }
+
+    opt.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    opt.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    opt.c_ispeed = speed;
+    opt.c_ospeed = speed;
+
+    if (ioctl(fd, TCSETSF2, &opt) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int tc_set_low_latency(int fd, char enabled)
+{
+    struct serial_struct ser;
+
+    if (ioctl(fd, TIOCGSERIAL, &ser) < 0) {
+        return -1;
+    }
+
+    if (enabled == TRUE) {
+        ser.flags |= ASYNC_LOW_LATENCY;
+    } else {
+        ser.flags &= ~ASYNC_LOW_LATENCY;
+    }
+
+    if (ioctl(fd, TIOCSSERIAL, &ser) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+#endif
@@ -57,6 +57,50 @@ static void print_usage(char *name)
             "    Run test on CIM\n"
             "  -nim\n"
             "    Run with legacy SKU of CCM with NIM support\n"
+            "  -nim-batch <1~1024>\n"
+            "    UDP packets per sendmmsg()/recvmmsg() of NIM test, every 1 ms (default: 1)\n"
+            "  -nim-rate <N[pps]|Nmbps>\n"
+            "    Offered load of each NIC by token bucket, instead of a batch every 1 ms\n"
+            "  -nim-profile <const|ramp:<seconds>|step:<seconds>:<steps>>\n"
+            "    Offered load over time, up to -nim-rate (default: const)\n"
+            "  -nim-rfc2544 <1~600>\n"
+            "    RFC 2544 benchmark of NIM with trials of given seconds, on both machines\n"
+            "  -nim-engine <udp|packet|xdp[:<queue>]>\n"
+            "    Path of NIM test traffic, packet/xdp: Ethernet frames without IP (default: udp)\n"
+            "  -nim-offload <none|gso>\n"
+            "    gso: NIM sends a batch in super-buffers by UDP GSO, receives by UDP GRO (default: none)\n"
+            "  -nim-rtt <1~100000>\n"
+            "    RTT probes per second of each NIC by kernel timestamps, on both machines\n"
+            "  -sim-engine <thread|epoll|uring>\n"
+            "    I/O engine of SIM test (default: thread)\n"
+            "  -sim-pacing <segment|outq|none>\n"
+            "    TX pacing of SIM test (default: segment, none with -sim-flow)\n"
+            "  -sim-flow <none|rtscts|xonxoff>\n"
+            "    Flow control of SIM ports (default: none)\n"
+            "  -sim-latency <off|loopback|echo>\n"
+            "    Latency measurement of SIM test (default: off)\n"
+            "  -sim-sweep <seconds>\n"
+            "    Sweep SIM ports through all baudrates, seconds per step\n"
+            "  -sim-frame <16~1024>\n"
+            "    Packet length of SIM test in bytes (default: 265)\n"
+            "  -sim-frame-sweep <seconds>\n"
+            "    Sweep SIM packet length from 16 to 1024 bytes, seconds per step\n"
+            "  -sim-baud <baudrate>\n"
+            "    Baudrate of SIM test, any rate supported by UART\n"
+            "  -sim-ports <auto|driver=<name>|io=<start>-<end>|dev,dev...>\n"
+            "    SIM ports from sysfs or a list, instead of SIM port number\n"
+            "  -sim-vmin <0~255>, -sim-vtime <0~255>\n"
+            "    VMIN and VTIME(0.1s) of SIM ports (default: 0, 20)\n"
+            "  -sim-topology <off|report|remap>\n"
+            "    Discover wiring of SIM ports before test, on both machines (default: off)\n"
+            "  -sim-capture <KB>\n"
+            "    Capture raw RX data of SIM ports, KB of compressed data per port\n"
+            "  -sim-payload <ramp|zeros|ones|alt|prbs7|prbs15|prbs31|random>\n"
+            "    Payload of SIM packets (default: ramp)\n"
+            "  -sim-seed <seed>\n"
+            "    Seed of random payload of SIM packets (default: 1)\n"
+            "  -low-latency\n"
+            "    Set ASYNC_LOW_LATENCY of SIM ports and CCM port of HSM/MSM\n"
             );
 }
 
@@ -514,7 +558,7 @@ void generate_report(int fd, char *report_file, struct tm *tm_start, struct tm *
 
         if (g_test_sim) {
             write_file(fd, "SIM1 SN: %s\n", g_sim_sn[0]);
-            if (get_sim_board_num() == MAX_SIM_COUNT) {
+            if (get_sim_board_num() >= MAX_SIM_COUNT) {
                 write_file(fd, "SIM2 SN: %s\n", g_sim_sn[1]);
             }
         }
@@ -11,6 +11,9 @@
 *     - Initial version
 *
 ******************************************************************************/
+/* For sendmmsg() and recvmmsg() */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,14 +24,29 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <net/if.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include <sys/time.h>
 #include <pthread.h>
+#include <time.h>
+#include <poll.h>
 #include <zlib.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <sys/mman.h>
 
 #include "nim_test.h"
+#include "errmap.h"
+#include "hist.h"
+#include "tbucket.h"
+#include "xsk.h"
 
+/* Packets between logs, times the batch size */
 #define LOG_INTERVAL_TIME  10000
 
 typedef struct _ether_port_para {
@@ -59,13 +77,151 @@ struct ip_addrs cim_ip_lists[] = {
 #define NETMASK "255.255.255.0"
 
 #define UDP_PORT  9527
+#define UDP_PORT_RTT  9528
+#define UDP_PORT_DISCARD  9     /* Target of the UDP GSO probe */
 
 /* package size */
 #define NET_MAX_NUM 1024
 
+/* Socket buffers hold this number of batches of packets */
+#define NET_BUF_BATCHES 8
+
+/* Bytes of a packet on Ethernet: UDP, IP, MAC header, FCS, preamble, IFG */
+#define NET_WIRE_BYTES (NET_MAX_NUM + 8 + 20 + 18 + 20)
+
+/*
+ * -nim-offload gso: a message sent holds up to NET_GSO_SEGS packets, split
+ * into datagrams of NET_MAX_NUM by the stack (or NIC), within the 64 KB of
+ * an IP packet. A message received holds up to NET_GRO_LEN of datagrams
+ * coalesced, NET_GRO_MSGS messages per recvmmsg() at most.
+ */
+#define NET_GSO_SEGS (65507 / NET_MAX_NUM)
+#define NET_GRO_LEN 65536
+#define NET_GRO_MSGS 16
+
+/*
+ * Rate control: the token bucket holds NET_RATE_DEPTH_MS of packets at the
+ * rate, two batches at least, so the time overslept or preempted is made up
+ * by the next batches. A wait is NET_RATE_MAX_WAIT_MS at most, to follow the
+ * load profile and stop in time.
+ */
+#define NET_RATE_DEPTH_MS 10
+#define NET_RATE_MAX_WAIT_MS 10
+
 #define MAX_RETRY 5
 #define FRAME_LOSS_RATE 100000
 
+/*
+ * RFC 2544 benchmark by -nim-rfc2544: machine A sends trials of a constant
+ * rate and frame size, machine B echoes every packet back, so the loss and
+ * the round trip latency are measured by the clock of A. A packet is the
+ * ramp, then the trial id (bit 15 set, never a stop packet), sequence, TX
+ * time and CRC:
+ *
+ *   | 0x00 0x01 ... | trial(2) | seq(4) | TX ns(8) | CRC(4) |
+ */
+static const int bench_frame[] = {64, 128, 256, 512, 1024, 1280, 1518, 9018};
+#define BENCH_SIZE_COUNT (sizeof(bench_frame) / sizeof(bench_frame[0]))
+
+/* UDP payload of an Ethernet frame: less MAC header, FCS, IP and UDP headers */
+#define BENCH_PAYLOAD(frame) ((frame) - 18 - 20 - 8)
+#define BENCH_MAX_LEN BENCH_PAYLOAD(9018)
+#define BENCH_TAIL_LEN 18
+
+/* Preamble, SFD and IFG of a frame on wire */
+#define BENCH_WIRE_EXTRA 20
+
+/* Line rate and MTU if sysfs has none, e.g. on a virtual NIC */
+#define BENCH_DEFAULT_MBPS 1000
+#define BENCH_DEFAULT_MTU 1500
+
+#define BENCH_MIN_BATCH 32
+#define BENCH_SETTLE_MS 2000        /* Wait for late packets after a trial */
+#define BENCH_LOADS 10              /* Frame loss at 100%, 90% ... 10% */
+#define BENCH_RESOLUTION 200        /* Search to 0.5% of the line rate */
+#define BENCH_LATENCY_PCT 90        /* Latency at 90% of the throughput */
+#define BENCH_SENT_PCT 98           /* A trial sends 98% of its load at least */
+#define BENCH_READY_PPS 100
+#define BENCH_READY_TRIES 10
+
+struct bench_trial {
+    uint64_t sent;
+    uint64_t recv;                  /* Echoed with good CRC */
+    uint64_t err;                   /* Echoed with CRC error */
+};
+
+struct nim_bench_result {
+    int done;
+    uint64_t max_pps;               /* Line rate of frame size */
+    uint64_t throughput;            /* Highest rate without loss */
+    uint64_t lat_p50;               /* Round trip in ns */
+    uint64_t lat_p99;
+    uint64_t lat_max;
+    int loss_count;
+    double loss[BENCH_LOADS];       /* Percent at 100%, 90% ... of line rate */
+};
+
+/*
+ * RTT probes by -nim-rtt: machine A sends a probe of the sequence number,
+ * machine B echoes it with the time it held the probe. Both timestamps of
+ * an RTT are taken by the kernel, or by the NIC, on machine A.
+ *
+ *   | seq(4) | echo ns(8) | 0 ... |
+ */
+#define RTT_PROBE_LEN 64
+#define RTT_RING 4096               /* Probes in flight at most */
+
+struct rtt_slot {
+    uint32_t seq;
+    uint8_t echoed;
+    uint8_t done;
+    uint64_t tx_sw;
+    uint64_t tx_hw;
+    uint64_t rx_sw;
+    uint64_t rx_hw;
+    uint64_t turn_ns;               /* Held by machine B */
+};
+
+/*
+ * Frames of -nim-engine packet: the packet of NIM test after a broadcast
+ * Ethernet header of NIM_ETHERTYPE. Frames are written into the TX ring and
+ * checked in the RX ring in place, both of TPACKET_V3.
+ */
+#define L2_FRAME_LEN (ETH_HLEN + NET_MAX_NUM)
+#define L2_FRAME_SIZE 2048          /* Slot of a frame in TX ring */
+#define L2_BLOCK_SIZE (1 << 17)
+#define L2_RX_BLOCKS 64
+#define L2_BLOCK_TOV_MS 10
+#define L2_DATA_OFFSET TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+typedef struct _l2_ring {
+    uint8_t *map;
+    size_t map_len;
+    uint8_t *rx;                    /* Blocks of RX ring */
+    unsigned int rx_block;          /* Next block to read */
+    uint8_t *tx;                    /* Frames of TX ring */
+    unsigned int tx_frames;
+    unsigned int tx_frame;          /* Next frame to fill */
+} l2_ring;
+
+/* Buffers and state of benchmark of a NIC */
+typedef struct _bench_ctx {
+    int sockfd;
+    uint32_t ethid;
+    int batch;
+    int len;                        /* UDP payload of frame size tested */
+    uint16_t trial;
+    uint32_t prefix_crc;
+    uint8_t *send_buf;
+    struct mmsghdr *send_msgs;
+    struct iovec *send_iovs;
+    uint8_t *recv_buf;
+    struct mmsghdr *recv_msgs;
+    struct iovec *recv_iovs;
+    uint8_t expect[BENCH_MAX_LEN];
+    hist_t lat;
+} bench_ctx;
+
 /* Global Variables */
 static int net_sockid[MAX_NIC_COUNT];
 
@@ -76,6 +232,47 @@ static uint32_t timeout_rst_cnt[MAX_NIC_COUNT] = {0};
 static uint32_t tesc_err_no[MAX_NIC_COUNT] = {0};
 static uint32_t tesc_lost_no[MAX_NIC_COUNT] = {0};
 
+/* Bit errors of packets with CRC error */
+static errmap_t nim_errmap[MAX_NIC_COUNT];
+
+/*
+ * sendmmsg() and recvmmsg() calls of each NIC, time of sending, and time
+ * from the first to the last packet received
+ */
+static uint64_t udp_calls_send[MAX_NIC_COUNT] = {0};
+static uint64_t udp_calls_recv[MAX_NIC_COUNT] = {0};
+static uint64_t udp_send_ns[MAX_NIC_COUNT] = {0};
+static uint64_t udp_recv_ns[MAX_NIC_COUNT] = {0};
+
+/* CPU time of send and receive threads of each NIC */
+static uint64_t udp_send_cpu_ns[MAX_NIC_COUNT] = {0};
+static uint64_t udp_recv_cpu_ns[MAX_NIC_COUNT] = {0};
+
+/* Offered load of each NIC in pps by -nim-rate, 0: a batch every 1 ms */
+static uint64_t nim_rate;
+
+/* RFC 2544 results and line rate of each NIC */
+static struct nim_bench_result nim_bench[MAX_NIC_COUNT][BENCH_SIZE_COUNT];
+static double bench_line_mbps[MAX_NIC_COUNT];
+
+/* Rings of -nim-engine packet of each NIC */
+static l2_ring l2_rings[MAX_NIC_COUNT];
+
+/* AF_XDP sockets of -nim-engine xdp of each NIC, and a stack of TX frames free */
+static xsk_t nim_xsk[MAX_NIC_COUNT];
+static uint64_t xdp_tx_free[MAX_NIC_COUNT][XSK_RING_SIZE];
+static uint32_t xdp_tx_nfree[MAX_NIC_COUNT];
+static const char *xdp_mode[MAX_NIC_COUNT];     /* Kept for the report after close */
+
+/* RTT probes of each NIC, with timestamps of NIC or not */
+static int rtt_sockid[MAX_NIC_COUNT];
+static uint8_t rtt_hw[MAX_NIC_COUNT];
+static struct hwtstamp_config rtt_hw_saved[MAX_NIC_COUNT];  /* Restored at exit */
+static uint64_t rtt_sent_cnt[MAX_NIC_COUNT];
+static uint64_t rtt_echo_cnt[MAX_NIC_COUNT];
+static hist_t rtt_hist[MAX_NIC_COUNT];
+static hist_t rtt_net_hist[MAX_NIC_COUNT];   /* Less the time held by machine B */
+
 static int32_t udp_send_task_id[MAX_NIC_COUNT];
 static int32_t udp_recv_task_id[MAX_NIC_COUNT];
 
@@ -85,17 +282,55 @@ static ether_port_para net_port_para_send[MAX_NIC_COUNT];
 static int log_fd;
 
 /* Function Defination */
-static void ether_port_init(uint32_t ethid, uint16_t portid);
+static int ether_port_init(uint32_t ethid, uint16_t portid);
 static int udp_test_init(uint32_t ethid, uint16_t portid);
+static int udp_gso_probe(uint32_t ethid, struct sockaddr_in *targetaddr);
 static void udp_send_test(ether_port_para *net_port_para);
 static void udp_recv_test(ether_port_para *net_port_para);
-static int32_t udp_send(int sockfd, char *target_ip, uint16_t port, uint8_t *buff, int32_t length, int32_t ethid);
-static int32_t udp_recv(int sockfd, uint16_t portid, uint8_t *buff, int32_t length, int32_t ethid);
-static int is_udp_write_ready(int sockfd);
-static int is_udp_read_ready(int sockfd);
+static void fill_udp_packet(uint8_t *buff, uint32_t prefix_crc, uint32_t count);
+static int nim_check_packet(uint32_t ethid, uint8_t *pkt, uint32_t len,
+        uint8_t *expect_buf, uint32_t prefix_crc);
+static int udp_send_batch(int sockfd, struct mmsghdr *msgs, int num, uint32_t ethid);
+static int udp_recv_batch(int sockfd, struct mmsghdr *msgs, int num, uint32_t ethid);
+static uint32_t udp_gro_size(struct msghdr *msg, uint32_t len);
+static uint64_t nim_profile_rate(uint64_t elapsed_ns);
+static int nim_wait_tokens(tbucket_t *tb, uint64_t start_ns, int batch, uint32_t ethid);
+static int nim_read_eth_attr(uint32_t ethid, const char *attr);
+static uint64_t bench_max_pps(uint32_t ethid, int frame);
+static void bench_set_len(bench_ctx *ctx, int len);
+static void bench_fill(bench_ctx *ctx, uint8_t *pkt, uint32_t seq, uint64_t tx_ns);
+static void bench_drain(bench_ctx *ctx, struct bench_trial *t, hist_t *lat);
+static void bench_run_trial(bench_ctx *ctx, uint64_t pps, hist_t *lat, struct bench_trial *t);
+static double bench_loss_pct(struct bench_trial *t);
+static int bench_trial_pass(bench_ctx *ctx, struct bench_trial *t, uint64_t pps);
+static void bench_frame_size(bench_ctx *ctx, int frame, struct nim_bench_result *res);
+static void nim_bench_test(ether_port_para *net_port_para);
+static void nim_bench_reflect(ether_port_para *net_port_para);
+static int nim_rtt_init(uint32_t ethid, char *local_ip);
+static void nim_rtt_deinit(uint32_t ethid);
+static void rtt_complete(uint32_t ethid, struct rtt_slot *slot);
+static uint64_t rtt_ts_ns(struct timespec *ts);
+static void rtt_read_tx(uint32_t ethid, struct rtt_slot *ring);
+static int rtt_recv(uint32_t ethid, uint8_t *buf, int flags, uint64_t *rx_sw, uint64_t *rx_hw);
+static void rtt_read_echo(uint32_t ethid, struct rtt_slot *ring);
+static void nim_rtt_probe(ether_port_para *net_port_para);
+static void nim_rtt_echo(ether_port_para *net_port_para);
+static int l2_test_init(uint32_t ethid);
+static int l2_send_batch(uint32_t ethid, uint32_t prefix_crc, uint32_t count, int num);
+static void l2_send_stop(uint32_t ethid);
+static void l2_recv_test(ether_port_para *net_port_para);
+static int xdp_test_init(uint32_t ethid);
+static void xdp_reclaim(uint32_t ethid);
+static int xdp_send_batch(uint32_t ethid, uint32_t prefix_crc, uint32_t count, int num);
+static void xdp_send_stop(uint32_t ethid);
+static void xdp_recv_test(ether_port_para *net_port_para);
 
 static void nim_print_status();
 static void nim_print_result(int fd);
+static void nim_print_errmap(int fd);
+static void nim_print_rate(int fd);
+static void nim_print_bench(int fd);
+static void nim_print_rtt(int fd);
 static void nim_check_pass(void);
 static void *nim_test(void *args);
 
@@ -142,11 +377,144 @@ static void nim_print_result(int fd)
 
     write_file(fd, "%s: %s\n", "ETH",
             test_mod_nim.pass?"PASS":"FAIL");
+
+    if (g_nim_rfc2544 > 0) {
+        nim_print_bench(fd);
+    } else {
+        nim_print_rate(fd);
+    }
+    if (g_nim_rtt > 0) {
+        nim_print_rtt(fd);
+    }
+    nim_print_errmap(fd);
+}
+
+/* Print packet rate, syscalls and CPU per packet of each NIC */
+static void nim_print_rate(int fd)
+{
+    int i;
+
+    if (nim_rate > 0) {
+        write_file(fd, "    Offered load: %llu pkt/s (%.1f Mbps on wire), profile %s\n",
+                (unsigned long long)nim_rate,
+                nim_rate * NET_WIRE_BYTES * 8 / 1000000.0,
+                (g_nim_profile == NIM_PROFILE_RAMP) ? "ramp" :
+                (g_nim_profile == NIM_PROFILE_STEP) ? "step" : "const");
+    }
+
+    for (i = 0; i < MAX_NIC_COUNT; i++) {
+        if (!g_nim_test_eth[i]) {
+            continue;
+        }
+
+        write_file(fd, "    NIC%d: batch %d, TX %llu pkt/s, %.3f syscalls/pkt, "
+                "RX %llu pkt/s, %.3f syscalls/pkt\n", i, g_nim_batch,
+                udp_send_ns[i] ? (unsigned long long)(udp_cnt_send[i] * 1000000000.0 / udp_send_ns[i]) : 0ULL,
+                udp_cnt_send[i] ? (double)udp_calls_send[i] / udp_cnt_send[i] : 0.0,
+                udp_recv_ns[i] ? (unsigned long long)(udp_cnt_recv[i] * 1000000000.0 / udp_recv_ns[i]) : 0ULL,
+                udp_cnt_recv[i] ? (double)udp_calls_recv[i] / udp_cnt_recv[i] : 0.0);
+
+        /* Packets per second of CPU time of the send and receive threads */
+        if (g_nim_engine == NIM_ENGINE_XDP) {
+            write_file(fd, "    NIC%d: xdp engine, queue %d, %s, ", i, g_nim_xdp_queue,
+                    xdp_mode[i] ? xdp_mode[i] : "not open");
+        } else {
+            write_file(fd, "    NIC%d: %s engine, ", i,
+                    (g_nim_engine == NIM_ENGINE_PACKET) ? "packet" :
+                    (g_nim_offload == NIM_OFFLOAD_GSO) ? "udp gso/gro" : "udp");
+        }
+        write_file(fd, "TX %.3f Mpps, %.3f Mpps/core, RX %.3f Mpps, %.3f Mpps/core\n",
+                udp_send_ns[i] ? udp_cnt_send[i] * 1000.0 / udp_send_ns[i] : 0.0,
+                udp_send_cpu_ns[i] ? udp_cnt_send[i] * 1000.0 / udp_send_cpu_ns[i] : 0.0,
+                udp_recv_ns[i] ? udp_cnt_recv[i] * 1000.0 / udp_recv_ns[i] : 0.0,
+                udp_recv_cpu_ns[i] ? udp_cnt_recv[i] * 1000.0 / udp_recv_cpu_ns[i] : 0.0);
+
+        /* Share of a core taken by each Gbps of payload, ns of CPU per bit */
+        write_file(fd, "    NIC%d: CPU per Gbps, TX %.1f%% of a core, RX %.1f%% of a core\n", i,
+                udp_cnt_send[i] ? udp_send_cpu_ns[i] * 100.0 / ((double)udp_cnt_send[i] * NET_MAX_NUM * 8) : 0.0,
+                udp_cnt_recv[i] ? udp_recv_cpu_ns[i] * 100.0 / ((double)udp_cnt_recv[i] * NET_MAX_NUM * 8) : 0.0);
+    }
+}
+
+/* Print the RFC 2544 throughput, latency and frame loss of each NIC */
+static void nim_print_bench(int fd)
+{
+    struct nim_bench_result *res;
+    int i;
+    int j;
+    int k;
+
+    if (g_machine != 'A') {
+        return;
+    }
+
+    for (i = 0; i < MAX_NIC_COUNT; i++) {
+        if (!g_nim_test_eth[i]) {
+            continue;
+        }
+
+        write_file(fd, "    NIC%d RFC 2544, line rate %.0f Mbps, %d s per trial:\n", i,
+                bench_line_mbps[i], g_nim_rfc2544);
+        write_file(fd, "        %-6s %-10s %-8s %-8s %-9s %-9s %-9s\n", "FRAME",
+                "PKT/s", "Mbps", "LINE(%)", "p50(us)", "p99(us)", "max(us)");
+        for (j = 0; j < (int)BENCH_SIZE_COUNT; j++) {
+            res = &nim_bench[i][j];
+            if (!res->done) {
+                continue;
+            }
+
+            write_file(fd, "        %-6d %-10llu %-8.1f %-8.1f %-9.1f %-9.1f %-9.1f\n",
+                    bench_frame[j], (unsigned long long)res->throughput,
+                    res->throughput * (bench_frame[j] + BENCH_WIRE_EXTRA) * 8 / 1000000.0,
+                    res->max_pps ? res->throughput * 100.0 / res->max_pps : 0.0,
+                    res->lat_p50 / 1000.0, res->lat_p99 / 1000.0, res->lat_max / 1000.0);
+        }
+
+        write_file(fd, "    NIC%d frame loss(%%) by load of line rate:\n", i);
+        write_file(fd, "        %-6s", "FRAME");
+        for (k = 0; k < BENCH_LOADS; k++) {
+            write_file(fd, " %5d%%", (BENCH_LOADS - k) * 100 / BENCH_LOADS);
+        }
+        write_file(fd, "\n");
+        for (j = 0; j < (int)BENCH_SIZE_COUNT; j++) {
+            res = &nim_bench[i][j];
+            if (!res->done) {
+                continue;
+            }
+
+            write_file(fd, "        %-6d", bench_frame[j]);
+            for (k = 0; k < BENCH_LOADS; k++) {
+                if (k < res->loss_count) {
+                    write_file(fd, " %6.2f", res->loss[k]);
+                } else {
+                    write_file(fd, "      -");
+                }
+            }
+            write_file(fd, "\n");
+        }
+    }
+}
+
+/* Print the bit error histograms of NICs with CRC errors */
+static void nim_print_errmap(int fd)
+{
+    char name[16];
+    int i;
+
+    for (i = 0; i < MAX_NIC_COUNT; i++) {
+        if (!g_nim_test_eth[i] || nim_errmap[i].frames == 0) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "NIC%d", i);
+        errmap_print(fd, name, &nim_errmap[i]);
+    }
 }
 
 static void nim_check_pass(void)
 {
     int i = 0;
+    int j;
     uint8_t flag = 1;
 
     for (i = 0; i < MAX_NIC_COUNT; i++) {
@@ -165,6 +533,15 @@ static void nim_check_pass(void)
             flag = 0;
             break;
         }
+
+        /* A frame size benchmarked without throughput */
+        if (g_nim_rfc2544 > 0 && g_machine == 'A') {
+            for (j = 0; j < (int)BENCH_SIZE_COUNT; j++) {
+                if (nim_bench[i][j].done && nim_bench[i][j].throughput == 0) {
+                    flag = 0;
+                }
+            }
+        }
     }
 
     test_mod_nim.pass = flag;
@@ -177,6 +554,7 @@ static void *nim_test(void *args)
 
     pthread_t ptid_r[MAX_NIC_COUNT];
     pthread_t ptid_s[MAX_NIC_COUNT];
+    pthread_t ptid_t[MAX_NIC_COUNT];
 
     print_version(log_fd, "NIM");
     log_print(log_fd, "Begin test!\n\n");
@@ -187,6 +565,45 @@ static void *nim_test(void *args)
     memset(timeout_rst_cnt, 0, MAX_NIC_COUNT * sizeof(uint32_t));
     memset(tesc_err_no, 0, MAX_NIC_COUNT * sizeof(uint32_t));
     memset(tesc_lost_no, 0, MAX_NIC_COUNT * sizeof(uint32_t));
+    memset(udp_calls_send, 0, MAX_NIC_COUNT * sizeof(uint64_t));
+    memset(udp_calls_recv, 0, MAX_NIC_COUNT * sizeof(uint64_t));
+    memset(udp_send_ns, 0, MAX_NIC_COUNT * sizeof(uint64_t));
+    memset(udp_recv_ns, 0, MAX_NIC_COUNT * sizeof(uint64_t));
+    memset(udp_send_cpu_ns, 0, MAX_NIC_COUNT * sizeof(uint64_t));
+    memset(udp_recv_cpu_ns, 0, MAX_NIC_COUNT * sizeof(uint64_t));
+    memset(nim_bench, 0, sizeof(nim_bench));
+    memset(rtt_sent_cnt, 0, MAX_NIC_COUNT * sizeof(uint64_t));
+    memset(rtt_echo_cnt, 0, MAX_NIC_COUNT * sizeof(uint64_t));
+
+    nim_rate = g_nim_pps;
+    if (g_nim_mbps > 0) {
+        nim_rate = (uint64_t)(g_nim_mbps * 1000000 / (NET_WIRE_BYTES * 8));
+        if (nim_rate == 0) {
+            nim_rate = 1;
+        }
+    }
+    if (nim_rate > 0) {
+        log_print(log_fd, "Offered load %llu pkt/s per NIC, %d packets per batch\n",
+                (unsigned long long)nim_rate, g_nim_batch);
+        /* A wait shorter than the timer slack can't be made */
+        if (nim_rate / g_nim_batch > 20000) {
+            log_print(log_fd, "Over 20000 batches/s, use a larger -nim-batch\n");
+        }
+    }
+    for (i = 0; i < MAX_NIC_COUNT; i++) {
+        errmap_init(&nim_errmap[i]);
+        hist_init(&rtt_hist[i]);
+        hist_init(&rtt_net_hist[i]);
+    }
+
+    /* Small frames at line rate need batches */
+    if (g_nim_rfc2544 > 0 && g_nim_batch < BENCH_MIN_BATCH) {
+        g_nim_batch = BENCH_MIN_BATCH;
+    }
+    if (g_nim_rfc2544 > 0) {
+        log_print(log_fd, "RFC 2544 benchmark, %d s per trial, %d packets per batch\n",
+                g_nim_rfc2544, g_nim_batch);
+    }
 
     /* test init & ethernet port init*/
     for (i = 0; i < MAX_NIC_COUNT; i++) {
@@ -195,10 +612,17 @@ static void *nim_test(void *args)
         }
 
         int ret;
-        ret = udp_test_init(i, UDP_PORT);
-        if (ret == 0) {
-            ether_port_init(i, UDP_PORT);
+        if (g_nim_engine == NIM_ENGINE_PACKET) {
+            ret = l2_test_init(i);
+        } else if (g_nim_engine == NIM_ENGINE_XDP) {
+            ret = xdp_test_init(i);
         } else {
+            ret = udp_test_init(i, UDP_PORT);
+            if (ret == 0) {
+                ret = ether_port_init(i, UDP_PORT);
+            }
+        }
+        if (ret != 0) {
             log_print(log_fd, "NIC%d init error!\n", i);
             test_mod_nim.pass = 0;
         }
@@ -216,7 +640,22 @@ static void *nim_test(void *args)
             continue;
         }
 
-        udp_recv_task_id[i] = pthread_create(&ptid_r[i], NULL, (void *)udp_recv_test, &net_port_para_recv[i]);
+        /* Machine A runs the benchmark, machine B echoes the packets */
+        if (g_nim_rfc2544 > 0) {
+            udp_send_task_id[i] = pthread_create(&ptid_s[i], NULL,
+                    (void *)((g_machine == 'A') ? nim_bench_test : nim_bench_reflect),
+                    &net_port_para_send[i]);
+            if (udp_send_task_id[i] != 0) {
+                log_print(log_fd, "Port %d benchmark spawn failed!\n", i);
+                test_mod_nim.pass = 0;
+            }
+            continue;
+        }
+
+        udp_recv_task_id[i] = pthread_create(&ptid_r[i], NULL,
+                (void *)((g_nim_engine == NIM_ENGINE_PACKET) ? l2_recv_test :
+                    (g_nim_engine == NIM_ENGINE_XDP) ? xdp_recv_test : udp_recv_test),
+                &net_port_para_recv[i]);
         if (udp_recv_task_id[i] != 0) {
             log_print(log_fd, "Port %d recv spawn failed!\n", i);
             test_mod_nim.pass = 0;
@@ -227,6 +666,16 @@ static void *nim_test(void *args)
             log_print(log_fd, "Port %d send spawn failed!\n", i);
             test_mod_nim.pass = 0;
         }
+
+        /* RTT probes along with the test traffic */
+        if (g_nim_rtt > 0) {
+            if (pthread_create(&ptid_t[i], NULL,
+                        (void *)((g_machine == 'A') ? nim_rtt_probe : nim_rtt_echo),
+                        &net_port_para_send[i]) != 0) {
+                log_print(log_fd, "Port %d RTT spawn failed!\n", i);
+                test_mod_nim.pass = 0;
+            }
+        }
     }
 
     /* Wait all udp send packet thread and all udp receive packet thread to endup */
@@ -235,18 +684,47 @@ static void *nim_test(void *args)
             continue;
         }
 
-        pthread_join(ptid_r[i], NULL);
+        if (g_nim_rfc2544 == 0) {
+            pthread_join(ptid_r[i], NULL);
+        }
         pthread_join(ptid_s[i], NULL);
+        if (g_nim_rtt > 0) {
+            pthread_join(ptid_t[i], NULL);
+        }
     }
 
+    if (g_nim_rfc2544 > 0) {
+        nim_print_bench(log_fd);
+    } else {
+        nim_print_rate(log_fd);
+    }
+    if (g_nim_rtt > 0) {
+        nim_print_rtt(log_fd);
+    }
+    nim_print_errmap(log_fd);
     log_print(log_fd, "Test end\n\n");
 
 exit:
+    /* The XDP program is detached from the NICs */
+    for (i = 0; i < MAX_NIC_COUNT; i++) {
+        if (nim_xsk[i].umem != NULL) {
+            xsk_close(&nim_xsk[i]);
+        }
+    }
+
+    /* The timestamps of NICs are for all sockets, e.g. of PTP */
+    for (i = 0; i < MAX_NIC_COUNT; i++) {
+        if (rtt_hw[i]) {
+            nim_rtt_deinit(i);
+        }
+    }
+
     pthread_exit(NULL);
 }
 
-static void ether_port_init(uint32_t ethid, uint16_t portid)
+static int ether_port_init(uint32_t ethid, uint16_t portid)
 {
+    struct sockaddr_in targetaddr;
     char *target_ip = NULL;
 
     if (g_dev_sku == SKU_CIM) {
@@ -271,11 +749,42 @@ static void ether_port_init(uint32_t ethid, uint16_t portid)
     net_port_para_send[ethid].port = portid;
     net_port_para_send[ethid].ethid = ethid;
     net_port_para_send[ethid].ip = target_ip;
+
+    /* Connect to the target once, instead of an address per packet */
+    memset(&targetaddr, 0, sizeof(struct sockaddr_in));
+    targetaddr.sin_family = AF_INET;
+    targetaddr.sin_port = htons(portid);
+    targetaddr.sin_addr.s_addr = inet_addr(target_ip);
+
+    if (connect(net_sockid[ethid], (struct sockaddr *)&targetaddr,
+                sizeof(struct sockaddr_in)) == -1) {
+        log_print(log_fd, "NIC%d connect to %s failed!\n", ethid, target_ip);
+
+        return -1;
+    }
+
+    if (g_nim_offload == NIM_OFFLOAD_GSO && udp_gso_probe(ethid, &targetaddr) != 0) {
+        return -1;
+    }
+
+    if (g_nim_rtt > 0) {
+        targetaddr.sin_port = htons(UDP_PORT_RTT);
+        if (connect(rtt_sockid[ethid], (struct sockaddr *)&targetaddr,
+                    sizeof(struct sockaddr_in)) == -1) {
+            log_print(log_fd, "NIC%d RTT connect to %s failed!\n", ethid, target_ip);
+
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 static int udp_test_init(uint32_t ethid, uint16_t portid)
 {
     char *local_ip = NULL;
+    struct timeval tv;
+    int bufsize;
 
     //Initial IP address
     if (g_dev_sku == SKU_CIM) {
@@ -302,7 +811,77 @@ static int udp_test_init(uint32_t ethid, uint16_t portid)
         return -1;
     }
 
-    log_print(log_fd, "NIC%d test init done !\n", ethid);
+    /* Wait up to 1 second for the first packet of a batch */
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    if (setsockopt(net_sockid[ethid], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+        log_print(log_fd, "NIC%d set receive timeout failed!\n", ethid);
+
+        return -1;
+    }
+
+    /* Room for a few batches, over net.core.rmem_max/wmem_max as root */
+    if (g_nim_batch > 1) {
+        bufsize = g_nim_batch * NET_BUF_BATCHES
+            * ((g_nim_rfc2544 > 0) ? BENCH_MAX_LEN : NET_MAX_NUM);
+        if (setsockopt(net_sockid[ethid], SOL_SOCKET, SO_RCVBUFFORCE, &bufsize, sizeof(bufsize)) < 0) {
+            setsockopt(net_sockid[ethid], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+        }
+        if (setsockopt(net_sockid[ethid], SOL_SOCKET, SO_SNDBUFFORCE, &bufsize, sizeof(bufsize)) < 0) {
+            setsockopt(net_sockid[ethid], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+        }
+    }
+
+    /* Packets of NET_MAX_NUM split from a send, coalesced on receive */
+    if (g_nim_offload == NIM_OFFLOAD_GSO) {
+        bufsize = NET_MAX_NUM;
+        if (setsockopt(net_sockid[ethid], SOL_UDP, UDP_SEGMENT, &bufsize, sizeof(bufsize)) < 0) {
+            log_print(log_fd, "NIC%d UDP GSO is not supported: %s!\n", ethid, strerror(errno));
+
+            return -1;
+        }
+        bufsize = 1;
+        if (setsockopt(net_sockid[ethid], SOL_UDP, UDP_GRO, &bufsize, sizeof(bufsize)) < 0) {
+            log_print(log_fd, "NIC%d UDP GRO is not supported: %s!\n", ethid, strerror(errno));
+
+            return -1;
+        }
+    }
+
+    if (g_nim_rtt > 0 && nim_rtt_init(ethid, local_ip) != 0) {
+        return -1;
+    }
+
+    log_print(log_fd, "NIC%d test init done%s !\n", ethid,
+            (g_nim_offload == NIM_OFFLOAD_GSO) ? ", UDP GSO/GRO" : "");
+
+    return 0;
+}
+
+/*
+ * Send one message of UDP GSO to the discard port of the target, so the
+ * test socket of machine B never sees it. UDP_SEGMENT is accepted by any
+ * socket, but the send fails with EIO if the NIC has no TX checksum
+ * offload, and so would every send of the test.
+ *
+ * Return: 0 GSO works, -1 it doesn't
+ */
+static int udp_gso_probe(uint32_t ethid, struct sockaddr_in *targetaddr)
+{
+    struct sockaddr_in probeaddr = *targetaddr;
+    uint8_t buf[2 * NET_MAX_NUM];
+
+    memset(buf, 0, sizeof(buf));
+    probeaddr.sin_port = htons(UDP_PORT_DISCARD);
+
+    if (sendto(net_sockid[ethid], buf, sizeof(buf), MSG_DONTWAIT,
+                (struct sockaddr *)&probeaddr, sizeof(probeaddr)) < 0 && errno == EIO) {
+        log_print(log_fd, "NIC%d UDP GSO needs TX checksum offload, "
+                "turn it on (ethtool -K eth%u tx on) or use -nim-offload none!\n",
+                ethid, ethid);
+
+        return -1;
+    }
 
     return 0;
 }
@@ -311,58 +890,118 @@ static void udp_send_test(ether_port_para *net_port_para)
 {
     int sockfd;
     uint32_t ethid;
-    uint16_t portid;
     char *tgt_ip = NULL;
 
-    int i, j = 0, send_num;
-    uint8_t send_buf[NET_MAX_NUM];
+    int i, j = 0, k, num, send_num;
+    int nmsgs, segs;
+    int batch = g_nim_batch;
+    uint8_t *send_buf;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    tbucket_t tb;
+    uint64_t depth;
+    uint64_t start_ns;
+    uint64_t cpu_ns;
 
-    uint32_t calculated_crc;
+    uint32_t prefix_crc;
 
     sockfd = net_port_para->sockfd;
     ethid = net_port_para->ethid;
-    portid = net_port_para->port;
 
     tgt_ip = net_port_para->ip;
 
-    /* Packaging byte 0 - NET_MAX_NUM - 8 */
-    for (i = 0; i < NET_MAX_NUM - 8; i++) {
-        send_buf[i] = i;
+    send_buf = malloc(batch * NET_MAX_NUM);
+    msgs = calloc(batch, sizeof(struct mmsghdr));
+    iovs = calloc(batch, sizeof(struct iovec));
+    if (send_buf == NULL || msgs == NULL || iovs == NULL) {
+        log_print(log_fd, "NIC%d: out of memory!\n", ethid);
+        test_mod_nim.pass = 0;
+        goto out;
+    }
+
+    /* Packaging byte 0 - NET_MAX_NUM - 8 of each packet in batch */
+    for (k = 0; k < batch; k++) {
+        for (i = 0; i < NET_MAX_NUM - 8; i++) {
+            send_buf[k * NET_MAX_NUM + i] = i;
+        }
+
+        iovs[k].iov_base = send_buf + k * NET_MAX_NUM;
+        iovs[k].iov_len = NET_MAX_NUM;
+        msgs[k].msg_hdr.msg_iov = &iovs[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
     }
 
+    /* The CRC of constant bytes is calculated once */
+    prefix_crc = crc32(0, send_buf, NET_MAX_NUM - 8);
+
     /* Wait receive thread to ready */
     sleep_ms(500);
 
+    depth = nim_rate * NET_RATE_DEPTH_MS / 1000;
+    if (depth < (uint64_t)batch * 2) {
+        depth = batch * 2;
+    }
+
+    start_ns = get_time_ns();
+    cpu_ns = get_thread_cpu_ns();
+    tbucket_init(&tb, 0, depth, start_ns);
+
     while (g_running) {
-        /* Send packages count */
-        send_buf[NET_MAX_NUM - 5] = (uint8_t)(udp_cnt_send[ethid] & 0xff);
-        send_buf[NET_MAX_NUM - 6] = (uint8_t)(udp_cnt_send[ethid] >> 8 & 0xff);
-        send_buf[NET_MAX_NUM - 7] = (uint8_t)(udp_cnt_send[ethid] >> 16 & 0xff);
-        send_buf[NET_MAX_NUM - 8] = (uint8_t)(udp_cnt_send[ethid] >> 24 & 0xff);
-
-        /* calucate CRC */
-        calculated_crc = crc32(0, send_buf, NET_MAX_NUM - 4);
-        send_buf[NET_MAX_NUM - 1] = (uint8_t)(calculated_crc & 0xff);
-        send_buf[NET_MAX_NUM - 2] = (uint8_t)(calculated_crc >> 8 & 0xff);
-        send_buf[NET_MAX_NUM - 3] = (uint8_t)(calculated_crc >> 16 & 0xff);
-        send_buf[NET_MAX_NUM - 4] = (uint8_t)(calculated_crc >> 24 & 0xff);
-
-        send_num = udp_send(sockfd, tgt_ip, portid, send_buf, NET_MAX_NUM, ethid);
-        if (send_num != NET_MAX_NUM) {
-            log_print(log_fd, "udp send failed!\n");
+        /* A batch every 1 ms, or the packets allowed by the token bucket */
+        num = batch;
+        if (nim_rate > 0) {
+            num = nim_wait_tokens(&tb, start_ns, batch, ethid);
+            if (num == 0) {
+                continue;
+            }
+        }
+
+        if (g_nim_engine == NIM_ENGINE_PACKET) {
+            send_num = l2_send_batch(ethid, prefix_crc, udp_cnt_send[ethid], num);
+        } else if (g_nim_engine == NIM_ENGINE_XDP) {
+            send_num = xdp_send_batch(ethid, prefix_crc, udp_cnt_send[ethid], num);
         } else {
-            udp_cnt_send[ethid]++;
+            for (k = 0; k < num; k++) {
+                fill_udp_packet(send_buf + k * NET_MAX_NUM, prefix_crc,
+                        udp_cnt_send[ethid] + k);
+            }
 
-            j++;
-            /* print log after given times */
-            if (j >= LOG_INTERVAL_TIME) {
-                log_print(log_fd, "NIC%d: send udp packets count %u.\n", ethid, udp_cnt_send[ethid]);
-                j = 0;
+            if (g_nim_offload == NIM_OFFLOAD_GSO) {
+                /* The packets in a row make super-buffers of NET_GSO_SEGS */
+                nmsgs = (num + NET_GSO_SEGS - 1) / NET_GSO_SEGS;
+                for (k = 0; k < nmsgs; k++) {
+                    segs = num - k * NET_GSO_SEGS;
+                    if (segs > NET_GSO_SEGS) {
+                        segs = NET_GSO_SEGS;
+                    }
+                    iovs[k].iov_base = send_buf + k * NET_GSO_SEGS * NET_MAX_NUM;
+                    iovs[k].iov_len = segs * NET_MAX_NUM;
+                }
+
+                send_num = udp_send_batch(sockfd, msgs, nmsgs, ethid);
+                send_num = (send_num == nmsgs) ? num : send_num * NET_GSO_SEGS;
+            } else {
+                send_num = udp_send_batch(sockfd, msgs, num, ethid);
             }
         }
+        if (send_num != num) {
+            log_print(log_fd, "udp send failed!\n");
+        }
+        udp_cnt_send[ethid] += send_num;
 
-        sleep_ms(1);
+        j += send_num;
+        /* print log after given times */
+        if (j >= LOG_INTERVAL_TIME * batch) {
+            log_print(log_fd, "NIC%d: send udp packets count %u.\n", ethid, udp_cnt_send[ethid]);
+            j = 0;
+        }
+
+        if (nim_rate == 0) {
+            sleep_ms(1);
+        }
     }
+    udp_send_ns[ethid] = get_time_ns() - start_ns;
+    udp_send_cpu_ns[ethid] = get_thread_cpu_ns() - cpu_ns;
 
     /* sync for stopping*/
     if (g_running == 0) {
@@ -370,189 +1009,1681 @@ static void udp_send_test(ether_port_para *net_port_para)
             send_buf[i] = 0x55;
         }
 
-        send_num = udp_send(sockfd, tgt_ip, portid, send_buf, NET_MAX_NUM, ethid);
-        if (send_num != NET_MAX_NUM) {
+        if (g_nim_engine == NIM_ENGINE_PACKET) {
+            l2_send_stop(ethid);
+        } else if (g_nim_engine == NIM_ENGINE_XDP) {
+            xdp_send_stop(ethid);
+        } else if (send(sockfd, send_buf, NET_MAX_NUM, 0) != NET_MAX_NUM) {
             log_print(log_fd, "udp send failed!\n");
         }
 
-        log_print(log_fd, "send sync packet for stopping!\n");
+        log_print(log_fd, "send sync packet for stopping to %s!\n", tgt_ip);
     }
+
+out:
+    free(iovs);
+    free(msgs);
+    free(send_buf);
 }
 
 static void udp_recv_test(ether_port_para *net_port_para)
 {
     int sockfd;
     uint32_t ethid;
-    uint16_t portid;
     int recv_num;
-    uint8_t recv_buf[NET_MAX_NUM];
+    int batch = g_nim_batch;
+    uint8_t *recv_buf;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    uint8_t *ctrl_buf = NULL;
+    uint8_t expect_buf[NET_MAX_NUM];
 
-    uint32_t stored_crc;
-    uint32_t calculated_crc;
-    uint32_t udp_cnt_read;
+    uint64_t first_ns = 0;
+    uint64_t now_ns;
+    uint64_t cpu_ns = get_thread_cpu_ns();
 
-    int i = 0, j = 0;
+    uint32_t prefix_crc;
+    uint32_t len, seg, off;
+    int gro = (g_nim_offload == NIM_OFFLOAD_GSO);
+    int stride = NET_MAX_NUM;
+    int ctrl_len = CMSG_SPACE(sizeof(uint16_t));
+
+    int i = 0, j = 0, k, ret;
 
     sockfd = net_port_para->sockfd;
     ethid = net_port_para->ethid;
-    portid = net_port_para->port;
 
-    memset(recv_buf, 0, NET_MAX_NUM);
+    /* A message of GRO holds datagrams coalesced, and their size in cmsg */
+    if (gro) {
+        stride = NET_GRO_LEN;
+        if (batch > NET_GRO_MSGS) {
+            batch = NET_GRO_MSGS;
+        }
+    }
+
+    recv_buf = calloc(batch, stride);
+    msgs = calloc(batch, sizeof(struct mmsghdr));
+    iovs = calloc(batch, sizeof(struct iovec));
+    if (gro) {
+        ctrl_buf = calloc(batch, ctrl_len);
+    }
+    if (recv_buf == NULL || msgs == NULL || iovs == NULL || (gro && ctrl_buf == NULL)) {
+        log_print(log_fd, "NIC%d: out of memory!\n", ethid);
+        test_mod_nim.pass = 0;
+        goto out;
+    }
 
-    while (g_running) {
-        recv_num = udp_recv(sockfd, portid, recv_buf, NET_MAX_NUM, ethid);
+    for (k = 0; k < batch; k++) {
+        iovs[k].iov_base = recv_buf + k * stride;
+        iovs[k].iov_len = stride;
+        msgs[k].msg_hdr.msg_iov = &iovs[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
 
-        if (recv_num == NET_MAX_NUM) {
-            /* sync for stopping */
-            if (((recv_buf[i] & 0xaa) || (recv_buf[i + 1] & 0xaa) || (recv_buf[i + 2] & 0xaa) || (recv_buf[i + 3] & 0xaa)) == 0) {
-                g_running = 0;
-                break;
-            }
+    /* Same payload as udp_send_test(), the count is filled per packet */
+    for (i = 0; i < NET_MAX_NUM - 8; i++) {
+        expect_buf[i] = i;
+    }
+    prefix_crc = crc32(0, expect_buf, NET_MAX_NUM - 8);
 
-            /* reset flag for timeout */
-            timeout_rst_cnt[ethid] = 0;
+    while (g_running) {
+        /* The lengths of control are overwritten by each receive */
+        for (k = 0; gro && k < batch; k++) {
+            msgs[k].msg_hdr.msg_control = ctrl_buf + k * ctrl_len;
+            msgs[k].msg_hdr.msg_controllen = ctrl_len;
+        }
 
-            calculated_crc = crc32(0, recv_buf, NET_MAX_NUM - 4);
+        recv_num = udp_recv_batch(sockfd, msgs, batch, ethid);
+        if (recv_num == 0) {
+            log_print(log_fd, "NIC%d: receive timeout [no.%d], no data is incoming.\n", ethid, timeout_rst_cnt[ethid]);
+            continue;
+        }
 
-            stored_crc = (uint32_t)((recv_buf[NET_MAX_NUM - 1]) | (recv_buf[NET_MAX_NUM - 2] << 8)  \
-                 | (recv_buf[NET_MAX_NUM -3] << 16) | (recv_buf[NET_MAX_NUM - 4] << 24));
+        now_ns = get_time_ns();
+        if (first_ns == 0) {
+            first_ns = now_ns;
+        }
+        udp_recv_ns[ethid] = now_ns - first_ns;
+
+        /* Check the packets of batch, each split from a message of GRO */
+        for (k = 0; k < recv_num && g_running; k++) {
+            len = msgs[k].msg_len;
+            seg = gro ? udp_gro_size(&msgs[k].msg_hdr, len) : len;
+
+            for (off = 0; off < len && g_running; off += seg) {
+                ret = nim_check_packet(ethid, recv_buf + k * stride + off,
+                        (len - off < seg) ? len - off : seg, expect_buf, prefix_crc);
+                if (ret < 0) {
+                    continue;
+                }
 
-            if (calculated_crc != stored_crc) {
-                tesc_err_no[ethid]++;
-                log_print(log_fd, "NIC%d: CRC error, number %u.\n", ethid, tesc_err_no[ethid]);
-            } else {  /* crc is good */
-                udp_cnt_read = (uint32_t)((recv_buf[NET_MAX_NUM - 5]) | (recv_buf[NET_MAX_NUM - 6] << 8)    \
-                    | (recv_buf[NET_MAX_NUM - 7] << 16) | (recv_buf[NET_MAX_NUM - 8] << 24));
-
-                /* Calulate the number of lost packages, care it */
-                if (udp_cnt_read >= udp_cnt_recv[ethid]) {
-                    tesc_lost_no[ethid] += (udp_cnt_read - udp_cnt_recv[ethid]);
-                    udp_cnt_recv[ethid] = udp_cnt_read;
-                } else if (udp_cnt_read < udp_cnt_recv[ethid]) {
-                    /* Maybe the package is late in sequence, here skip it */
-                    //log_print(log_fd, "NIC%d: receive notice, maybe has received packages from other machine, or the package maybe late\n", ethid);
+                /* sync for stopping */
+                if (ret > 0) {
+                    g_running = 0;
+                    break;
                 }
-            }
-            udp_cnt_recv[ethid]++;
 
-            j++;
+                j++;
 
-            /* print log after given times */
-            if (j >= LOG_INTERVAL_TIME) {
-                log_print(log_fd, "NIC%d: recv udp count = %u, lost no = %u, err no = %u\n", \
-                    ethid, udp_cnt_recv[ethid], tesc_lost_no[ethid], tesc_err_no[ethid]);
-                j = 0;
-             }
-        } else if ((recv_num > 0) && (recv_num < NET_MAX_NUM)) {
-            log_print(log_fd, "NIC%d: receive packet of %d bytes, lost %d bytes!\n", \
-                    ethid, recv_num, NET_MAX_NUM - recv_num);
-        } else {
-            log_print(log_fd, "NIC%d: receive timeout [no.%d], no data is incoming.\n", ethid, timeout_rst_cnt[ethid]);
+                /* print log after given times */
+                if (j >= LOG_INTERVAL_TIME * g_nim_batch) {
+                    log_print(log_fd, "NIC%d: recv udp count = %u, lost no = %u, err no = %u\n", \
+                        ethid, udp_cnt_recv[ethid], tesc_lost_no[ethid], tesc_err_no[ethid]);
+                    j = 0;
+                }
+            }
         }
     }
+    udp_recv_cpu_ns[ethid] = get_thread_cpu_ns() - cpu_ns;
+
+out:
+    free(ctrl_buf);
+    free(iovs);
+    free(msgs);
+    free(recv_buf);
 }
 
-static int32_t udp_send(int sockfd, char *target_ip, uint16_t port, uint8_t *buff, int32_t length, int32_t ethid)
+/*
+ * Check a packet received by its CRC, and count the packets lost before it.
+ *
+ * Return: 0 checked, 1 the sync packet for stopping, -1 wrong length
+ */
+static int nim_check_packet(uint32_t ethid, uint8_t *pkt, uint32_t len,
+        uint8_t *expect_buf, uint32_t prefix_crc)
 {
-    struct sockaddr_in targetaddr;
-    int32_t send_num = 0;
+    uint32_t stored_crc;
+    uint32_t calculated_crc;
+    uint32_t udp_cnt_read;
+    uint64_t bit_err;
 
-    if ((buff == NULL) || (target_ip == NULL)) {
-        DBG_PRINT("udp_send error: NULL pointer!\n");
+    if (len != NET_MAX_NUM) {
+        log_print(log_fd, "NIC%d: receive packet of %u bytes, lost %u bytes!\n", \
+                ethid, len, NET_MAX_NUM - len);
+        return -1;
     }
 
-    memset(&targetaddr, 0, sizeof(struct sockaddr_in));
-
-    targetaddr.sin_family = AF_INET;
-    targetaddr.sin_port = htons(port);
-    targetaddr.sin_addr.s_addr = inet_addr(target_ip);
+    /* sync for stopping */
+    if (((pkt[0] & 0xaa) || (pkt[1] & 0xaa) || (pkt[2] & 0xaa) || (pkt[3] & 0xaa)) == 0) {
+        return 1;
+    }
 
-    if (is_udp_write_ready(sockfd) == 0) {
-        send_num = sendto(sockfd, buff, length, 0, (struct sockaddr *)(&targetaddr), sizeof(struct sockaddr_in));
-        if (send_num == -1) {
-            log_print(log_fd, "sendto: NIC%d send to %s failed!\n", ethid, target_ip);
+    /* reset flag for timeout */
+    timeout_rst_cnt[ethid] = 0;
 
-            return -1;
-        }
+    /* Continue from the CRC of constant bytes if they are intact */
+    if (memcmp(pkt, expect_buf, NET_MAX_NUM - 8) == 0) {
+        calculated_crc = crc32(prefix_crc, pkt + NET_MAX_NUM - 8, 4);
     } else {
-        log_print(log_fd, "udp_send failed: now NIC%d busy!\n", ethid);
+        calculated_crc = crc32(0, pkt, NET_MAX_NUM - 4);
+    }
 
-        return -1;
+    stored_crc = (uint32_t)((pkt[NET_MAX_NUM - 1]) | (pkt[NET_MAX_NUM - 2] << 8)  \
+         | (pkt[NET_MAX_NUM -3] << 16) | (pkt[NET_MAX_NUM - 4] << 24));
+
+    if (calculated_crc != stored_crc) {
+        /* The count is not trusted, take it as the next one */
+        expect_buf[NET_MAX_NUM - 5] = (uint8_t)(udp_cnt_recv[ethid] & 0xff);
+        expect_buf[NET_MAX_NUM - 6] = (uint8_t)(udp_cnt_recv[ethid] >> 8 & 0xff);
+        expect_buf[NET_MAX_NUM - 7] = (uint8_t)(udp_cnt_recv[ethid] >> 16 & 0xff);
+        expect_buf[NET_MAX_NUM - 8] = (uint8_t)(udp_cnt_recv[ethid] >> 24 & 0xff);
+        bit_err = errmap_add(&nim_errmap[ethid], pkt, expect_buf, NET_MAX_NUM - 4);
+
+        tesc_err_no[ethid]++;
+        log_print(log_fd, "NIC%d: CRC error, number %u, %llu bit errors.\n", ethid,
+                tesc_err_no[ethid], (unsigned long long)bit_err);
+    } else {  /* crc is good */
+        udp_cnt_read = (uint32_t)((pkt[NET_MAX_NUM - 5]) | (pkt[NET_MAX_NUM - 6] << 8)    \
+            | (pkt[NET_MAX_NUM - 7] << 16) | (pkt[NET_MAX_NUM - 8] << 24));
+
+        /* Calulate the number of lost packages, care it */
+        if (udp_cnt_read >= udp_cnt_recv[ethid]) {
+            tesc_lost_no[ethid] += (udp_cnt_read - udp_cnt_recv[ethid]);
+            udp_cnt_recv[ethid] = udp_cnt_read;
+        } else if (udp_cnt_read < udp_cnt_recv[ethid]) {
+            /* Maybe the package is late in sequence, here skip it */
+            //log_print(log_fd, "NIC%d: receive notice, maybe has received packages from other machine, or the package maybe late\n", ethid);
+        }
     }
+    udp_cnt_recv[ethid]++;
 
-    return send_num;
+    return 0;
 }
 
-static int32_t udp_recv(int sockfd, uint16_t portid, uint8_t *buff, int32_t length, int32_t ethid)
+/* Fill the count and CRC of a packet, continued from the CRC of the constant bytes */
+static void fill_udp_packet(uint8_t *buff, uint32_t prefix_crc, uint32_t count)
 {
-    struct sockaddr_in recv_from_addr;
-    int32_t recv_num = 0;
-    socklen_t addrlen;
-    int tv;
-
-    memset(&recv_from_addr, 0, sizeof(struct sockaddr_in));
-    addrlen = sizeof(struct sockaddr_in);
+    uint32_t calculated_crc;
 
-    tv = is_udp_read_ready(sockfd);
-    if (tv == 0) {
-        recv_num = recvfrom(sockfd, buff, length, 0, (struct sockaddr *)&recv_from_addr, &addrlen);
+    /* Send packages count */
+    buff[NET_MAX_NUM - 5] = (uint8_t)(count & 0xff);
+    buff[NET_MAX_NUM - 6] = (uint8_t)(count >> 8 & 0xff);
+    buff[NET_MAX_NUM - 7] = (uint8_t)(count >> 16 & 0xff);
+    buff[NET_MAX_NUM - 8] = (uint8_t)(count >> 24 & 0xff);
+
+    /* calucate CRC */
+    calculated_crc = crc32(prefix_crc, buff + NET_MAX_NUM - 8, 4);
+    buff[NET_MAX_NUM - 1] = (uint8_t)(calculated_crc & 0xff);
+    buff[NET_MAX_NUM - 2] = (uint8_t)(calculated_crc >> 8 & 0xff);
+    buff[NET_MAX_NUM - 3] = (uint8_t)(calculated_crc >> 16 & 0xff);
+    buff[NET_MAX_NUM - 4] = (uint8_t)(calculated_crc >> 24 & 0xff);
+}
 
-        if (recv_num == -1) {
-            log_print(log_fd, "udp_recv error: %d!\n", ethid);
+/*
+ * Send a batch of packets on the connected socket, blocking while the socket
+ * buffer is full. An ICMP port unreachable from the target (not listening
+ * yet) is reported by the next call, it is retried.
+ */
+static int udp_send_batch(int sockfd, struct mmsghdr *msgs, int num, uint32_t ethid)
+{
+    int sent = 0;
+    int ret;
+
+    while (sent < num) {
+        ret = sendmmsg(sockfd, msgs + sent, num - sent, 0);
+        udp_calls_send[ethid]++;
+        if (ret == -1) {
+            if (errno == EINTR || errno == ECONNREFUSED) {
+                continue;
+            }
+            log_print(log_fd, "sendmmsg: NIC%d send failed: %s!\n", ethid, strerror(errno));
+            break;
         }
-    } else if (tv == 1) {    /* select timeout */
-        timeout_rst_cnt[ethid]++;
+        sent += ret;
     }
 
-    return recv_num;
+    return sent;
 }
 
-static int is_udp_write_ready(int sockfd)
+/*
+ * Receive a batch of packets, waiting up to SO_RCVTIMEO for the first one
+ * and taking the others already queued.
+ *
+ * Return: number of packets, 0 on timeout, -1 on error
+ */
+static int udp_recv_batch(int sockfd, struct mmsghdr *msgs, int num, uint32_t ethid)
 {
-    fd_set wfds;
-    int retval = 0, ret = -1;
-
-    FD_ZERO(&wfds);
-    FD_SET(sockfd, &wfds);
-
-    /* Wait up to 200000 microseconds
-     * tv.tv_sec = 0;
-     * tv.tv_usec = 200000; */
-
-    retval = select(sockfd + 1, NULL, &wfds, NULL, NULL/* or no-blocking: &tv */);
-    if (retval > 0) {
-        if (FD_ISSET(sockfd, &wfds))
-            ret = 0;
-    } else {
-        ret = -1;
+    int ret;
+
+    ret = recvmmsg(sockfd, msgs, num, MSG_WAITFORONE, NULL);
+    udp_calls_recv[ethid]++;
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            timeout_rst_cnt[ethid]++;
+            return 0;
+        }
+        if (errno != EINTR && errno != ECONNREFUSED) {
+            log_print(log_fd, "udp_recv error: %d!\n", ethid);
+        }
+        return -1;
     }
 
     return ret;
 }
 
-static int is_udp_read_ready(int sockfd)
+/*
+ * Get the size of datagrams coalesced in a message by GRO, from the cmsg of
+ * UDP_GRO, the last one may be shorter. A message without it is one
+ * datagram of len.
+ */
+static uint32_t udp_gro_size(struct msghdr *msg, uint32_t len)
 {
-    fd_set rfds;
-    int retval = 0, ret = -1;
-    struct timeval tv;
+    struct cmsghdr *cmsg;
+    uint16_t size;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            if (size > 0) {
+                return size;
+            }
+        }
+    }
+
+    return len;
+}
 
-    FD_ZERO(&rfds);
-    FD_SET(sockfd, &rfds);
+/* Offered load at a time of test, by the load profile */
+static uint64_t nim_profile_rate(uint64_t elapsed_ns)
+{
+    uint64_t period_ms = (uint64_t)g_nim_profile_secs * 1000;
+    uint64_t elapsed_ms = elapsed_ns / 1000000;
+    uint64_t step;
+
+    switch (g_nim_profile) {
+    case NIM_PROFILE_RAMP:
+        if (elapsed_ms >= period_ms) {
+            return nim_rate;
+        }
+        return nim_rate * elapsed_ms / period_ms;
+    case NIM_PROFILE_STEP:
+        step = elapsed_ms / period_ms + 1;
+        if (step > (uint64_t)g_nim_profile_steps) {
+            step = g_nim_profile_steps;
+        }
+        return nim_rate * step / g_nim_profile_steps;
+    default:
+        return nim_rate;
+    }
+}
 
-    /* Wait up to 1 second */
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
+/*
+ * Sleep on CLOCK_MONOTONIC until the token bucket has a batch of packets, or
+ * NET_RATE_MAX_WAIT_MS at most, and take the packets of it.
+ *
+ * Return: number of packets to send, 0 ~ batch
+ */
+static int nim_wait_tokens(tbucket_t *tb, uint64_t start_ns, int batch, uint32_t ethid)
+{
+    struct timespec ts;
+    uint64_t now_ns = get_time_ns();
+    uint64_t rate = nim_profile_rate(now_ns - start_ns);
+    uint64_t wait_ns;
+
+    if (rate != tb->rate) {
+        if (g_nim_profile == NIM_PROFILE_STEP) {
+            log_print(log_fd, "NIC%d: offered load %llu pkt/s\n", ethid,
+                    (unsigned long long)rate);
+        }
+        tbucket_set_rate(tb, rate, now_ns);
+    }
 
-    retval = select(sockfd + 1, &rfds, NULL, NULL, &tv /* no-blocking*/);
-    if (retval > 0) {
-        if (FD_ISSET(sockfd, &rfds)) {
-            ret = 0;
+    wait_ns = tbucket_wait_ns(tb, batch, now_ns);
+    if (wait_ns > 0) {
+        if (wait_ns > NET_RATE_MAX_WAIT_MS * 1000000ULL) {
+            wait_ns = NET_RATE_MAX_WAIT_MS * 1000000ULL;
         }
-    } else if (retval == 0) { /* timeout */
-        ret = 1;
-    } else {
-        ret = -1;
+        now_ns += wait_ns;
+        ts.tv_sec = now_ns / 1000000000ULL;
+        ts.tv_nsec = now_ns % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+        now_ns = get_time_ns();
     }
 
-    return ret;
+    return (int)tbucket_take(tb, batch, now_ns);
+}
+
+/* Read an integer attribute of eth%d in sysfs, -1 if there is none */
+static int nim_read_eth_attr(uint32_t ethid, const char *attr)
+{
+    char path[64];
+    FILE *fp;
+    int val = -1;
+
+    snprintf(path, sizeof(path), "/sys/class/net/eth%u/%s", ethid, attr);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fscanf(fp, "%d", &val) != 1) {
+        val = -1;
+    }
+    fclose(fp);
+
+    return val;
+}
+
+/* Highest frame rate of a frame size, by the line rate or -nim-rate in pps */
+static uint64_t bench_max_pps(uint32_t ethid, int frame)
+{
+    uint64_t pps;
+
+    pps = (uint64_t)(bench_line_mbps[ethid] * 1000000 / ((frame + BENCH_WIRE_EXTRA) * 8));
+    if (g_nim_pps > 0 && g_nim_pps < pps) {
+        pps = g_nim_pps;
+    }
+
+    return pps;
+}
+
+/* Set the payload length of frame size tested, and the ramp of each packet */
+static void bench_set_len(bench_ctx *ctx, int len)
+{
+    int k;
+
+    ctx->len = len;
+    for (k = 0; k < ctx->batch; k++) {
+        memcpy(ctx->send_buf + k * BENCH_MAX_LEN, ctx->expect, len - BENCH_TAIL_LEN);
+        ctx->send_iovs[k].iov_len = len;
+    }
+
+    /* The CRC of the ramp is calculated once per size */
+    ctx->prefix_crc = crc32(0, ctx->expect, len - BENCH_TAIL_LEN);
+}
+
+/* Fill the trial id, sequence, TX time and CRC of a packet */
+static void bench_fill(bench_ctx *ctx, uint8_t *pkt, uint32_t seq, uint64_t tx_ns)
+{
+    uint8_t *tail = pkt + ctx->len - BENCH_TAIL_LEN;
+    uint32_t calculated_crc;
+
+    tail[0] = (uint8_t)(ctx->trial >> 8);
+    tail[1] = (uint8_t)(ctx->trial & 0xff);
+    tail[2] = (uint8_t)(seq >> 24 & 0xff);
+    tail[3] = (uint8_t)(seq >> 16 & 0xff);
+    tail[4] = (uint8_t)(seq >> 8 & 0xff);
+    tail[5] = (uint8_t)(seq & 0xff);
+    memcpy(tail + 6, &tx_ns, 8);
+
+    calculated_crc = crc32(ctx->prefix_crc, tail, BENCH_TAIL_LEN - 4);
+    tail[14] = (uint8_t)(calculated_crc >> 24 & 0xff);
+    tail[15] = (uint8_t)(calculated_crc >> 16 & 0xff);
+    tail[16] = (uint8_t)(calculated_crc >> 8 & 0xff);
+    tail[17] = (uint8_t)(calculated_crc & 0xff);
+}
+
+/* Check the echoed packets queued, latency is added to lat if not NULL */
+static void bench_drain(bench_ctx *ctx, struct bench_trial *t, hist_t *lat)
+{
+    uint32_t stored_crc;
+    uint32_t calculated_crc;
+    uint64_t now_ns;
+    uint64_t tx_ns;
+    uint8_t *pkt;
+    uint8_t *tail;
+    int recv_num;
+    int k;
+
+    for (;;) {
+        recv_num = recvmmsg(ctx->sockfd, ctx->recv_msgs, ctx->batch, MSG_DONTWAIT, NULL);
+        udp_calls_recv[ctx->ethid]++;
+        if (recv_num <= 0) {
+            break;
+        }
+
+        now_ns = get_time_ns();
+        for (k = 0; k < recv_num; k++) {
+            pkt = ctx->recv_buf + k * BENCH_MAX_LEN;
+            tail = pkt + ctx->len - BENCH_TAIL_LEN;
+
+            /* Late packets of an earlier trial are not counted */
+            if (ctx->recv_msgs[k].msg_len != (unsigned int)ctx->len
+                    || ((tail[0] << 8) | tail[1]) != ctx->trial) {
+                continue;
+            }
+
+            if (memcmp(pkt, ctx->expect, ctx->len - BENCH_TAIL_LEN) == 0) {
+                calculated_crc = crc32(ctx->prefix_crc, tail, BENCH_TAIL_LEN - 4);
+            } else {
+                calculated_crc = crc32(0, pkt, ctx->len - 4);
+            }
+            stored_crc = (uint32_t)((tail[17]) | (tail[16] << 8)
+                    | (tail[15] << 16) | (tail[14] << 24));
+
+            if (calculated_crc != stored_crc) {
+                t->err++;
+                tesc_err_no[ctx->ethid]++;
+                continue;
+            }
+
+            t->recv++;
+            udp_cnt_recv[ctx->ethid]++;
+            if (lat != NULL) {
+                memcpy(&tx_ns, tail + 6, 8);
+                hist_add(lat, now_ns - tx_ns);
+            }
+        }
+    }
+}
+
+/*
+ * Run a trial: send at a constant rate for -nim-rfc2544 seconds, and count
+ * the packets echoed back until BENCH_SETTLE_MS after the last one is sent.
+ * Packets are sent in batches of 1 ms at most, so the load is smooth at
+ * every rate.
+ */
+static void bench_run_trial(bench_ctx *ctx, uint64_t pps, hist_t *lat, struct bench_trial *t)
+{
+    struct pollfd pfd;
+    struct timespec ts;
+    tbucket_t tb;
+    uint64_t depth;
+    uint64_t now_ns;
+    uint64_t end_ns;
+    uint64_t settle_ns;
+    uint64_t wait_ns;
+    int batch;
+    int num;
+    int k;
+
+    memset(t, 0, sizeof(struct bench_trial));
+    ctx->trial = 0x8000 | ((ctx->trial + 1) & 0x7fff);
+    if (lat != NULL) {
+        hist_init(lat);
+    }
+
+    batch = (int)(pps / 1000);
+    if (batch < 1) {
+        batch = 1;
+    } else if (batch > ctx->batch) {
+        batch = ctx->batch;
+    }
+
+    depth = pps * NET_RATE_DEPTH_MS / 1000;
+    if (depth < (uint64_t)batch * 2) {
+        depth = batch * 2;
+    }
+
+    pfd.fd = ctx->sockfd;
+    pfd.events = POLLIN;
+
+    now_ns = get_time_ns();
+    end_ns = now_ns + g_nim_rfc2544 * 1000000000ULL;
+    settle_ns = end_ns + BENCH_SETTLE_MS * 1000000ULL;
+    tbucket_init(&tb, pps, depth, now_ns);
+
+    while (g_running && now_ns < settle_ns) {
+        wait_ns = settle_ns - now_ns;
+
+        if (now_ns < end_ns) {
+            wait_ns = tbucket_wait_ns(&tb, batch, now_ns);
+            if (wait_ns == 0) {
+                num = (int)tbucket_take(&tb, batch, now_ns);
+                for (k = 0; k < num; k++) {
+                    bench_fill(ctx, ctx->send_buf + k * BENCH_MAX_LEN,
+                            (uint32_t)t->sent + k, get_time_ns());
+                }
+
+                num = udp_send_batch(ctx->sockfd, ctx->send_msgs, num, ctx->ethid);
+                t->sent += num;
+                udp_cnt_send[ctx->ethid] += num;
+            }
+            if (wait_ns > end_ns - now_ns) {
+                wait_ns = end_ns - now_ns;
+            }
+        }
+
+        /* Wait for the tokens, taking the echoes meanwhile */
+        if (wait_ns > NET_RATE_MAX_WAIT_MS * 1000000ULL) {
+            wait_ns = NET_RATE_MAX_WAIT_MS * 1000000ULL;
+        }
+        ts.tv_sec = wait_ns / 1000000000ULL;
+        ts.tv_nsec = wait_ns % 1000000000ULL;
+        if (ppoll(&pfd, 1, &ts, NULL) > 0) {
+            bench_drain(ctx, t, lat);
+        }
+
+        now_ns = get_time_ns();
+    }
+}
+
+/* Frame loss of a trial in percent */
+static double bench_loss_pct(struct bench_trial *t)
+{
+    if (t->sent == 0) {
+        return 100.0;
+    }
+
+    return (double)(t->sent - t->recv) * 100 / t->sent;
+}
+
+/*
+ * A trial passes without loss, and with the load offered. A load the tester
+ * can't send is not taken as the throughput of the other side.
+ */
+static int bench_trial_pass(bench_ctx *ctx, struct bench_trial *t, uint64_t pps)
+{
+    if (t->sent * 100 < pps * g_nim_rfc2544 * BENCH_SENT_PCT) {
+        log_print(log_fd, "NIC%d: sent %llu of %llu packets, limited by tester\n", ctx->ethid,
+                (unsigned long long)t->sent, (unsigned long long)(pps * g_nim_rfc2544));
+        return 0;
+    }
+
+    return t->sent > 0 && t->recv == t->sent;
+}
+
+/*
+ * Benchmark of a frame size: the frame loss at 100%, 90% ... of the line
+ * rate until two trials in a row have no loss (RFC 2544 26.3), then a
+ * binary search between the highest load without loss and the load above
+ * it for the throughput (26.1), and the latency at BENCH_LATENCY_PCT of the
+ * throughput (26.2).
+ */
+static void bench_frame_size(bench_ctx *ctx, int frame, struct nim_bench_result *res)
+{
+    struct bench_trial t;
+    uint64_t max_pps = bench_max_pps(ctx->ethid, frame);
+    uint64_t lo = 0;
+    uint64_t hi = max_pps;
+    uint64_t pps;
+    int zero_run = 0;
+    int k;
+
+    bench_set_len(ctx, BENCH_PAYLOAD(frame));
+    res->max_pps = max_pps;
+
+    for (k = 0; k < BENCH_LOADS && g_running; k++) {
+        pps = max_pps * (BENCH_LOADS - k) / BENCH_LOADS;
+        bench_run_trial(ctx, pps, NULL, &t);
+
+        res->loss[k] = bench_loss_pct(&t);
+        res->loss_count = k + 1;
+        log_print(log_fd, "NIC%d: frame %d, load %llu pkt/s, sent %llu, received %llu, error %llu\n",
+                ctx->ethid, frame, (unsigned long long)pps, (unsigned long long)t.sent,
+                (unsigned long long)t.recv, (unsigned long long)t.err);
+
+        if (bench_trial_pass(ctx, &t, pps)) {
+            if (zero_run++ == 0) {
+                lo = pps;
+            }
+            if (zero_run == 2) {
+                break;
+            }
+        } else {
+            zero_run = 0;
+            lo = 0;
+            hi = pps;
+        }
+    }
+
+    while (g_running && lo < hi && hi - lo > max_pps / BENCH_RESOLUTION) {
+        pps = (lo + hi) / 2;
+        bench_run_trial(ctx, pps, NULL, &t);
+
+        log_print(log_fd, "NIC%d: frame %d, search %llu pkt/s, sent %llu, received %llu\n",
+                ctx->ethid, frame, (unsigned long long)pps, (unsigned long long)t.sent,
+                (unsigned long long)t.recv);
+        if (bench_trial_pass(ctx, &t, pps)) {
+            lo = pps;
+        } else {
+            hi = pps;
+        }
+    }
+    res->throughput = lo;
+
+    if (g_running && lo > 0) {
+        pps = lo * BENCH_LATENCY_PCT / 100;
+        bench_run_trial(ctx, (pps > 0) ? pps : 1, &ctx->lat, &t);
+        if (ctx->lat.count > 0) {
+            res->lat_p50 = hist_percentile(&ctx->lat, 50);
+            res->lat_p99 = hist_percentile(&ctx->lat, 99);
+            res->lat_max = ctx->lat.max;
+        }
+    }
+
+    res->done = g_running;
+    log_print(log_fd, "NIC%d: frame %d, throughput %llu pkt/s of %llu\n", ctx->ethid,
+            frame, (unsigned long long)res->throughput, (unsigned long long)max_pps);
+}
+
+/* Machine A: RFC 2544 benchmark of a NIC, over all frame sizes */
+static void nim_bench_test(ether_port_para *net_port_para)
+{
+    struct bench_trial t;
+    bench_ctx *ctx;
+    int speed;
+    int mtu;
+    int i;
+    int k;
+
+    ctx = calloc(1, sizeof(bench_ctx));
+    if (ctx == NULL) {
+        log_print(log_fd, "NIC%d: out of memory!\n", net_port_para->ethid);
+        test_mod_nim.pass = 0;
+        return;
+    }
+    ctx->sockfd = net_port_para->sockfd;
+    ctx->ethid = net_port_para->ethid;
+    ctx->batch = g_nim_batch;
+
+    ctx->send_buf = malloc(ctx->batch * BENCH_MAX_LEN);
+    ctx->send_msgs = calloc(ctx->batch, sizeof(struct mmsghdr));
+    ctx->send_iovs = calloc(ctx->batch, sizeof(struct iovec));
+    ctx->recv_buf = malloc(ctx->batch * BENCH_MAX_LEN);
+    ctx->recv_msgs = calloc(ctx->batch, sizeof(struct mmsghdr));
+    ctx->recv_iovs = calloc(ctx->batch, sizeof(struct iovec));
+    if (ctx->send_buf == NULL || ctx->send_msgs == NULL || ctx->send_iovs == NULL
+            || ctx->recv_buf == NULL || ctx->recv_msgs == NULL || ctx->recv_iovs == NULL) {
+        log_print(log_fd, "NIC%d: out of memory!\n", ctx->ethid);
+        test_mod_nim.pass = 0;
+        goto out;
+    }
+
+    for (i = 0; i < BENCH_MAX_LEN; i++) {
+        ctx->expect[i] = i;
+    }
+
+    for (k = 0; k < ctx->batch; k++) {
+        ctx->send_iovs[k].iov_base = ctx->send_buf + k * BENCH_MAX_LEN;
+        ctx->send_msgs[k].msg_hdr.msg_iov = &ctx->send_iovs[k];
+        ctx->send_msgs[k].msg_hdr.msg_iovlen = 1;
+
+        ctx->recv_iovs[k].iov_base = ctx->recv_buf + k * BENCH_MAX_LEN;
+        ctx->recv_iovs[k].iov_len = BENCH_MAX_LEN;
+        ctx->recv_msgs[k].msg_hdr.msg_iov = &ctx->recv_iovs[k];
+        ctx->recv_msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Line rate by -nim-rate in Mbps, or the link speed */
+    speed = nim_read_eth_attr(ctx->ethid, "speed");
+    if (g_nim_mbps > 0) {
+        bench_line_mbps[ctx->ethid] = g_nim_mbps;
+    } else if (speed > 0) {
+        bench_line_mbps[ctx->ethid] = speed;
+    } else {
+        bench_line_mbps[ctx->ethid] = BENCH_DEFAULT_MBPS;
+        log_print(log_fd, "NIC%d: unknown link speed, take %d Mbps\n", ctx->ethid,
+                BENCH_DEFAULT_MBPS);
+    }
+
+    mtu = nim_read_eth_attr(ctx->ethid, "mtu");
+    if (mtu <= 0) {
+        mtu = BENCH_DEFAULT_MTU;
+    }
+
+    /* Wait for machine B to echo */
+    bench_set_len(ctx, BENCH_PAYLOAD(bench_frame[0]));
+    for (i = 0; i < BENCH_READY_TRIES && g_running; i++) {
+        bench_run_trial(ctx, BENCH_READY_PPS, NULL, &t);
+        if (t.recv > 0) {
+            break;
+        }
+        log_print(log_fd, "NIC%d: no echo from the other side, retry\n", ctx->ethid);
+    }
+    if (i == BENCH_READY_TRIES) {
+        log_print(log_fd, "NIC%d: no echo from the other side!\n", ctx->ethid);
+        test_mod_nim.pass = 0;
+        goto stop;
+    }
+
+    log_print(log_fd, "NIC%d: RFC 2544 benchmark, line rate %.0f Mbps, MTU %d, %d s per trial\n",
+            ctx->ethid, bench_line_mbps[ctx->ethid], mtu, g_nim_rfc2544);
+
+    for (i = 0; i < (int)BENCH_SIZE_COUNT && g_running; i++) {
+        /* IP packet of frame is over MTU */
+        if (bench_frame[i] - 18 > mtu) {
+            log_print(log_fd, "NIC%d: skip frame %d over MTU %d\n", ctx->ethid,
+                    bench_frame[i], mtu);
+            continue;
+        }
+
+        bench_frame_size(ctx, bench_frame[i], &nim_bench[ctx->ethid][i]);
+    }
+
+stop:
+    /* sync for stopping, not echoed */
+    memset(ctx->send_buf, 0x55, BENCH_PAYLOAD(bench_frame[0]));
+    if (send(ctx->sockfd, ctx->send_buf, BENCH_PAYLOAD(bench_frame[0]), 0) == -1) {
+        log_print(log_fd, "udp send failed!\n");
+    }
+    log_print(log_fd, "send sync packet for stopping to %s!\n", net_port_para->ip);
+
+out:
+    free(ctx->recv_iovs);
+    free(ctx->recv_msgs);
+    free(ctx->recv_buf);
+    free(ctx->send_iovs);
+    free(ctx->send_msgs);
+    free(ctx->send_buf);
+    free(ctx);
+}
+
+/* Machine B: echo the benchmark packets of a NIC back, until the stop packet */
+static void nim_bench_reflect(ether_port_para *net_port_para)
+{
+    int sockfd = net_port_para->sockfd;
+    uint32_t ethid = net_port_para->ethid;
+    int batch = g_nim_batch;
+    uint8_t *buf;
+    uint8_t *pkt;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    int recv_num;
+    int stop = 0;
+    int k;
+
+    buf = malloc(batch * BENCH_MAX_LEN);
+    msgs = calloc(batch, sizeof(struct mmsghdr));
+    iovs = calloc(batch, sizeof(struct iovec));
+    if (buf == NULL || msgs == NULL || iovs == NULL) {
+        log_print(log_fd, "NIC%d: out of memory!\n", ethid);
+        test_mod_nim.pass = 0;
+        goto out;
+    }
+
+    for (k = 0; k < batch; k++) {
+        iovs[k].iov_base = buf + k * BENCH_MAX_LEN;
+        msgs[k].msg_hdr.msg_iov = &iovs[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (g_running && !stop) {
+        for (k = 0; k < batch; k++) {
+            iovs[k].iov_len = BENCH_MAX_LEN;
+        }
+
+        recv_num = udp_recv_batch(sockfd, msgs, batch, ethid);
+        if (recv_num <= 0) {
+            continue;
+        }
+        timeout_rst_cnt[ethid] = 0;
+
+        /* Send each packet back as received, the stop packet ends the batch */
+        for (k = 0; k < recv_num; k++) {
+            pkt = buf + k * BENCH_MAX_LEN;
+            if (msgs[k].msg_len >= 4
+                    && ((pkt[0] & 0xaa) || (pkt[1] & 0xaa) || (pkt[2] & 0xaa) || (pkt[3] & 0xaa)) == 0) {
+                stop = 1;
+                recv_num = k;
+                break;
+            }
+            iovs[k].iov_len = msgs[k].msg_len;
+        }
+        udp_cnt_recv[ethid] += recv_num;
+        udp_cnt_send[ethid] += udp_send_batch(sockfd, msgs, recv_num, ethid);
+    }
+
+    log_print(log_fd, "NIC%d: echoed %u packets\n", ethid, udp_cnt_send[ethid]);
+
+out:
+    free(iovs);
+    free(msgs);
+    free(buf);
+}
+
+/*
+ * Open the socket of RTT probes of a NIC, with kernel timestamps of the
+ * packets received, and of the packets sent on machine A. The hardware
+ * timestamps are turned on if the NIC supports them.
+ */
+static int nim_rtt_init(uint32_t ethid, char *local_ip)
+{
+    struct hwtstamp_config hwcfg;
+    struct ifreq ifr;
+    struct timeval tv;
+    int flags;
+
+    if (socket_init(&rtt_sockid[ethid], local_ip, UDP_PORT_RTT) != 0) {
+        log_print(log_fd, "NIC%d RTT socket init failed!\n", ethid);
+
+        return -1;
+    }
+
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    setsockopt(rtt_sockid[ethid], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    /* The NIC is left as it is if its timestamp config can't be restored */
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "eth%u", ethid);
+    ifr.ifr_data = (void *)&rtt_hw_saved[ethid];
+    if (ioctl(rtt_sockid[ethid], SIOCGHWTSTAMP, &ifr) == 0) {
+        memset(&hwcfg, 0, sizeof(hwcfg));
+        hwcfg.tx_type = HWTSTAMP_TX_ON;
+        hwcfg.rx_filter = HWTSTAMP_FILTER_ALL;
+        ifr.ifr_data = (void *)&hwcfg;
+        if (ioctl(rtt_sockid[ethid], SIOCSHWTSTAMP, &ifr) == 0) {
+            rtt_hw[ethid] = (hwcfg.rx_filter != HWTSTAMP_FILTER_NONE);
+            if (!rtt_hw[ethid]) {
+                nim_rtt_deinit(ethid);
+            }
+        }
+    }
+
+    flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (g_machine == 'A') {
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID
+            | SOF_TIMESTAMPING_OPT_TSONLY;
+    }
+    if (rtt_hw[ethid]) {
+        flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        if (g_machine == 'A') {
+            flags |= SOF_TIMESTAMPING_TX_HARDWARE;
+        }
+    }
+    if (setsockopt(rtt_sockid[ethid], SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        log_print(log_fd, "NIC%d set SO_TIMESTAMPING failed: %s!\n", ethid, strerror(errno));
+
+        return -1;
+    }
+
+    log_print(log_fd, "NIC%d RTT timestamps: %s\n", ethid,
+            rtt_hw[ethid] ? "hardware" : "software");
+
+    return 0;
+}
+
+/*
+ * Restore the timestamp config of a NIC saved by nim_rtt_init(). rtt_hw is
+ * kept for the report.
+ */
+static void nim_rtt_deinit(uint32_t ethid)
+{
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "eth%u", ethid);
+    ifr.ifr_data = (void *)&rtt_hw_saved[ethid];
+    if (ioctl(rtt_sockid[ethid], SIOCSHWTSTAMP, &ifr) < 0) {
+        log_print(log_fd, "NIC%d restore hardware timestamps failed: %s!\n",
+                ethid, strerror(errno));
+    }
+}
+
+/* Add the RTT of a probe once both of its timestamps are there */
+static void rtt_complete(uint32_t ethid, struct rtt_slot *slot)
+{
+    uint64_t rtt;
+
+    if (slot->done || !slot->echoed) {
+        return;
+    }
+
+    /* Both timestamps of the same clock, the PHC of NIC or the system */
+    if (rtt_hw[ethid]) {
+        if (slot->tx_hw == 0 || slot->rx_hw == 0 || slot->rx_hw < slot->tx_hw) {
+            return;
+        }
+        rtt = slot->rx_hw - slot->tx_hw;
+    } else {
+        if (slot->tx_sw == 0 || slot->rx_sw == 0 || slot->rx_sw < slot->tx_sw) {
+            return;
+        }
+        rtt = slot->rx_sw - slot->tx_sw;
+    }
+    slot->done = 1;
+
+    hist_add(&rtt_hist[ethid], rtt);
+    hist_add(&rtt_net_hist[ethid], (slot->turn_ns < rtt) ? rtt - slot->turn_ns : 0);
+}
+
+/* Take a timestamp of SCM_TIMESTAMPING, software or hardware, in ns */
+static uint64_t rtt_ts_ns(struct timespec *ts)
+{
+    return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* Read the TX timestamps of probes from the error queue of socket */
+static void rtt_read_tx(uint32_t ethid, struct rtt_slot *ring)
+{
+    struct scm_timestamping *tss;
+    struct sock_extended_err *serr;
+    struct rtt_slot *slot;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    char ctrl[512];
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+        if (recvmsg(rtt_sockid[ethid], &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+
+        tss = NULL;
+        serr = NULL;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                tss = (struct scm_timestamping *)CMSG_DATA(cmsg);
+            } else if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) {
+                serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            }
+        }
+        if (tss == NULL || serr == NULL || serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) {
+            continue;
+        }
+
+        /* The ID of SOF_TIMESTAMPING_OPT_ID counts the packets sent, as seq */
+        slot = &ring[serr->ee_data % RTT_RING];
+        if (slot->seq != serr->ee_data) {
+            continue;
+        }
+        if (tss->ts[2].tv_sec || tss->ts[2].tv_nsec) {
+            slot->tx_hw = rtt_ts_ns(&tss->ts[2]);
+        }
+        if (tss->ts[0].tv_sec || tss->ts[0].tv_nsec) {
+            slot->tx_sw = rtt_ts_ns(&tss->ts[0]);
+        }
+        rtt_complete(ethid, slot);
+    }
+}
+
+/*
+ * Receive a probe with its RX timestamps.
+ *
+ * Return: bytes of probe, -1 on timeout or error
+ */
+static int rtt_recv(uint32_t ethid, uint8_t *buf, int flags, uint64_t *rx_sw, uint64_t *rx_hw)
+{
+    struct scm_timestamping *tss;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    char ctrl[512];
+    int len;
+
+    iov.iov_base = buf;
+    iov.iov_len = RTT_PROBE_LEN;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+
+    len = recvmsg(rtt_sockid[ethid], &msg, flags);
+    if (len < 0) {
+        return -1;
+    }
+
+    *rx_sw = 0;
+    *rx_hw = 0;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            tss = (struct scm_timestamping *)CMSG_DATA(cmsg);
+            *rx_sw = rtt_ts_ns(&tss->ts[0]);
+            *rx_hw = rtt_ts_ns(&tss->ts[2]);
+        }
+    }
+
+    return len;
+}
+
+/* Read the echoes of probes with their RX timestamps */
+static void rtt_read_echo(uint32_t ethid, struct rtt_slot *ring)
+{
+    uint8_t buf[RTT_PROBE_LEN];
+    struct rtt_slot *slot;
+    uint64_t rx_sw;
+    uint64_t rx_hw;
+    uint32_t seq;
+
+    while (rtt_recv(ethid, buf, MSG_DONTWAIT, &rx_sw, &rx_hw) == RTT_PROBE_LEN) {
+        seq = (uint32_t)((buf[3]) | (buf[2] << 8) | (buf[1] << 16) | (buf[0] << 24));
+        slot = &ring[seq % RTT_RING];
+        if (slot->seq != seq || slot->echoed) {
+            continue;
+        }
+
+        slot->echoed = 1;
+        slot->rx_sw = rx_sw;
+        slot->rx_hw = rx_hw;
+        memcpy(&slot->turn_ns, buf + 4, 8);
+        rtt_echo_cnt[ethid]++;
+        rtt_complete(ethid, slot);
+    }
+}
+
+/*
+ * Machine A: send RTT probes of a NIC at -nim-rtt per second, along with
+ * the test traffic, and take the timestamps of probes and echoes meanwhile.
+ */
+static void nim_rtt_probe(ether_port_para *net_port_para)
+{
+    uint32_t ethid = net_port_para->ethid;
+    uint64_t interval_ns = 1000000000ULL / g_nim_rtt;
+    uint8_t buf[RTT_PROBE_LEN];
+    struct rtt_slot *ring;
+    struct rtt_slot *slot;
+    struct pollfd pfd;
+    struct timespec ts;
+    uint64_t next_ns;
+    uint64_t now_ns;
+    uint64_t wait_ns;
+    uint32_t seq = 0;
+
+    ring = calloc(RTT_RING, sizeof(struct rtt_slot));
+    if (ring == NULL) {
+        log_print(log_fd, "NIC%d: out of memory!\n", ethid);
+        test_mod_nim.pass = 0;
+        return;
+    }
+    memset(buf, 0, sizeof(buf));
+
+    pfd.fd = rtt_sockid[ethid];
+    pfd.events = POLLIN;
+
+    /* Wait the other side to ready, as udp_send_test() */
+    sleep_ms(500);
+
+    next_ns = get_time_ns();
+    while (g_running) {
+        now_ns = get_time_ns();
+        if (now_ns >= next_ns) {
+            buf[0] = (uint8_t)(seq >> 24 & 0xff);
+            buf[1] = (uint8_t)(seq >> 16 & 0xff);
+            buf[2] = (uint8_t)(seq >> 8 & 0xff);
+            buf[3] = (uint8_t)(seq & 0xff);
+
+            slot = &ring[seq % RTT_RING];
+            memset(slot, 0, sizeof(struct rtt_slot));
+            slot->seq = seq;
+
+            /* A packet refused is not sent, nor counted by OPT_ID */
+            if (send(rtt_sockid[ethid], buf, RTT_PROBE_LEN, 0) == RTT_PROBE_LEN) {
+                rtt_sent_cnt[ethid]++;
+                seq++;
+            }
+
+            next_ns += interval_ns;
+            if (next_ns < now_ns) {
+                next_ns = now_ns + interval_ns;
+            }
+        }
+
+        wait_ns = next_ns - now_ns;
+        if (wait_ns > NET_RATE_MAX_WAIT_MS * 1000000ULL) {
+            wait_ns = NET_RATE_MAX_WAIT_MS * 1000000ULL;
+        }
+        ts.tv_sec = wait_ns / 1000000000ULL;
+        ts.tv_nsec = wait_ns % 1000000000ULL;
+
+        /* POLLERR is for the TX timestamps in error queue */
+        if (ppoll(&pfd, 1, &ts, NULL) > 0) {
+            rtt_read_tx(ethid, ring);
+            rtt_read_echo(ethid, ring);
+        }
+    }
+
+    free(ring);
+}
+
+/*
+ * Machine B: echo the RTT probes of a NIC back, with the time from the RX
+ * timestamp to the echo, which is taken out of the RTT on machine A.
+ */
+static void nim_rtt_echo(ether_port_para *net_port_para)
+{
+    uint32_t ethid = net_port_para->ethid;
+    uint8_t buf[RTT_PROBE_LEN];
+    struct timespec now;
+    uint64_t turn_ns;
+    uint64_t rx_sw;
+    uint64_t rx_hw;
+    int len;
+
+    while (g_running) {
+        len = rtt_recv(ethid, buf, 0, &rx_sw, &rx_hw);
+        if (len != RTT_PROBE_LEN) {
+            continue;
+        }
+
+        /* The software RX timestamp is of CLOCK_REALTIME */
+        turn_ns = 0;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (rx_sw > 0 && rtt_ts_ns(&now) > rx_sw) {
+            turn_ns = rtt_ts_ns(&now) - rx_sw;
+        }
+        memcpy(buf + 4, &turn_ns, 8);
+
+        if (send(rtt_sockid[ethid], buf, RTT_PROBE_LEN, 0) == RTT_PROBE_LEN) {
+            rtt_echo_cnt[ethid]++;
+        }
+    }
+}
+
+/* Print the RTT of probes of each NIC */
+static void nim_print_rtt(int fd)
+{
+    char name[48];
+    int i;
+
+    for (i = 0; i < MAX_NIC_COUNT; i++) {
+        if (!g_nim_test_eth[i]) {
+            continue;
+        }
+
+        if (g_machine != 'A') {
+            write_file(fd, "    NIC%d RTT: %llu probes echoed\n", i,
+                    (unsigned long long)rtt_echo_cnt[i]);
+            continue;
+        }
+
+        write_file(fd, "    NIC%d RTT: %llu probes, %llu echoed, %llu timestamped by %s\n", i,
+                (unsigned long long)rtt_sent_cnt[i], (unsigned long long)rtt_echo_cnt[i],
+                (unsigned long long)rtt_hist[i].count, rtt_hw[i] ? "hardware" : "software");
+        snprintf(name, sizeof(name), "NIC%d RTT", i);
+        hist_print(fd, name, &rtt_hist[i]);
+        snprintf(name, sizeof(name), "NIC%d RTT less echo time", i);
+        hist_print(fd, name, &rtt_net_hist[i]);
+    }
+}
+
+/*
+ * Open the packet socket of a NIC for -nim-engine packet, with the RX and
+ * TX rings mapped, and the Ethernet header and constant bytes of each frame
+ * of TX ring filled once. No address of NIC is set.
+ */
+static int l2_test_init(uint32_t ethid)
+{
+    l2_ring *r = &l2_rings[ethid];
+    struct tpacket_req3 req;
+    struct sockaddr_ll addr;
+    struct ifreq ifr;
+    struct ethhdr *eth;
+    uint8_t *frame;
+    unsigned int per_block = L2_BLOCK_SIZE / L2_FRAME_SIZE;
+    unsigned int tx_blocks;
+    size_t rx_len;
+    int version = TPACKET_V3;
+    int fd;
+    int i;
+    int k;
+
+    if (l2_socket_init(&net_sockid[ethid], ethid, SOCK_RAW, &addr) != 0) {
+        log_print(log_fd, "NIC%d packet socket init failed!\n", ethid);
+
+        return -1;
+    }
+    fd = net_sockid[ethid];
+
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "eth%u", ethid);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+        log_print(log_fd, "NIC%d get MAC address failed!\n", ethid);
+
+        return -1;
+    }
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        log_print(log_fd, "NIC%d TPACKET_V3 is not supported!\n", ethid);
+
+        return -1;
+    }
+
+    /* RX blocks are handed over when full, or after L2_BLOCK_TOV_MS */
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = L2_BLOCK_SIZE;
+    req.tp_block_nr = L2_RX_BLOCKS;
+    req.tp_frame_size = L2_FRAME_SIZE;
+    req.tp_frame_nr = per_block * L2_RX_BLOCKS;
+    req.tp_retire_blk_tov = L2_BLOCK_TOV_MS;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        log_print(log_fd, "NIC%d set RX ring failed: %s!\n", ethid, strerror(errno));
+
+        return -1;
+    }
+
+    /* Room for a few batches of frames, as the socket buffers of UDP */
+    tx_blocks = (g_nim_batch * NET_BUF_BATCHES + per_block - 1) / per_block;
+    if (tx_blocks < 2) {
+        tx_blocks = 2;
+    }
+    req.tp_block_nr = tx_blocks;
+    req.tp_frame_nr = per_block * tx_blocks;
+    req.tp_retire_blk_tov = 0;
+    if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        log_print(log_fd, "NIC%d set TX ring failed: %s!\n", ethid, strerror(errno));
+
+        return -1;
+    }
+
+    /* The TX ring follows the RX ring in one mapping */
+    rx_len = (size_t)L2_BLOCK_SIZE * L2_RX_BLOCKS;
+    r->map_len = rx_len + (size_t)L2_BLOCK_SIZE * tx_blocks;
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (r->map == MAP_FAILED) {
+        log_print(log_fd, "NIC%d map rings failed: %s!\n", ethid, strerror(errno));
+
+        return -1;
+    }
+    r->rx = r->map;
+    r->rx_block = 0;
+    r->tx = r->map + rx_len;
+    r->tx_frames = per_block * tx_blocks;
+    r->tx_frame = 0;
+
+    for (k = 0; k < (int)r->tx_frames; k++) {
+        frame = r->tx + k * L2_FRAME_SIZE + L2_DATA_OFFSET;
+
+        eth = (struct ethhdr *)frame;
+        memset(eth->h_dest, 0xff, ETH_ALEN);
+        memcpy(eth->h_source, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+        eth->h_proto = htons(NIM_ETHERTYPE);
+
+        for (i = 0; i < NET_MAX_NUM - 8; i++) {
+            frame[ETH_HLEN + i] = i;
+        }
+    }
+
+    net_port_para_recv[ethid].sockfd = fd;
+    net_port_para_recv[ethid].ethid = ethid;
+
+    net_port_para_send[ethid].sockfd = fd;
+    net_port_para_send[ethid].ethid = ethid;
+    net_port_para_send[ethid].ip = "ff:ff:ff:ff:ff:ff";
+
+    log_print(log_fd, "NIC%d test init done, EtherType 0x%04X, %u TX frames !\n", ethid,
+            NIM_ETHERTYPE, r->tx_frames);
+
+    return 0;
+}
+
+/*
+ * Fill the count and CRC of frames in the TX ring in place, and send them
+ * by one call, which returns when the frames are sent.
+ *
+ * Return: number of frames sent
+ */
+static int l2_send_batch(uint32_t ethid, uint32_t prefix_crc, uint32_t count, int num)
+{
+    l2_ring *r = &l2_rings[ethid];
+    struct tpacket3_hdr *hdr;
+    uint8_t *frame;
+    int k;
+
+    for (k = 0; k < num; k++) {
+        frame = r->tx + r->tx_frame * L2_FRAME_SIZE;
+        hdr = (struct tpacket3_hdr *)frame;
+        if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            break;
+        }
+
+        fill_udp_packet(frame + L2_DATA_OFFSET + ETH_HLEN, prefix_crc, count + k);
+        hdr->tp_len = L2_FRAME_LEN;
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+        r->tx_frame = (r->tx_frame + 1) % r->tx_frames;
+    }
+
+    for (;;) {
+        udp_calls_send[ethid]++;
+        if (send(net_sockid[ethid], NULL, 0, 0) >= 0) {
+            break;
+        }
+        if (errno != EINTR) {
+            log_print(log_fd, "send: NIC%d send failed: %s!\n", ethid, strerror(errno));
+            return 0;
+        }
+    }
+
+    return k;
+}
+
+/* Send the sync frame for stopping by the TX ring */
+static void l2_send_stop(uint32_t ethid)
+{
+    l2_ring *r = &l2_rings[ethid];
+    struct tpacket3_hdr *hdr;
+    uint8_t *frame;
+
+    frame = r->tx + r->tx_frame * L2_FRAME_SIZE;
+    hdr = (struct tpacket3_hdr *)frame;
+    memset(frame + L2_DATA_OFFSET + ETH_HLEN, 0x55, 4);
+    hdr->tp_len = L2_FRAME_LEN;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    r->tx_frame = (r->tx_frame + 1) % r->tx_frames;
+
+    if (send(net_sockid[ethid], NULL, 0, 0) < 0) {
+        log_print(log_fd, "send: NIC%d send failed: %s!\n", ethid, strerror(errno));
+    }
+}
+
+/*
+ * Receive thread of -nim-engine packet: check the frames of each block of
+ * the RX ring in place, and hand the block back to the kernel.
+ */
+static void l2_recv_test(ether_port_para *net_port_para)
+{
+    uint32_t ethid = net_port_para->ethid;
+    l2_ring *r = &l2_rings[ethid];
+    struct tpacket_block_desc *bd;
+    struct tpacket3_hdr *ppd;
+    struct pollfd pfd;
+    uint8_t expect_buf[NET_MAX_NUM];
+    uint32_t prefix_crc;
+    uint64_t first_ns = 0;
+    uint64_t now_ns;
+    uint64_t cpu_ns = get_thread_cpu_ns();
+    int i, j = 0, k, ret;
+
+    /* Same payload as udp_send_test(), the count is filled per frame */
+    for (i = 0; i < NET_MAX_NUM - 8; i++) {
+        expect_buf[i] = i;
+    }
+    prefix_crc = crc32(0, expect_buf, NET_MAX_NUM - 8);
+
+    pfd.fd = net_port_para->sockfd;
+    pfd.events = POLLIN | POLLERR;
+
+    while (g_running) {
+        bd = (struct tpacket_block_desc *)(r->rx + r->rx_block * L2_BLOCK_SIZE);
+        if ((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+            udp_calls_recv[ethid]++;
+            if (poll(&pfd, 1, 1000) == 0) {
+                timeout_rst_cnt[ethid]++;
+                log_print(log_fd, "NIC%d: receive timeout [no.%d], no data is incoming.\n", ethid, timeout_rst_cnt[ethid]);
+            }
+            continue;
+        }
+
+        now_ns = get_time_ns();
+        if (first_ns == 0) {
+            first_ns = now_ns;
+        }
+        udp_recv_ns[ethid] = now_ns - first_ns;
+
+        ppd = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+        for (k = 0; k < (int)bd->hdr.bh1.num_pkts && g_running; k++) {
+            ret = nim_check_packet(ethid, (uint8_t *)ppd + ppd->tp_mac + ETH_HLEN,
+                    ppd->tp_snaplen - ETH_HLEN, expect_buf, prefix_crc);
+
+            /* sync for stopping */
+            if (ret > 0) {
+                g_running = 0;
+                break;
+            }
+
+            if (ret == 0 && ++j >= LOG_INTERVAL_TIME * g_nim_batch) {
+                log_print(log_fd, "NIC%d: recv frame count = %u, lost no = %u, err no = %u\n", \
+                    ethid, udp_cnt_recv[ethid], tesc_lost_no[ethid], tesc_err_no[ethid]);
+                j = 0;
+            }
+
+            ppd = (struct tpacket3_hdr *)((uint8_t *)ppd + ppd->tp_next_offset);
+        }
+
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        r->rx_block = (r->rx_block + 1) % L2_RX_BLOCKS;
+    }
+    udp_recv_cpu_ns[ethid] = get_thread_cpu_ns() - cpu_ns;
+}
+
+/*
+ * Open the AF_XDP socket of a NIC for -nim-engine xdp on the queue given,
+ * with the XDP program attached. The frames of RX are given to the kernel
+ * by the fill ring, and the Ethernet header and constant bytes of each TX
+ * frame of UMEM are filled once. No address of NIC is set.
+ */
+static int xdp_test_init(uint32_t ethid)
+{
+    xsk_t *x = &nim_xsk[ethid];
+    struct ifreq ifr;
+    struct ethhdr *eth;
+    uint8_t *frame;
+    uint32_t k;
+    int i;
+    int fd;
+
+    /* The MAC address, which an AF_XDP socket can't get by ioctl() */
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        log_print(log_fd, "NIC%d get MAC address failed!\n", ethid);
+
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "eth%u", ethid);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+        log_print(log_fd, "NIC%d get MAC address failed!\n", ethid);
+        close(fd);
+
+        return -1;
+    }
+    close(fd);
+
+    if (xsk_open(x, ifr.ifr_name, g_nim_xdp_queue, NIM_ETHERTYPE) != 0) {
+        log_print(log_fd, "NIC%d AF_XDP socket init failed: %s!\n", ethid, strerror(errno));
+
+        return -1;
+    }
+    net_sockid[ethid] = x->fd;
+    xdp_mode[ethid] = (x->xdp_flags & XDP_FLAGS_DRV_MODE) ?
+        ((x->bind_flags & XDP_ZEROCOPY) ? "driver mode, zero-copy" : "driver mode, copy") :
+        "generic mode, copy";
+
+    for (k = 0; k < XSK_RING_SIZE; k++) {
+        *xsk_ring_addr(&x->fill, *x->fill.producer + k) = (uint64_t)k * XSK_FRAME_SIZE;
+    }
+    xsk_ring_submit(&x->fill, XSK_RING_SIZE);
+
+    for (k = 0; k < XSK_RING_SIZE; k++) {
+        frame = x->umem + XSK_TX_ADDR(k);
+
+        eth = (struct ethhdr *)frame;
+        memset(eth->h_dest, 0xff, ETH_ALEN);
+        memcpy(eth->h_source, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+        eth->h_proto = htons(NIM_ETHERTYPE);
+
+        for (i = 0; i < NET_MAX_NUM - 8; i++) {
+            frame[ETH_HLEN + i] = i;
+        }
+
+        xdp_tx_free[ethid][k] = XSK_TX_ADDR(k);
+    }
+    xdp_tx_nfree[ethid] = XSK_RING_SIZE;
+
+    net_port_para_recv[ethid].sockfd = x->fd;
+    net_port_para_recv[ethid].ethid = ethid;
+
+    net_port_para_send[ethid].sockfd = x->fd;
+    net_port_para_send[ethid].ethid = ethid;
+    net_port_para_send[ethid].ip = "ff:ff:ff:ff:ff:ff";
+
+    log_print(log_fd, "NIC%d test init done, EtherType 0x%04X, queue %d, %s !\n", ethid,
+            NIM_ETHERTYPE, x->queue, xdp_mode[ethid]);
+
+    return 0;
+}
+
+/* Take the TX frames sent back from the completion ring */
+static void xdp_reclaim(uint32_t ethid)
+{
+    xsk_t *x = &nim_xsk[ethid];
+    uint32_t n = xsk_ring_ready(&x->comp);
+    uint32_t idx = *x->comp.consumer;
+    uint32_t k;
+
+    for (k = 0; k < n; k++) {
+        xdp_tx_free[ethid][xdp_tx_nfree[ethid]++] = *xsk_ring_addr(&x->comp, idx + k);
+    }
+    xsk_ring_release(&x->comp, n);
+}
+
+/*
+ * Fill the count and CRC of free TX frames in UMEM in place, put them into
+ * the TX ring, and wake the kernel up if it asks to.
+ *
+ * Return: number of frames put
+ */
+static int xdp_send_batch(uint32_t ethid, uint32_t prefix_crc, uint32_t count, int num)
+{
+    xsk_t *x = &nim_xsk[ethid];
+    struct xdp_desc *desc;
+    uint32_t idx = *x->tx.producer;
+    uint32_t n = num;
+    uint64_t addr;
+    uint32_t k;
+    int calls;
+
+    xdp_reclaim(ethid);
+    if (n > xdp_tx_nfree[ethid]) {
+        n = xdp_tx_nfree[ethid];
+    }
+    if (n > xsk_ring_free(&x->tx)) {
+        n = xsk_ring_free(&x->tx);
+    }
+
+    for (k = 0; k < n; k++) {
+        addr = xdp_tx_free[ethid][--xdp_tx_nfree[ethid]];
+        fill_udp_packet(x->umem + addr + ETH_HLEN, prefix_crc, count + k);
+
+        desc = xsk_ring_desc(&x->tx, idx + k);
+        desc->addr = addr;
+        desc->len = L2_FRAME_LEN;
+        desc->options = 0;
+    }
+    xsk_ring_submit(&x->tx, n);
+
+    /* The frames submitted are counted sent, the next kick sends them */
+    calls = xsk_kick_tx(x);
+    if (calls < 0) {
+        log_print(log_fd, "send: NIC%d send failed: %s!\n", ethid, strerror(errno));
+        calls = 1;
+    }
+    udp_calls_send[ethid] += calls;
+
+    return n;
+}
+
+/* Send the sync frame for stopping by the TX ring */
+static void xdp_send_stop(uint32_t ethid)
+{
+    xsk_t *x = &nim_xsk[ethid];
+    struct xdp_desc *desc;
+    uint64_t addr;
+    int i;
+
+    for (i = 0; i < 100 && (xdp_tx_nfree[ethid] == 0 || xsk_ring_free(&x->tx) == 0); i++) {
+        xsk_kick_tx(x);
+        sleep_ms(1);
+        xdp_reclaim(ethid);
+    }
+    if (xdp_tx_nfree[ethid] == 0 || xsk_ring_free(&x->tx) == 0) {
+        log_print(log_fd, "send: NIC%d TX ring is full!\n", ethid);
+        return;
+    }
+
+    addr = xdp_tx_free[ethid][--xdp_tx_nfree[ethid]];
+    memset(x->umem + addr + ETH_HLEN, 0x55, 4);
+
+    desc = xsk_ring_desc(&x->tx, *x->tx.producer);
+    desc->addr = addr;
+    desc->len = L2_FRAME_LEN;
+    desc->options = 0;
+    xsk_ring_submit(&x->tx, 1);
+
+    if (xsk_kick_tx(x) < 0) {
+        log_print(log_fd, "send: NIC%d send failed: %s!\n", ethid, strerror(errno));
+    }
+}
+
+/*
+ * Receive thread of -nim-engine xdp: check the frames of RX ring in UMEM
+ * in place, and give them back by the fill ring.
+ */
+static void xdp_recv_test(ether_port_para *net_port_para)
+{
+    uint32_t ethid = net_port_para->ethid;
+    xsk_t *x = &nim_xsk[ethid];
+    struct xdp_desc *desc;
+    uint8_t expect_buf[NET_MAX_NUM];
+    uint32_t prefix_crc;
+    uint32_t idx;
+    uint32_t fill_idx;
+    uint32_t n;
+    uint32_t k;
+    uint64_t first_ns = 0;
+    uint64_t now_ns;
+    uint64_t cpu_ns = get_thread_cpu_ns();
+    int i, j = 0, ret;
+
+    /* Same payload as udp_send_test(), the count is filled per frame */
+    for (i = 0; i < NET_MAX_NUM - 8; i++) {
+        expect_buf[i] = i;
+    }
+    prefix_crc = crc32(0, expect_buf, NET_MAX_NUM - 8);
+
+    while (g_running) {
+        n = xsk_ring_ready(&x->rx);
+        if (n == 0) {
+            udp_calls_recv[ethid]++;
+            if (xsk_wait_rx(x, 1000) == 0) {
+                timeout_rst_cnt[ethid]++;
+                log_print(log_fd, "NIC%d: receive timeout [no.%d], no data is incoming.\n", ethid, timeout_rst_cnt[ethid]);
+            }
+            continue;
+        }
+
+        now_ns = get_time_ns();
+        if (first_ns == 0) {
+            first_ns = now_ns;
+        }
+        udp_recv_ns[ethid] = now_ns - first_ns;
+
+        /* The fill ring has room for all frames of RX */
+        idx = *x->rx.consumer;
+        fill_idx = *x->fill.producer;
+        for (k = 0; k < n; k++) {
+            desc = xsk_ring_desc(&x->rx, idx + k);
+            *xsk_ring_addr(&x->fill, fill_idx + k) = desc->addr - desc->addr % XSK_FRAME_SIZE;
+            if (!g_running) {
+                continue;
+            }
+
+            ret = nim_check_packet(ethid, x->umem + desc->addr + ETH_HLEN,
+                    desc->len - ETH_HLEN, expect_buf, prefix_crc);
+
+            /* sync for stopping */
+            if (ret > 0) {
+                g_running = 0;
+                continue;
+            }
+
+            if (ret == 0 && ++j >= LOG_INTERVAL_TIME * g_nim_batch) {
+                log_print(log_fd, "NIC%d: recv frame count = %u, lost no = %u, err no = %u\n", \
+                    ethid, udp_cnt_recv[ethid], tesc_lost_no[ethid], tesc_err_no[ethid]);
+                j = 0;
+            }
+        }
+        xsk_ring_release(&x->rx, n);
+        xsk_ring_submit(&x->fill, n);
+
+        /* A driver of zero-copy may wait for a call to take the fill ring */
+        if (__atomic_load_n(x->fill.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) {
+            udp_calls_recv[ethid]++;
+            xsk_wait_rx(x, 0);
+        }
+    }
+    udp_recv_cpu_ns[ethid] = get_thread_cpu_ns() - cpu_ns;
 }
@@ -0,0 +1,169 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     prbs.c
+ *
+ * DESCRIPTION:
+ *     Define functions of pseudo random bit sequence generator
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#include <string.h>
+#include "prbs.h"
+
+/* Next word of stream, bit k of the word is bit (64 * j + k) of stream */
+static uint64_t prbs_next_word(prbs_t *p)
+{
+    uint64_t w;
+
+    if (p->n == 0) {
+        /* xorshift64* */
+        p->rnd ^= p->rnd >> 12;
+        p->rnd ^= p->rnd << 25;
+        p->rnd ^= p->rnd >> 27;
+        return p->rnd * 0x2545F4914F6CDD1DULL;
+    }
+
+    w = p->ring[p->pos] ^ p->ring[(p->pos + p->n - p->m) % p->n];
+    p->ring[p->pos] = w;
+    p->pos = (p->pos + 1) % p->n;
+
+    return w;
+}
+
+/******************************************************************************
+ * NAME:
+ *      prbs_init
+ *
+ * DESCRIPTION:
+ *      Initialize a generator. The LFSR is started from the state of all
+ *      ones and run bit by bit for n words to fill the ring, the stream
+ *      output starts after them.
+ *
+ * PARAMETERS:
+ *      p    - The generator
+ *      type - Type of sequence, see enum PRBS_TYPE
+ *      seed - Seed of PRBS_RANDOM, not used by others
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void prbs_init(prbs_t *p, int type, uint64_t seed)
+{
+    uint32_t state;
+    uint32_t bit;
+    int i;
+    int k;
+
+    memset(p, 0, sizeof(prbs_t));
+
+    switch (type) {
+    case PRBS_7:
+        p->n = 7;
+        p->m = 6;
+        break;
+    case PRBS_15:
+        p->n = 15;
+        p->m = 14;
+        break;
+    case PRBS_31:
+        p->n = 31;
+        p->m = 28;
+        break;
+    default:
+        /* State of xorshift shall not be 0 */
+        p->rnd = seed ? seed : 0x9E3779B97F4A7C15ULL;
+        return;
+    }
+
+    /* Bit i of state is bit (t - 1 - i) of stream, t is current bit */
+    state = (1U << p->n) - 1;
+    for (i = 0; i < p->n; i++) {
+        for (k = 0; k < 64; k++) {
+            bit = ((state >> (p->n - 1)) ^ (state >> (p->m - 1))) & 1;
+            state = ((state << 1) | bit) & ((1U << p->n) - 1);
+            p->ring[i] |= (uint64_t)bit << k;
+        }
+    }
+}
+
+/******************************************************************************
+ * NAME:
+ *      prbs_fill
+ *
+ * DESCRIPTION:
+ *      Fill the next bytes of stream into buffer, least significant bit
+ *      first.
+ *
+ * PARAMETERS:
+ *      p    - The generator
+ *      buff - The buffer
+ *      len  - Bytes to fill
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void prbs_fill(prbs_t *p, uint8_t *buff, int len)
+{
+    uint64_t w;
+    int n;
+
+    while (len > 0) {
+        if (p->left == 0) {
+            if (len >= 8) {
+                w = prbs_next_word(p);
+                memcpy(buff, &w, 8);
+                buff += 8;
+                len -= 8;
+                continue;
+            }
+
+            w = prbs_next_word(p);
+            memcpy(p->cache, &w, 8);
+            p->left = 8;
+        }
+
+        n = (len < p->left) ? len : p->left;
+        memcpy(buff, p->cache + 8 - p->left, n);
+        p->left -= n;
+        buff += n;
+        len -= n;
+    }
+}
+
+/******************************************************************************
+ * NAME:
+ *      prbs_skip
+ *
+ * DESCRIPTION:
+ *      Skip bytes of stream, e.g. of the lost packets.
+ *
+ * PARAMETERS:
+ *      p   - The generator
+ *      len - Bytes to skip
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void prbs_skip(prbs_t *p, uint64_t len)
+{
+    uint64_t n;
+
+    n = (len < (uint64_t)p->left) ? len : (uint64_t)p->left;
+    p->left -= n;
+    len -= n;
+
+    for (; len >= 8; len -= 8) {
+        prbs_next_word(p);
+    }
+
+    if (len > 0) {
+        uint64_t w = prbs_next_word(p);
+
+        memcpy(p->cache, &w, 8);
+        p->left = 8 - (int)len;
+    }
+}
@@ -0,0 +1,48 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     prbs.h
+ *
+ * DESCRIPTION:
+ *     Define pseudo random bit sequence generator for test payloads
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#ifndef _PRBS_H_
+#define _PRBS_H_
+
+#include <stdint.h>
+
+/* Type of sequence */
+enum PRBS_TYPE {
+    PRBS_7,         /* x^7 + x^6 + 1 */
+    PRBS_15,        /* x^15 + x^14 + 1 */
+    PRBS_31,        /* x^31 + x^28 + 1 */
+    PRBS_RANDOM     /* xorshift64*, not a LFSR sequence */
+};
+
+#define PRBS_MAX_DEGREE     31
+
+/*
+ * State of generator. For x^n + x^m + 1, the sequence also satisfies
+ * x^64n + x^64m + 1, so each 64 bits word of the stream is the XOR of the
+ * words n and m before it, and the stream is generated a word at a time.
+ */
+typedef struct _prbs {
+    int n;
+    int m;
+    int pos;                            /* Index of oldest word in ring */
+    uint64_t ring[PRBS_MAX_DEGREE];     /* Last n words of stream */
+    uint64_t rnd;                       /* State of PRBS_RANDOM */
+    uint8_t cache[8];                   /* Current word */
+    int left;                           /* Bytes of current word not used */
+} prbs_t;
+
+void prbs_init(prbs_t *p, int type, uint64_t seed);
+void prbs_fill(prbs_t *p, uint8_t *buff, int len);
+void prbs_skip(prbs_t *p, uint64_t len);
+
+#endif /* _PRBS_H_ */
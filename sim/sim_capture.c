@@ -0,0 +1,449 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     sim_capture.c
+ *
+ * DESCRIPTION:
+ *     Capture the raw RX bytes of SIM ports into a bounded ring of zlib
+ *     compressed chunks, and save the ring around an error to a file.
+ *
+ *     The receiver of a port only copies the bytes into a raw chunk and
+ *     hands the full chunk to the capture thread, which compresses it. If
+ *     the capture thread is behind, the bytes are dropped and counted, the
+ *     receiver never waits.
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "common.h"
+#include "sim_test.h"
+#include "sim_capture.h"
+
+/* Raw chunks handed from receiver to capture thread, per port */
+#define CAP_CHUNK_SIZE      (16 * 1024)
+#define CAP_RAW_SLOTS       4
+
+/* Data of a record, so that a record fits in a chunk */
+#define CAP_REC_MAX         (CAP_CHUNK_SIZE - (int)sizeof(struct simcap_rec))
+
+/* A raw chunk is handed over when it is full or older than CAP_FLUSH_MS */
+#define CAP_FLUSH_MS        500
+
+/* Data after the trigger saved in capture file */
+#define CAP_AFTER_MS        2000
+
+/* Capture files per port at most */
+#define CAP_MAX_FILES       8
+
+#define CAP_POLL_MS         100
+
+struct cap_raw {
+    uint32_t start_ms;
+    uint32_t len;
+    uint8_t data[CAP_CHUNK_SIZE];
+};
+
+struct cap_zchunk {
+    struct cap_zchunk *next;
+    struct simcap_chunk_hdr hdr;
+    uint8_t data[];
+};
+
+struct cap_port {
+    /* Written by the receiver of port */
+    struct cap_raw raw[CAP_RAW_SLOTS];
+    uint32_t head;          /* Raw chunks handed over */
+    uint32_t dropped;       /* Bytes dropped, not recorded yet */
+    int triggers;
+    uint32_t trigger;
+    uint32_t trigger_ms;
+    int trigger_set;        /* Cleared by capture thread after saving */
+
+    /* Written by the capture thread */
+    uint32_t tail;          /* Raw chunks compressed */
+    struct cap_zchunk *first;
+    struct cap_zchunk *last;
+    size_t zbytes;
+    int files;
+};
+
+static struct cap_port *cap_ports;
+static int cap_port_num;
+static size_t cap_ring_bytes;
+static char **cap_devices;
+static char cap_dir[PATH_MAX - 64];
+static uint64_t cap_start_ns;
+static volatile int cap_running;
+static pthread_t cap_thread;
+
+static uint32_t cap_now_ms(void)
+{
+    return (uint32_t)((get_time_ns() - cap_start_ns) / 1000000);
+}
+
+/* Raw chunk being filled by receiver, NULL if capture thread is behind */
+static struct cap_raw *cap_slot(struct cap_port *p)
+{
+    uint32_t tail = __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+
+    if (p->head - tail >= CAP_RAW_SLOTS) {
+        return NULL;
+    }
+
+    return &p->raw[p->head % CAP_RAW_SLOTS];
+}
+
+static void cap_hand_over(struct cap_port *p)
+{
+    __atomic_store_n(&p->head, p->head + 1, __ATOMIC_RELEASE);
+}
+
+/* Append a record to the raw chunk, by the receiver of port */
+static void cap_append(struct cap_port *p, uint32_t now, int type,
+        const void *data, int len)
+{
+    struct cap_raw *raw;
+    struct simcap_rec rec;
+
+    raw = cap_slot(p);
+    if (raw && raw->len + sizeof(rec) + len > CAP_CHUNK_SIZE) {
+        cap_hand_over(p);
+        raw = cap_slot(p);
+    }
+
+    if (raw == NULL) {
+        if (type == SIMCAP_REC_DATA) {
+            p->dropped += len;
+        }
+        return;
+    }
+
+    if (raw->len == 0) {
+        raw->start_ms = now;
+    }
+
+    rec.ms = now;
+    rec.type = type;
+    rec.len = len;
+    memcpy(raw->data + raw->len, &rec, sizeof(rec));
+    if (len > 0) {
+        memcpy(raw->data + raw->len + sizeof(rec), data, len);
+    }
+    raw->len += sizeof(rec) + len;
+}
+
+/******************************************************************************
+ * NAME:
+ *      sim_capture_data
+ *
+ * DESCRIPTION:
+ *      Capture the bytes received by port, called by the receiver of port.
+ *
+ * PARAMETERS:
+ *      port_id - Array id number of port.
+ *      buff - Received bytes.
+ *      len - Length of buff.
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void sim_capture_data(int port_id, const uint8_t *buff, int len)
+{
+    struct cap_port *p;
+    struct cap_raw *raw;
+    uint32_t now;
+    int n;
+
+    if (cap_ports == NULL) {
+        return;
+    }
+
+    p = &cap_ports[port_id];
+    now = cap_now_ms();
+
+    if (p->dropped > 0 && cap_slot(p) != NULL) {
+        n = p->dropped;
+        p->dropped = 0;
+        cap_append(p, now, SIMCAP_REC_DROP, &n, sizeof(n));
+    }
+
+    while (len > 0) {
+        n = (len > CAP_REC_MAX) ? CAP_REC_MAX : len;
+        cap_append(p, now, SIMCAP_REC_DATA, buff, n);
+        buff += n;
+        len -= n;
+    }
+
+    raw = cap_slot(p);
+    if (raw && raw->len > 0 && now - raw->start_ms >= CAP_FLUSH_MS) {
+        cap_hand_over(p);
+    }
+}
+
+/******************************************************************************
+ * NAME:
+ *      sim_capture_event
+ *
+ * DESCRIPTION:
+ *      Record an error of port, called by the receiver of port. The capture
+ *      ring of port is saved to a file CAP_AFTER_MS later.
+ *
+ * PARAMETERS:
+ *      port_id - Array id number of port.
+ *      type - SIMCAP_REC_CRC_ERROR or SIMCAP_REC_TIMEOUT.
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void sim_capture_event(int port_id, int type)
+{
+    struct cap_port *p;
+    struct cap_raw *raw;
+    uint32_t now;
+
+    if (cap_ports == NULL) {
+        return;
+    }
+
+    p = &cap_ports[port_id];
+    now = cap_now_ms();
+
+    cap_append(p, now, type, NULL, 0);
+    raw = cap_slot(p);
+    if (raw && raw->len > 0) {
+        cap_hand_over(p);
+    }
+
+    if (p->triggers < CAP_MAX_FILES
+            && !__atomic_load_n(&p->trigger_set, __ATOMIC_ACQUIRE)) {
+        p->triggers++;
+        p->trigger = type;
+        p->trigger_ms = now;
+        __atomic_store_n(&p->trigger_set, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* Compress a raw chunk into the ring of port, by the capture thread */
+static void cap_compress(struct cap_port *p, struct cap_raw *raw)
+{
+    struct cap_zchunk *z;
+    struct cap_zchunk *tmp;
+    uLongf zlen = compressBound(raw->len);
+
+    z = malloc(sizeof(*z) + zlen);
+    if (z == NULL) {
+        return;
+    }
+
+    if (compress2(z->data, &zlen, raw->data, raw->len, Z_BEST_SPEED) != Z_OK) {
+        free(z);
+        return;
+    }
+
+    tmp = realloc(z, sizeof(*z) + zlen);
+    if (tmp) {
+        z = tmp;
+    }
+
+    z->next = NULL;
+    z->hdr.start_ms = raw->start_ms;
+    z->hdr.raw_len = raw->len;
+    z->hdr.zlen = zlen;
+
+    if (p->last) {
+        p->last->next = z;
+    } else {
+        p->first = z;
+    }
+    p->last = z;
+    p->zbytes += zlen;
+
+    /* Drop the oldest chunks, but keep the newest one */
+    while (p->zbytes > cap_ring_bytes && p->first != p->last) {
+        z = p->first;
+        p->first = z->next;
+        p->zbytes -= z->hdr.zlen;
+        free(z);
+    }
+}
+
+/* Save the capture ring of port to a file, by the capture thread */
+static void cap_save(struct cap_port *p, int port_id)
+{
+    struct simcap_file_hdr hdr;
+    struct cap_zchunk *z;
+    char path[PATH_MAX];
+    int log_fd = test_mod_sim.log_fd;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/sim_COM-%d_%d.cap",
+            cap_dir, port_id + 1, ++p->files);
+
+    fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        log_print(log_fd, "Create capture file %s error\n", path);
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SIMCAP_MAGIC, sizeof(SIMCAP_MAGIC));
+    snprintf(hdr.device, sizeof(hdr.device), "%s", cap_devices[port_id]);
+    hdr.port_id = port_id + 1;
+    hdr.baudrate = g_baudrate;
+    hdr.trigger = p->trigger;
+    hdr.trigger_ms = p->trigger_ms;
+    hdr.machine = g_machine;
+
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        log_print(log_fd, "Write capture file %s error\n", path);
+        close(fd);
+        return;
+    }
+
+    for (z = p->first; z; z = z->next) {
+        if (write(fd, &z->hdr, sizeof(z->hdr)) != sizeof(z->hdr)
+                || write(fd, z->data, z->hdr.zlen) != z->hdr.zlen) {
+            log_print(log_fd, "Write capture file %s error\n", path);
+            break;
+        }
+    }
+    close(fd);
+
+    log_print(log_fd, "Capture of %s saved to %s\n",
+            cap_devices[port_id], path);
+}
+
+/*
+ * Compress the raw chunks handed over, and save the ring of ports with an
+ * error CAP_AFTER_MS ago. At last, the receivers are stopped, so the chunks
+ * being filled and the pending errors are taken too.
+ */
+static void cap_service(int last)
+{
+    struct cap_port *p;
+    struct cap_raw *raw;
+    uint32_t head;
+    uint32_t now = cap_now_ms();
+    int i;
+
+    for (i = 0; i < cap_port_num; i++) {
+        p = &cap_ports[i];
+
+        if (last && p->raw[p->head % CAP_RAW_SLOTS].len > 0
+                && p->head - p->tail < CAP_RAW_SLOTS) {
+            p->head++;
+        }
+
+        head = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+        while (p->tail != head) {
+            raw = &p->raw[p->tail % CAP_RAW_SLOTS];
+            cap_compress(p, raw);
+            raw->len = 0;
+            __atomic_store_n(&p->tail, p->tail + 1, __ATOMIC_RELEASE);
+        }
+
+        if (__atomic_load_n(&p->trigger_set, __ATOMIC_ACQUIRE)
+                && (last || now - p->trigger_ms >= CAP_AFTER_MS)) {
+            cap_save(p, i);
+            __atomic_store_n(&p->trigger_set, 0, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static void *cap_routine(void *args)
+{
+    while (cap_running) {
+        sleep_ms(CAP_POLL_MS);
+        cap_service(0);
+    }
+
+    pthread_exit(NULL);
+}
+
+/******************************************************************************
+ * NAME:
+ *      sim_capture_start
+ *
+ * DESCRIPTION:
+ *      Start the raw RX capture of SIM ports.
+ *
+ * PARAMETERS:
+ *      port_num - Number of ports.
+ *      ring_kb - Compressed data kept per port, in KB.
+ *      devices - Device names of ports.
+ *      dir - Directory of capture files.
+ *
+ * RETURN:
+ *      0 - OK
+ *      -1 - Error
+ ******************************************************************************/
+int sim_capture_start(int port_num, int ring_kb, char **devices, char *dir)
+{
+    cap_ports = calloc(port_num, sizeof(struct cap_port));
+    if (cap_ports == NULL) {
+        return -1;
+    }
+
+    cap_port_num = port_num;
+    cap_ring_bytes = (size_t)ring_kb * 1024;
+    cap_devices = devices;
+    snprintf(cap_dir, sizeof(cap_dir), "%s", dir);
+    cap_start_ns = get_time_ns();
+    cap_running = 1;
+
+    if (pthread_create(&cap_thread, NULL, cap_routine, NULL) != 0) {
+        free(cap_ports);
+        cap_ports = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+ * NAME:
+ *      sim_capture_stop
+ *
+ * DESCRIPTION:
+ *      Stop the raw RX capture, after the receivers of all ports exit. The
+ *      pending errors are saved at once.
+ *
+ * PARAMETERS:
+ *      None
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void sim_capture_stop(void)
+{
+    struct cap_zchunk *z;
+    int i;
+
+    if (cap_ports == NULL) {
+        return;
+    }
+
+    cap_running = 0;
+    pthread_join(cap_thread, NULL);
+    cap_service(1);
+
+    for (i = 0; i < cap_port_num; i++) {
+        while ((z = cap_ports[i].first) != NULL) {
+            cap_ports[i].first = z->next;
+            free(z);
+        }
+    }
+
+    free(cap_ports);
+    cap_ports = NULL;
+}
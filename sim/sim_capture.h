@@ -0,0 +1,66 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     sim_capture.h
+ *
+ * DESCRIPTION:
+ *     Define raw RX capture of SIM ports and the format of capture file
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#ifndef _SIM_CAPTURE_H_
+#define _SIM_CAPTURE_H_
+
+#include <stdint.h>
+
+/*
+ * Capture file:
+ *     struct simcap_file_hdr
+ *     struct simcap_chunk_hdr + zlen bytes of zlib data, repeated
+ *
+ * A chunk is inflated to raw_len bytes of records, each one is a struct
+ * simcap_rec followed by len bytes. The data of SIMCAP_REC_DATA is the raw
+ * bytes received, SIMCAP_REC_DROP has the number of bytes not captured
+ * (uint32_t), the other records have no data.
+ */
+#define SIMCAP_MAGIC        "SIMCAP1"
+
+enum SIMCAP_REC {
+    SIMCAP_REC_DATA = 0,
+    SIMCAP_REC_CRC_ERROR,   /* Packet with wrong CRC received */
+    SIMCAP_REC_TIMEOUT,     /* No data in RX timeout */
+    SIMCAP_REC_DROP,        /* Capture is behind, bytes are not captured */
+};
+
+struct simcap_file_hdr {
+    char magic[8];
+    char device[32];        /* Device of port, e.g. "/dev/ttyS2" */
+    uint32_t port_id;       /* COM-n, from 1 */
+    uint32_t baudrate;
+    uint32_t trigger;       /* Record type triggering the capture file */
+    uint32_t trigger_ms;    /* Time of trigger, ms since capture start */
+    char machine;
+    char reserved[7];
+}__attribute__ ((packed));
+
+struct simcap_chunk_hdr {
+    uint32_t start_ms;      /* Time of first record */
+    uint32_t raw_len;
+    uint32_t zlen;
+}__attribute__ ((packed));
+
+struct simcap_rec {
+    uint32_t ms;            /* Time of receiving, ms since capture start */
+    uint16_t type;          /* enum SIMCAP_REC */
+    uint16_t len;
+}__attribute__ ((packed));
+
+int sim_capture_start(int port_num, int ring_kb, char **devices, char *dir);
+void sim_capture_data(int port_id, const uint8_t *buff, int len);
+void sim_capture_event(int port_id, int type);
+void sim_capture_stop(void);
+
+#endif /* _SIM_CAPTURE_H_ */
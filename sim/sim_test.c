@@ -20,20 +20,111 @@
 #include <string.h>
 #include <termios.h>
 #include <time.h>
+#include <math.h>
 #include <zlib.h>
 #include <stdint.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <libgen.h>
+#include <linux/serial.h>
 #include "cfg.h"
 #include "common.h"
+#include "errmap.h"
+#include "hist.h"
+#include "prbs.h"
+#include "sim_capture.h"
 #include "sim_test.h"
 #include "term.h"
+#include "uring.h"
 
 #define MAX_RETRY_COUNT 3
 
 #define TAIL 0xfe
 
-#define BUFF_SIZE 265
+/* Buffer of a packet, the length on the wire is frame_len */
+#define BUFF_SIZE SIM_FRAME_MAX
+
+/*
+ * Offset of pack_data, pack_tail, pack_num and crc_err on the wire. The
+ * trailer follows pack_data, whose length is frame_len less 15 bytes.
+ */
+#define PAYLOAD_OFFSET ((int)sizeof(struct uart_package))
+#define TAIL_OFFSET (frame_len - (int)sizeof(struct uart_trailer))
+#define NUM_OFFSET (TAIL_OFFSET + 1)
+#define CRC_OFFSET (frame_len - 4)
+
+/* TX timestamp in the last 8 bytes of pack_data, if latency is measured */
+#define TS_OFFSET (TAIL_OFFSET - 8)
+
+/* Pacing of the sender: write SEG_LEN bytes every SEG_INTERVAL_MS */
+#define SEG_LEN 25
+#define SEG_INTERVAL_MS 4
+
+/*
+ * Pacing by TIOCOUTQ: keep OUTQ_FILL_MS of data in the TX queue of UART, but
+ * OUTQ_MIN_FILL bytes at least
+ */
+#define OUTQ_FILL_MS 20
+#define OUTQ_MIN_FILL 64
+
+/*
+ * With XON/XOFF flow control, the packet bytes below are sent as XON_ESC
+ * and (byte ^ XON_ESC_MASK), so they are never taken as XON/XOFF
+ */
+#define XON_CHAR 0x11
+#define XOFF_CHAR 0x13
+#define XON_ESC 0x7d
+#define XON_ESC_MASK 0x20
+
+/*
+ * Without pacing, the sender waits the port to be writable for at most
+ * FLOW_POLL_MS at a time, and writes FLOW_WRITE_MAX bytes at most, which
+ * fit in the TX buffer of tty once it is writable
+ */
+#define FLOW_POLL_MS 100
+#define FLOW_WRITE_MAX 256
+
+/* Events handled by one epoll_wait() of epoll engine */
+#define EPOLL_MAX_EVENTS 64
+
+/*
+ * Requests of io_uring engine, user_data is the port and type of request.
+ * The requests in flight are canceled in URING_DRAIN_MS at the end of run.
+ */
+#define URING_RX 0
+#define URING_LINK_TIMEOUT 1
+#define URING_TX 2
+#define URING_TICK 3
+#define URING_CANCEL 4
+#define URING_DATA(port, type) (((uint64_t)(port) << 8) | (type))
+#define URING_PORT(data) ((int)((data) >> 8))
+#define URING_TYPE(data) ((int)((data) & 0xff))
+#define URING_DRAIN_MS 1000
+
+/* Same as the VTIME set by tc_init(), see get_rx_timeout_ms() for -sim-vtime */
+#define RX_TIMEOUT_MS 2000
+
+/* Delay before sending, waiting the receiver to be ready */
+#define SEND_DELAY_MS 3000
+
+/* Interval of sampling the hardware counters of UART */
+#define ICOUNT_INTERVAL_MS 1000
+
+/* Idle time between two steps of baud or frame sweep */
+#define SWEEP_GAP_MS 2000
+
+/*
+ * Topology discovery: send a probe on each port every PROBE_INTERVAL_MS
+ * until PROBE_SEND_MS, and listen until DISCOVERY_MS
+ */
+#define PROBE_LEN 10
+#define PROBE_INTERVAL_MS 200
+#define PROBE_SEND_MS 1500
+#define DISCOVERY_MS 2000
 
 /*Uart head 0xca5c051111 define*/
 static const uint8_t head[5] = {
@@ -44,6 +135,31 @@ static const uint8_t head[5] = {
     0x11
 };
 
+/* Baudrates of sweep, all supported by tc_set_baudrate() */
+static const int sweep_baudrate[] = {
+    9600, 19200, 38400, 57600, 115200, 230400, 460800, 576000, 921600
+};
+
+#define SWEEP_RATE_COUNT (sizeof(sweep_baudrate) / sizeof(sweep_baudrate[0]))
+
+/* Packet lengths of frame sweep, from SIM_FRAME_MIN to SIM_FRAME_MAX */
+static const int sweep_frame[] = {
+    16, 32, 64, 128, 256, 512, 1024
+};
+
+#define SWEEP_FRAME_COUNT (sizeof(sweep_frame) / sizeof(sweep_frame[0]))
+
+#define SWEEP_STEP_COUNT (SWEEP_RATE_COUNT > SWEEP_FRAME_COUNT ? \
+        SWEEP_RATE_COUNT : SWEEP_FRAME_COUNT)
+
+/* Probe of topology discovery: probe_sign, machine, port_id, crc32 */
+static const uint8_t probe_sign[4] = {
+    0x9a,
+    0x3c,
+    0x7e,
+    0x51
+};
+
 static const uint8_t stop_sign[5] = {
     0x7e,
     0x57,
@@ -52,7 +168,7 @@ static const uint8_t stop_sign[5] = {
     0xff
 };
 
-static char *port_list[MAX_SIM_PORT_COUNT] = {
+static char *default_port_list[MAX_SIM_PORT_COUNT] = {
     "/dev/ttyS2",
     "/dev/ttyS3",
     "/dev/ttyS4",
@@ -71,46 +187,379 @@ static char *port_list[MAX_SIM_PORT_COUNT] = {
     "/dev/ttyS17"
 };
 
+/* Devices of SIM ports, g_sim_port_list if given by -sim-ports */
+static char **port_list = default_port_list;
+
 struct uart_package {
     uint8_t pack_head[5];/*0xca5c051111*/
     uint8_t port_id;
-    uint8_t pack_data[250];//0x00->0xF9
+    uint8_t pack_data[];//0x00->0xF9 in 265 bytes packet
+}__attribute__ ((packed));
+
+/* At TAIL_OFFSET, after pack_data */
+struct uart_trailer {
     uint8_t pack_tail;
     uint32_t  pack_num;
     uint32_t crc_err;
 }__attribute__ ((packed));
 
+/* Length of packets on the wire, g_sim_frame or a step of frame sweep */
+static int frame_len = SIM_FRAME_DEFAULT;
+
 struct uart_attr {
     int uart_fd;
     int baudrate;
     int port_id;
 }__attribute__ ((packed));
 
+/* Snapshot of the counters of a port, see sim_get_count() */
 struct uart_count_list {
-    uint32_t err_count;//global variable,count packet loss or error
-    uint32_t recv_count;//global variable, count received packet
-    uint32_t send_count;//global variable, count send packet
+    uint32_t err_count;//count packet loss or error
+    uint32_t recv_count;//count received packet
+    uint32_t send_count;//count send packet
     uint32_t target_send_num;//Record target amount of packets sent
     uint32_t lost_count;
     uint32_t timeout_count;
-}__attribute__ ((packed));
+    uint32_t skip_count;//bytes skipped while searching packet head
+    uint64_t tx_bytes;//bytes written to port
+    uint64_t rx_cpu_ns;//CPU time of receiving
+    uint64_t bit_count;//bits compared with expected packets
+    uint64_t bit_err;//bits different from expected packets
+    uint32_t dup_count;//duplicated packets
+    uint32_t reorder_count;//packets filling a gap, out of order
+    uint32_t late_count;//packets older than the window of tracker
+    int hw_valid;//hardware counters are supported by the driver
+    uint32_t hw_rx;//hardware counters since test start
+    uint32_t hw_tx;
+    uint32_t hw_frame;
+    uint32_t hw_parity;
+    uint32_t hw_brk;
+    uint32_t hw_overrun;
+    uint32_t hw_buf_overrun;
+    uint32_t hw_cts;//CTS changes, flow control by RTS/CTS
+};
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Counters of a port. The TX block is written by the sender only and the RX
+ * block by the receiver only, each in its own cache line. A writer updates
+ * its counters with relaxed atomic stores between two increments of the
+ * sequence number, so the main thread can read a consistent snapshot with
+ * sim_get_count() without locking the writers.
+ */
+struct uart_tx_stats {
+    uint32_t seq;
+    uint32_t send_count;
+    uint64_t tx_bytes;
+}__attribute__ ((aligned(CACHE_LINE_SIZE)));
+
+struct uart_rx_stats {
+    uint32_t seq;
+    uint32_t err_count;
+    uint32_t recv_count;
+    uint32_t target_send_num;
+    uint32_t lost_count;
+    uint32_t timeout_count;
+    uint32_t skip_count;
+    uint64_t rx_cpu_ns;
+    uint64_t bit_count;
+    uint64_t bit_err;
+    uint32_t dup_count;
+    uint32_t reorder_count;
+    uint32_t late_count;
+}__attribute__ ((aligned(CACHE_LINE_SIZE)));
+
+/*
+ * Hardware counters of UART (TIOCGICOUNT) since test start, written by the
+ * sampler only. overrun is lost in the FIFO of UART, buf_overrun is lost in
+ * the tty buffer of kernel.
+ */
+struct uart_hw_stats {
+    uint32_t seq;
+    int valid;
+    uint32_t rx;
+    uint32_t tx;
+    uint32_t frame;
+    uint32_t parity;
+    uint32_t brk;
+    uint32_t overrun;
+    uint32_t buf_overrun;
+    uint32_t cts;
+    struct serial_icounter_struct base;
+}__attribute__ ((aligned(CACHE_LINE_SIZE)));
+
+struct uart_stats {
+    struct uart_tx_stats tx;
+    struct uart_rx_stats rx;
+    struct uart_hw_stats hw;
+};
+
+#define STAT_GET(var)       __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define STAT_SET(var, val)  __atomic_store_n(&(var), (val), __ATOMIC_RELAXED)
+#define STAT_ADD(var, val)  STAT_SET(var, (var) + (val))
+
+/* Update counters of a stats block, by the single writer of the block */
+#define STAT_UPDATE(blk, stmt) \
+    do { \
+        stat_write_begin(&(blk)->seq); \
+        stmt; \
+        stat_write_end(&(blk)->seq); \
+    } while (0)
+
+/*
+ * Window of sequence tracker in packets, the size must be power of 2. A
+ * packet older than the window is counted as late.
+ */
+#define SEQ_WINDOW 1024
+#define SEQ_WORDS (SEQ_WINDOW / 64)
+
+/* Receive ring of a port, the size must be power of 2 */
+#define RX_RING_SIZE 4096
+#define RX_RING_MASK (RX_RING_SIZE - 1)
+
+struct uart_ring {
+    uint8_t data[RX_RING_SIZE];
+    uint32_t rd;        /* Read index, free running */
+    uint32_t wr;        /* Write index, free running */
+    uint32_t skipped;   /* Bytes skipped in current resync */
+    int esc_on;         /* Unescape the stream of XON/XOFF flow control */
+    int esc;            /* The last byte read is XON_ESC */
+};
+
+/*
+ * Pre-serialized packet of a port. Only pack_num and crc_err (and the TX
+ * timestamp or PRBS payload, if used) change from packet to packet, so the
+ * CRC of the constant part before var_off is calculated once and continued
+ * over the variable part for each packet.
+ */
+struct uart_frame {
+    uint8_t wire[BUFF_SIZE];
+    uint32_t prefix_crc;
+    int var_off;        /* PAYLOAD_OFFSET, TS_OFFSET or NUM_OFFSET */
+    int payload_end;    /* TS_OFFSET or TAIL_OFFSET */
+    prbs_t gen;         /* Generator of PRBS payload */
+};
+
+/*
+ * Expected packets of a port, regenerated by the receiver to count the bit
+ * errors of received packets. The error map is kept for the whole test.
+ */
+struct uart_ber {
+    struct uart_frame expect;
+    uint32_t next_num;  /* pack_num of next packet */
+    uint32_t gen_num;   /* pack_num of next payload of expect.gen */
+    errmap_t map;
+};
+
+/*
+ * Latency of a port, updated by the receiver only. The jitter is the
+ * difference of latency between two packets in a row.
+ */
+struct uart_latency {
+    hist_t latency;
+    hist_t jitter;
+    uint64_t last_ns;
+    int has_last;
+};
+
+/* Per-port state of the epoll engine */
+struct uart_io {
+    struct uart_attr *attr;
+    struct uart_frame tx;
+    uint8_t tx_esc[BUFF_SIZE * 2];
+    uint8_t *tx_buf;    /* tx.wire, or tx_esc with XON/XOFF */
+    int tx_len;
+    int tx_off;
+    int outq_target;
+    struct uart_ring rx;
+    uint64_t last_rx_ms;
+};
+
+/* Per-port state of the io_uring engine, in the registered buffer */
+struct uring_io {
+    struct uart_io io;
+    uint8_t rx_tmp[RX_RING_SIZE];   /* Data read to unescape for XON/XOFF */
+    int rx_busy;        /* A read is in flight */
+    int tx_busy;        /* A write is in flight */
+};
+
+struct sim_uring {
+    uring_t ring;
+    struct uring_io *port;
+    int fixed_files;    /* Ports are registered files */
+    int fixed_bufs;     /* port[] is a registered buffer */
+    struct __kernel_timespec tick;
+    struct __kernel_timespec rx_timeout;
+};
+
+/*
+ * Per-port state below is allocated by sim_alloc_ports() for sim_port_num
+ * ports, which is 0 before allocation.
+ */
+static int sim_port_num;
+
+static struct uart_stats *_uart_stats;
+
+/* Expected packet of each port, used to check received packets */
+static struct uart_frame *_uart_frame;
+
+static struct uart_ber *_uart_ber;
+
+/*
+ * Sequence tracker of a port, updated by the receiver only. pack_num is
+ * extended to 64 bits against the highest one, and the bitmap holds the
+ * packets received in the window up to the highest one.
+ */
+struct uart_seq {
+    uint64_t highest;
+    uint64_t bitmap[SEQ_WORDS];
+    uint64_t lost;      /* Skipped packets not filled yet */
+    uint64_t lost_logged;
+    hist_t reorder;     /* Distance of packets filling a gap */
+};
+
+/* Class of a received packet by sequence tracker */
+enum SEQ_CLASS {
+    SEQ_IN_ORDER = 0,   /* Higher than all received, maybe after a gap */
+    SEQ_GAP_FILL,       /* Fill a gap in window, reordered */
+    SEQ_DUPLICATE,      /* Received already */
+    SEQ_LATE,           /* Older than window */
+};
+
+static struct uart_seq *_uart_seq;
+
+/* Wiring of a port, see sim_discover() */
+struct uart_peer {
+    int sender;         /* Port sending the packets received by this port */
+    int mismatch;       /* Mismatched packet is logged */
+};
+
+static struct uart_peer *_uart_peer;
+
+/* Latency of each port, allocated only if latency is measured */
+static struct uart_latency *_uart_latency;
 
-static struct uart_count_list _uart_array[16];//init uart_count
+/* Time of sending start and end, for throughput calculation */
+static uint64_t tx_start_ms;
+static uint64_t tx_end_ms;
 
-static int read_pack_head_1_byte(int fd, uint8_t *buff, int port_id);
+/*
+ * I/O system calls and process CPU time of the engine in a run, to compare
+ * the engines. Each engine thread counts its own calls, and adds them to
+ * io_calls by flush_io_calls() when it ends.
+ */
+static __thread uint64_t thread_io_calls;
+static uint64_t io_calls;
+static uint64_t engine_cpu_ns;
+#define COUNT_IO_CALL() (thread_io_calls++)
+
+/*
+ * Running flag of current run, which is the whole test, or a step of baud
+ * or frame sweep ending at sim_stop_ms. See sim_is_running().
+ */
+static volatile int sim_running;
+static uint64_t sim_stop_ms;
+
+/* Result of a port at a step of baud or frame sweep */
+struct sim_sweep_result {
+    int done;
+    uint64_t goodput;   /* Bytes of good packets, payload in frame sweep */
+    uint64_t frames;    /* Good packets per second */
+    uint32_t recv;
+    uint32_t lost;
+    uint32_t err;
+    uint32_t overrun;   /* overrun + buf_overrun of UART */
+    uint64_t rx_cpu_ns;
+};
+
+static struct sim_sweep_result (*_sweep_result)[SWEEP_STEP_COUNT];
 
-static void creat_uart_pack(struct uart_package *uart_pack, uint32_t pack_num, uint8_t port_id);
-static int send_uart_packet(int fd, struct uart_package * packet_ptr, int len);
-static int recv_uart_packet(int fd, uint8_t *buff, int len, int port_id);
+static void creat_uart_pack(uint8_t *buff, uint32_t pack_num, uint8_t port_id);
+static void init_uart_frame(struct uart_frame *frame, uint8_t port_id);
+static void update_uart_frame(struct uart_frame *frame, uint32_t pack_num);
+static uint32_t calc_packet_crc(uint8_t *buff, int port_id);
+static void init_uart_ber(int port_id);
+static void init_uart_seq(int port_id);
+static int track_sequence(int port_id, uint32_t pack_num);
+static uint64_t count_bit_errors(uint8_t *buff, int port_id, int crc_ok);
+static int send_uart_packet(int fd, uint8_t *buff, int len);
+static int send_uart_packet_outq(int fd, uint8_t *buff, int len, int target,
+        int baudrate);
+static int get_outq_target(int baudrate);
+static uint64_t get_time_ms(void);
+static int get_rx_timeout_ms(void);
+static uint64_t get_process_cpu_ns(void);
+static int sim_is_running(void);
+static void sim_stop(void);
+static int recv_uart_stream(int fd, struct uart_ring *ring);
+static void capture_uart_stream(int port_id, struct uart_ring *ring, int n);
+static int parse_uart_stream(struct uart_ring *ring, struct uart_attr *attr);
+static void count_rx_timeout(int port_id);
 static int analysis_packet(uint8_t *buff, int port_id);
+static void process_uart_packet(uint8_t *buff, int port_id);
+static void send_stop_sign(int fd);
+static int write_uart_all(int fd, const uint8_t *buff, int len);
+static int escape_xonxoff(const uint8_t *buff, int len, uint8_t *out);
+static int unescape_xonxoff(struct uart_ring *ring, const uint8_t *buff, int n);
+static void record_latency(uint8_t *buff, int port_id);
+static void sim_print_latency(int fd);
+static void sim_print_ber(int fd);
+static void sim_print_errmap(int fd);
+static void sim_print_seq(int fd);
 
 static void *port_recv_event(void *args);
 static void *port_send_event(void *args);
+static void init_hw_count(int fd, int port_id);
+static void sample_hw_count(int fd, int port_id);
+static void *port_icount_event(void *args);
+static void sim_reactor_run(struct uart_attr *uart_param, int port_num);
+static void sim_uring_run(struct uart_attr *uart_param, int port_num);
+static void flush_io_calls(void);
+static void sim_run_engine(struct uart_attr *uart_param, int port_num);
+static void reset_port_count(int port_id);
+static void sim_sweep(struct uart_attr *uart_param, int port_num);
+static int sim_discover(struct uart_attr *uart_param, int port_num);
+static int sim_alloc_ports(int port_num);
+static void sim_print_sweep(int fd);
+static void sim_print_frame_sweep(int fd);
+static void sim_get_count(int port_id, struct uart_count_list *count);
 static void sim_print_status(void);
+static void sim_print_throughput(int fd);
 static void sim_print_result(int fd);
 static void *sim_test(void *args);
 
 
+static inline void stat_write_begin(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void stat_write_end(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t stat_read_begin(uint32_t *seq)
+{
+    uint32_t s;
+
+    /* Odd number means the writer is updating */
+    while ((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+        ;
+    }
+
+    return s;
+}
+
+static inline int stat_read_retry(uint32_t *seq, uint32_t s)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != s;
+}
+
 //test_mod_t no define in this test
 test_mod_t test_mod_sim = {
     .run = 1,
@@ -126,464 +575,2859 @@ test_mod_t test_mod_sim = {
  * NAME:
  *     creat_uart_pack
  * Description:
- *     creat uart package
+ *     creat uart package of frame_len bytes, serialized as sent on the wire
  * PARAMETERS:
- *     uart_pack: creat uart packet and save into uart_pack
+ *     buff: save packet, frame_len bytes at least
  *     pack_num: count packet amount
  *     port_id: uart ID
  * Return:
  *
  */
-static void creat_uart_pack(struct uart_package *uart_pack, uint32_t pack_num, uint8_t port_id)
+static void creat_uart_pack(uint8_t *buff, uint32_t pack_num, uint8_t port_id)
 {
-    uint8_t i = 0;
-    uint32_t crc = 0xFFFFFFFF;
+    struct uart_package *uart_pack = (struct uart_package *)buff;
+    struct uart_trailer *trailer = (struct uart_trailer *)(buff + TAIL_OFFSET);
+    int i = 0;
 
     /*creat pack head*/
     for (i=0; i<5; i++) {
         uart_pack->pack_head[i] = head[i];
     }
 
-    /*creat pack data*/
+    /*creat pack data, the PRBS payloads are filled by update_uart_frame()*/
     uart_pack->port_id = port_id;
-    for (i=0; i<=0xF9; i++) {
-        uart_pack->pack_data[i] = i;
+    for (i=0; i<TAIL_OFFSET-PAYLOAD_OFFSET; i++) {
+        switch (g_sim_payload) {
+        case SIM_PAYLOAD_ZEROS:
+            uart_pack->pack_data[i] = 0x00;
+            break;
+        case SIM_PAYLOAD_ONES:
+            uart_pack->pack_data[i] = 0xFF;
+            break;
+        case SIM_PAYLOAD_ALT:
+            uart_pack->pack_data[i] = 0x55;
+            break;
+        default:
+            uart_pack->pack_data[i] = (uint8_t)i;
+            break;
+        }
     }
-    uart_pack->pack_tail = TAIL;
-    uart_pack->pack_num = pack_num;
+    trailer->pack_tail = TAIL;
+    trailer->pack_num = pack_num;
 
     /*
      * calculated CRC
      */
-    crc = crc32(0, (uint8_t *)uart_pack, 261);
-    uart_pack->crc_err = crc;
+    trailer->crc_err = crc32(0, buff, CRC_OFFSET);
 }
 
 /*
  * Name:
- *      send_uart_packet
+ *      init_uart_frame
  * Description:
- *      send data
+ *      serialize the packet of port once and calculate CRC of the constant
+ *      part (pack_head, port_id, pack_data and pack_tail, except the TX
+ *      timestamp if latency is measured)
  * PARAMETERS:
- *      fd:file point
- *      packet_ptr:data point
-len:data length
+ *      frame: save pre-serialized packet
+ *      port_id: uart ID
  * Return:
- *      send bytes
+ *      NULL
  */
-static int send_uart_packet(int fd, struct uart_package * packet_ptr, int len)
+static void init_uart_frame(struct uart_frame *frame, uint8_t port_id)
 {
-    uint8_t buff[BUFF_SIZE];
-    int ret = 0;
-    int i = 0;
-    int bytes = 0;
-    int seg_len = 25;
+    creat_uart_pack(frame->wire, 0, port_id);
 
-    if (packet_ptr == NULL) {
-        DBG_PRINT("Have no packet sent\n");
-        return -1;
-    }
-    memcpy(buff, packet_ptr->pack_head, sizeof(packet_ptr->pack_head));
+    frame->payload_end = (g_sim_latency != SIM_LATENCY_OFF) ?
+        TS_OFFSET : TAIL_OFFSET;
 
-    buff[5] = packet_ptr->port_id;
+    switch (g_sim_payload) {
+    case SIM_PAYLOAD_PRBS7:
+        prbs_init(&frame->gen, PRBS_7, 0);
+        frame->var_off = PAYLOAD_OFFSET;
+        break;
+    case SIM_PAYLOAD_PRBS15:
+        prbs_init(&frame->gen, PRBS_15, 0);
+        frame->var_off = PAYLOAD_OFFSET;
+        break;
+    case SIM_PAYLOAD_PRBS31:
+        prbs_init(&frame->gen, PRBS_31, 0);
+        frame->var_off = PAYLOAD_OFFSET;
+        break;
+    case SIM_PAYLOAD_RANDOM:
+        prbs_init(&frame->gen, PRBS_RANDOM, g_sim_seed);
+        frame->var_off = PAYLOAD_OFFSET;
+        break;
+    default:
+        frame->var_off = (frame->payload_end == TS_OFFSET) ?
+            TS_OFFSET : NUM_OFFSET;
+        break;
+    }
 
-    memcpy(buff + 6, packet_ptr->pack_data, sizeof(packet_ptr->pack_data));
+    frame->prefix_crc = crc32(0, frame->wire, frame->var_off);
+}
 
-    buff[256] = packet_ptr->pack_tail;
+/*
+ * Name:
+ *      update_uart_frame
+ * Description:
+ *      patch pack_num (and TX timestamp if latency is measured, the next
+ *      bytes of PRBS payload if used) of pre-serialized packet and update
+ *      its CRC
+ * PARAMETERS:
+ *      frame: pre-serialized packet
+ *      pack_num: count packet amount
+ * Return:
+ *      NULL
+ */
+static void update_uart_frame(struct uart_frame *frame, uint32_t pack_num)
+{
+    uint32_t crc;
+    uint64_t ts;
 
-    memcpy(buff + 257, &packet_ptr->pack_num, sizeof(packet_ptr->pack_num));
-    memcpy(buff + 261, &packet_ptr->crc_err, sizeof(packet_ptr->crc_err));
+    if (frame->var_off == PAYLOAD_OFFSET) {
+        prbs_fill(&frame->gen, frame->wire + PAYLOAD_OFFSET,
+                frame->payload_end - PAYLOAD_OFFSET);
+    }
+    if (frame->payload_end == TS_OFFSET) {
+        ts = get_time_ns();
+        memcpy(frame->wire + TS_OFFSET, &ts, sizeof(ts));
+    }
+    memcpy(frame->wire + NUM_OFFSET, &pack_num, sizeof(pack_num));
 
-    for (i=0; i<len; ) {
-        int j = 0;
+    crc = crc32(frame->prefix_crc, frame->wire + frame->var_off,
+            CRC_OFFSET - frame->var_off);
+    memcpy(frame->wire + CRC_OFFSET, &crc, sizeof(crc));
+}
 
-        if ((len - i) < seg_len)
-            seg_len = len - i;
+/*
+ * Name:
+ *      calc_packet_crc
+ * Description:
+ *      calculate CRC of received packet. If the constant part is the same as
+ *      the expected packet of port, continue the CRC from the pre-calculated
+ *      one, otherwise calculate it over the whole packet.
+ * PARAMETERS:
+ *      buff: received packet
+ *      port_id: array id number
+ * Return:
+ *      CRC of packet
+ */
+static uint32_t calc_packet_crc(uint8_t *buff, int port_id)
+{
+    struct uart_frame *frame = &_uart_frame[port_id];
 
-        for(j=0; j<seg_len; ) {
-            ret = write(fd, buff + i, seg_len - j);
-            if (ret == -1) {
-                sleep(1);
-                continue;
-            } else {
-                bytes += ret;
-                i += ret;
-                j += ret;
-            }
-        }
-        sleep_ms(4);
+    if (memcmp(buff, frame->wire, frame->var_off) == 0) {
+        return crc32(frame->prefix_crc, buff + frame->var_off,
+                CRC_OFFSET - frame->var_off);
     }
 
-    return bytes;
+    return crc32(0, buff, CRC_OFFSET);
 }
 
-
 /*
  * Name:
- *      read_pack_head_1_byte
+ *      init_uart_ber
  * Description:
- *      read 1 data from uart
+ *      restart the expected packets of port, before the sender starts
  * PARAMETERS:
- *      fd:file point
- *      buff:save data
- *      port_id:array id number
+ *      port_id: array id number
  * Return:
- *       read status
+ *      NULL
  */
-static int read_pack_head_1_byte(int fd, uint8_t *buff, int port_id)
+static void init_uart_ber(int port_id)
 {
-    int ret = 0;
-    do {
-        ret = read(fd, buff, 1);
-        if (ret < 0) {
-            buff[0] = 0; /* if read error, init buff[0] = 0*/
-            DBG_PRINT("Read error\n");
-            break;
-        } else if (ret == 0) {
-            buff[0] = 0;/*if read anything, init buff[0] = 0*/
-            _uart_array[port_id].timeout_count++;
-            DBG_PRINT("received timeout\n");
-            break;
-        } else if (ret == 1) {
-            _uart_array[port_id].timeout_count = 0;
-        }
-    } while (ret != 1);
-    return ret;
+    init_uart_frame(&_uart_ber[port_id].expect, _uart_peer[port_id].sender);
+    _uart_ber[port_id].next_num = 1;
+    _uart_ber[port_id].gen_num = 1;
 }
 
 /*
  * Name:
- *      recv_uart_packet
+ *      count_bit_errors
  * Description:
- *      receive data
+ *      regenerate the expected packet and count the bits different from the
+ *      received one. A packet with CRC OK has no bit error, so only packets
+ *      with CRC error are regenerated, after skipping the PRBS stream of the
+ *      packets before. Their pack_num is not trusted, it is taken as the
+ *      next one. A packet older than the expected one is not counted.
  * PARAMETERS:
- *      fd:file point
- *      buff:save data
- *      len:data length
- *      port_id:array id number
+ *      buff: received packet
+ *      port_id: array id number
+ *      crc_ok: CRC of packet is OK
  * Return:
- *       received bytes
+ *      number of bit errors
  */
-static int recv_uart_packet(int fd, uint8_t *buff, int len, int port_id)
+static uint64_t count_bit_errors(uint8_t *buff, int port_id, int crc_ok)
 {
-    int ret = 0;
-    int i = 0;
-    int bytes = 0;
-    int retry_count = 0;
-
-    int log_fd;
-
-    log_fd = test_mod_sim.log_fd;
-
-    /*matching head*/
-    read_pack_head_1_byte(fd, buff, port_id);
+    struct uart_rx_stats *rx = &_uart_stats[port_id].rx;
+    struct uart_ber *ber = &_uart_ber[port_id];
+    struct uart_frame *frame = &ber->expect;
+    int payload_len = frame->payload_end - PAYLOAD_OFFSET;
+    uint32_t pack_num;
+    uint64_t errs;
+    int bits;
 
-    while (i < 5) {
-        /*check head[i]*/
-        if (buff[i] == head[i] || buff[i] == stop_sign[i]) {/*start if*/
-            i++;
-
-            if (i < 5) {
-                read_pack_head_1_byte(fd, buff + i, port_id);
-            }
-        } else {
-            DBG_PRINT("%s received HEAD%d data = %02x\n",
-                    port_list[port_id], i, buff[i]);
-            if (i == 0) {
-                retry_count++;
-
-                /*if timeout,not read again to avoid data loss*/
-                if (retry_count <= MAX_RETRY_COUNT) {
-                    read_pack_head_1_byte(fd, buff, port_id);
-                }
-            } else {
-                retry_count++;
-                buff[0] = buff[i];
-                i = 0;
-            }
-        }/*end if*/
+    if (crc_ok) {
+        memcpy(&pack_num, buff + NUM_OFFSET, sizeof(pack_num));
+    } else {
+        pack_num = ber->next_num;
+    }
 
-        /*timeout*/
-        if (retry_count > MAX_RETRY_COUNT) {
-            if (test_mod_sim.pass && _uart_array[port_id].timeout_count != 0) {
-                log_print(log_fd, "COM-%d timeout, please check the port connection\n",
-                        port_id+1);
-            }
+    if ((int32_t)(pack_num - ber->next_num) < 0) {
+        return 0;
+    }
+    ber->next_num = pack_num + 1;
 
-            if(g_running) {
-                DBG_PRINT("%s check PACKET HEAD timeout when received %d packet\n",
-                        port_list[port_id], _uart_array[port_id].recv_count);
+    /* The TX timestamp is not known, and the CRC is not counted */
+    bits = CRC_OFFSET * 8;
+    if (frame->payload_end == TS_OFFSET) {
+        bits -= (TAIL_OFFSET - TS_OFFSET) * 8;
+    }
 
-                test_mod_sim.pass = 0;
-            }
-            return bytes;
+    errs = 0;
+    if (!crc_ok) {
+        if (frame->var_off == PAYLOAD_OFFSET) {
+            prbs_skip(&frame->gen, (uint64_t)(pack_num - ber->gen_num)
+                    * payload_len);
+            prbs_fill(&frame->gen, frame->wire + PAYLOAD_OFFSET, payload_len);
+        }
+        ber->gen_num = pack_num + 1;
+        memcpy(frame->wire + NUM_OFFSET, &pack_num, sizeof(pack_num));
+        if (frame->payload_end == TS_OFFSET) {
+            memcpy(frame->wire + TS_OFFSET, buff + TS_OFFSET, TAIL_OFFSET - TS_OFFSET);
         }
-    }
 
-    if (buff[4] == stop_sign[4]) {
-        log_print(log_fd,"%s received stop signal, sim test will be stop\n", port_list[port_id]);
-        return -1;/* means will be stop test*/
+        errs = errmap_add(&ber->map, buff, frame->wire, CRC_OFFSET);
     }
 
-    retry_count = 0;
+    STAT_UPDATE(rx,
+            STAT_ADD(rx->bit_count, bits);
+            STAT_ADD(rx->bit_err, errs));
 
-    /*if head is not stop_sign then*/
-    _uart_array[port_id].recv_count++;/* Packet Reception count +1*/
-    bytes += 5;
-    len -= 5;
+    return errs;
+}
 
-    while (len > 0) {
-        ret = read(fd, buff + bytes, len);
-        if (ret < 0) {
-            log_print(log_fd,"%s read error\n", port_list[port_id]);
-            test_mod_sim.pass = 0;
-            break;
-        } else if (ret == 0) {
-            if (++retry_count > MAX_RETRY_COUNT) {
-                if (g_running) {
-                    log_print(log_fd, "%s receive %d packet timeout\n",
-                            port_list[port_id],
-                            _uart_array[port_id].recv_count);
-                    _uart_array[port_id].timeout_count += 3;
-                    test_mod_sim.pass = 0;
-                }
-                break;
-            } else {
-                DBG_PRINT("Retry:%d\n", retry_count);
-            }
-        } else {
-            bytes += ret;
-            len = len - ret;
-            _uart_array[port_id].timeout_count = 0;
-        }
-    } /* end while (len > 0) */
+/*
+ * Name:
+ *      init_uart_seq
+ * Description:
+ *      restart the sequence tracker of port, before the sender starts
+ * PARAMETERS:
+ *      port_id: array id number
+ * Return:
+ *      NULL
+ */
+static void init_uart_seq(int port_id)
+{
+    struct uart_seq *seq = &_uart_seq[port_id];
 
-    return bytes;
+    seq->highest = 0;
+    memset(seq->bitmap, 0, sizeof(seq->bitmap));
+    seq->lost = 0;
+    seq->lost_logged = 0;
+    hist_init(&seq->reorder);
+
+    /* pack_num starts from 1, take 0 as received */
+    seq->bitmap[0] = 1;
 }
 
 /*
  * Name:
- *      analysis_packet
+ *      clear_seq_bits
  * Description:
- *      check packet
+ *      clear the bits of pack_num from ~ to in bitmap, a word at a time
  * PARAMETERS:
- *      recv_packet: packet
- *      buff:data
- *      port_id:array id number
+ *      seq: sequence tracker
+ *      from: first pack_num
+ *      to: last pack_num, less than from + SEQ_WINDOW
  * Return:
- *      0: packet ok
- *      -1: packet error
- *
+ *      NULL
  */
-static int analysis_packet(uint8_t *buff, int port_id)
+static void clear_seq_bits(struct uart_seq *seq, uint64_t from, uint64_t to)
 {
-    uint32_t crc_check;
-    int i;
-    int log_fd;
-    int tmp;
+    uint64_t mask;
+    int lo;
+    int hi;
 
-    struct uart_package *recv_packet;
-    recv_packet = (struct uart_package *)buff;
+    while (from <= to) {
+        lo = from % 64;
+        hi = (from / 64 == to / 64) ? to % 64 : 63;
 
-    log_fd = test_mod_sim.log_fd;
+        mask = (hi == 63) ? ~0ULL : ((1ULL << (hi + 1)) - 1);
+        mask &= ~((1ULL << lo) - 1);
+        seq->bitmap[(from / 64) % SEQ_WORDS] &= ~mask;
 
-    /*
-     * check crc and printf which data is error
-     */
-    crc_check = crc32(0, (uint8_t *)recv_packet, 261);
-    if ((uint32_t)crc_check != (uint32_t)recv_packet->crc_err) {
-        if (g_running) {
-            /*means received error packet*/
-            log_print(log_fd, "%s Received \"%d\"packet error\n",
-                    port_list[port_id], _uart_array[port_id].recv_count);
-            write_file(log_fd, "    ");
-            /*dump received data*/
-            for (i = 0; i < 257; i++) {/*print received pack_head & port_id &pack_data*/
-                write_file(log_fd, " %02X", *((uint8_t *)buff + i));
-                if (((i+1) % 16) == 0) {
-                    write_file(log_fd, "\n");
-                    write_file(log_fd, "    ");
-                }
-            }
-            write_file(log_fd, "\n    Received pack_num = %u\n", (uint32_t)recv_packet->pack_num);
-            write_file(log_fd, "    Received crc = %08X\n", (uint32_t)recv_packet->crc_err);
-            write_file(log_fd, "    Calculated crc = %08X\n", (uint32_t)crc_check);
+        from = (from | 63) + 1;
+    }
+}
 
-            _uart_array[port_id].err_count++;
-            test_mod_sim.pass = 0;
+/*
+ * Name:
+ *      track_sequence
+ * Description:
+ *      classify a good packet by its pack_num and update the lost count
+ *      and reorder distances, in constant time
+ * PARAMETERS:
+ *      port_id: array id number
+ *      pack_num: pack_num of packet
+ * Return:
+ *      class of packet, see enum SEQ_CLASS
+ */
+static int track_sequence(int port_id, uint32_t pack_num)
+{
+    struct uart_seq *seq = &_uart_seq[port_id];
+    uint64_t num;
+    uint64_t dist;
+    uint64_t bit;
+    uint64_t *word;
+
+    num = seq->highest + (int32_t)(pack_num - (uint32_t)seq->highest);
+    if ((int64_t)num < 0) {
+        return SEQ_LATE;
+    }
+
+    if (num > seq->highest) {
+        /* The slots of new pack_num are reused from the oldest ones */
+        if (num - seq->highest >= SEQ_WINDOW) {
+            memset(seq->bitmap, 0, sizeof(seq->bitmap));
+        } else {
+            clear_seq_bits(seq, seq->highest + 1, num);
+        }
+
+        seq->lost += num - seq->highest - 1;
+        seq->highest = num;
+        seq->bitmap[(num / 64) % SEQ_WORDS] |= 1ULL << (num % 64);
+
+        return SEQ_IN_ORDER;
+    }
+
+    dist = seq->highest - num;
+    if (dist >= SEQ_WINDOW) {
+        return SEQ_LATE;
+    }
+
+    word = &seq->bitmap[(num / 64) % SEQ_WORDS];
+    bit = 1ULL << (num % 64);
+    if (*word & bit) {
+        return SEQ_DUPLICATE;
+    }
+
+    *word |= bit;
+    seq->lost--;
+    hist_add(&seq->reorder, dist);
+
+    return SEQ_GAP_FILL;
+}
+
+/*
+ * Name:
+ *      send_uart_packet
+ * Description:
+ *      send data
+ * PARAMETERS:
+ *      fd:file point
+ *      buff:serialized packet
+ *      len:data length
+ * Return:
+ *      send bytes
+ */
+static int send_uart_packet(int fd, uint8_t *buff, int len)
+{
+    int ret = 0;
+    int i = 0;
+    int bytes = 0;
+    int seg_len = SEG_LEN;
+
+    if (buff == NULL) {
+        DBG_PRINT("Have no packet sent\n");
+        return -1;
+    }
+
+    for (i=0; i<len; ) {
+        int j = 0;
+
+        if ((len - i) < seg_len)
+            seg_len = len - i;
+
+        for(j=0; j<seg_len; ) {
+            ret = write(fd, buff + i, seg_len - j);
+            COUNT_IO_CALL();
+            if (ret == -1) {
+                sleep(1);
+                continue;
+            } else {
+                bytes += ret;
+                i += ret;
+                j += ret;
+            }
+        }
+        sleep_ms(SEG_INTERVAL_MS);
+    }
+
+    return bytes;
+}
+
+
+/*
+ * Name:
+ *      get_outq_target
+ * Description:
+ *      get the fill level of TX queue to keep for TIOCOUTQ pacing
+ * PARAMETERS:
+ *      baudrate: baudrate of port
+ * Return:
+ *      fill level in bytes
+ */
+static int get_outq_target(int baudrate)
+{
+    /* 8N1: 10 bits per byte on the line */
+    int target = baudrate / 10 * OUTQ_FILL_MS / 1000;
+
+    if (target < OUTQ_MIN_FILL) {
+        target = OUTQ_MIN_FILL;
+    }
+
+    return target;
+}
+
+/*
+ * Name:
+ *      send_uart_packet_outq
+ * Description:
+ *      send data, write only when the TX queue of UART is below the target
+ *      fill level, so the line is kept busy without overrunning the queue
+ * PARAMETERS:
+ *      fd:file point
+ *      buff:serialized packet
+ *      len:data length
+ *      target:fill level of TX queue in bytes
+ *      baudrate:baudrate of port
+ * Return:
+ *      send bytes
+ */
+static int send_uart_packet_outq(int fd, uint8_t *buff, int len, int target,
+        int baudrate)
+{
+    int bytes = 0;
+    int queued;
+    int room;
+    int ret;
+
+    while (bytes < len) {
+        if (ioctl(fd, TIOCOUTQ, &queued) < 0) {
+            queued = 0;
+        }
+        COUNT_IO_CALL();
+
+        room = target - queued;
+        if (room <= 0) {
+            /* Sleep until half of the target is left */
+            sleep_ms((queued - target / 2) * 10000 / baudrate + 1);
+            continue;
+        }
+
+        if (room > len - bytes) {
+            room = len - bytes;
+        }
+
+        ret = write(fd, buff + bytes, room);
+        COUNT_IO_CALL();
+        if (ret == -1) {
+            sleep(1);
+            continue;
+        }
+        bytes += ret;
+    }
+
+    return bytes;
+}
+
+/*
+ * Name:
+ *      send_uart_packet_flow
+ * Description:
+ *      send data without pacing, the flow control of port holds the sender.
+ *      Wait the port to be writable with timeout, so that a port stopped by
+ *      flow control for ever doesn't hang the test
+ * PARAMETERS:
+ *      fd:file point
+ *      buff:serialized packet
+ *      len:data length
+ * Return:
+ *      send bytes
+ */
+static int send_uart_packet_flow(int fd, uint8_t *buff, int len)
+{
+    struct pollfd pfd;
+    int bytes = 0;
+    int room;
+    int ret;
+
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+
+    while (bytes < len && sim_is_running()) {
+        COUNT_IO_CALL();
+        if (poll(&pfd, 1, FLOW_POLL_MS) <= 0) {
+            continue;
+        }
+
+        room = len - bytes;
+        if (room > FLOW_WRITE_MAX) {
+            room = FLOW_WRITE_MAX;
+        }
+
+        ret = write(fd, buff + bytes, room);
+        COUNT_IO_CALL();
+        if (ret == -1) {
+            sleep_ms(SEG_INTERVAL_MS);
+            continue;
+        }
+        bytes += ret;
+    }
+
+    return bytes;
+}
+
+/*
+ * Name:
+ *      escape_xonxoff
+ * Description:
+ *      escape the XON, XOFF and XON_ESC bytes of data for XON/XOFF flow
+ *      control
+ * PARAMETERS:
+ *      buff: data
+ *      len: data length
+ *      out: save escaped data, 2 * len bytes at most
+ * Return:
+ *      length of escaped data
+ */
+static int escape_xonxoff(const uint8_t *buff, int len, uint8_t *out)
+{
+    int n = 0;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if (buff[i] == XON_CHAR || buff[i] == XOFF_CHAR || buff[i] == XON_ESC) {
+            out[n++] = XON_ESC;
+            out[n++] = buff[i] ^ XON_ESC_MASK;
+        } else {
+            out[n++] = buff[i];
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Name:
+ *      recv_uart_escaped
+ * Description:
+ *      read the stream escaped for XON/XOFF flow control, and unescape it
+ *      into receive ring. An XON_ESC at the end of read is kept in ring->esc.
+ * PARAMETERS:
+ *      fd:file point
+ *      ring:receive ring of port
+ *      space:free space of ring
+ * Return:
+ *      received bytes, 0 on timeout, -1 on error
+ */
+static int recv_uart_escaped(int fd, struct uart_ring *ring, uint32_t space)
+{
+    uint8_t buf[RX_RING_SIZE];
+    int len = 0;
+    int n;
+
+    while (len == 0) {
+        n = read(fd, buf, space);
+        COUNT_IO_CALL();
+        if (n <= 0) {
+            return n;
+        }
+
+        len = unescape_xonxoff(ring, buf, n);
+    }
+
+    return len;
+}
+
+/*
+ * Name:
+ *      unescape_xonxoff
+ * Description:
+ *      unescape the data escaped for XON/XOFF flow control into receive
+ *      ring. An XON_ESC at the end of data is kept in ring->esc.
+ * PARAMETERS:
+ *      ring:receive ring of port, n bytes free at least
+ *      buff:data read
+ *      n:data length
+ * Return:
+ *      bytes put into ring
+ */
+static int unescape_xonxoff(struct uart_ring *ring, const uint8_t *buff, int n)
+{
+    uint8_t c;
+    int len = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (ring->esc) {
+            c = buff[i] ^ XON_ESC_MASK;
+            ring->esc = 0;
+        } else if (buff[i] == XON_ESC) {
+            ring->esc = 1;
+            continue;
+        } else {
+            c = buff[i];
+        }
+        ring->data[(ring->wr + len) & RX_RING_MASK] = c;
+        len++;
+    }
+    ring->wr += len;
+
+    return len;
+}
+
+/*
+ * Name:
+ *      recv_uart_stream
+ * Description:
+ *      read all available data (up to the free space) into receive ring
+ * PARAMETERS:
+ *      fd:file point
+ *      ring:receive ring of port
+ * Return:
+ *      received bytes, 0 on timeout, -1 on error
+ */
+static int recv_uart_stream(int fd, struct uart_ring *ring)
+{
+    struct iovec iov[2];
+    uint32_t space;
+    uint32_t off;
+    int n;
+
+    space = RX_RING_SIZE - (ring->wr - ring->rd);
+    off = ring->wr & RX_RING_MASK;
+
+    if (ring->esc_on) {
+        return recv_uart_escaped(fd, ring, space);
+    }
+
+    iov[0].iov_base = ring->data + off;
+    iov[0].iov_len = RX_RING_SIZE - off;
+    if (iov[0].iov_len > space) {
+        iov[0].iov_len = space;
+    }
+    iov[1].iov_base = ring->data;
+    iov[1].iov_len = space - iov[0].iov_len;
+
+    n = readv(fd, iov, (iov[1].iov_len > 0) ? 2 : 1);
+    COUNT_IO_CALL();
+    if (n > 0) {
+        ring->wr += n;
+    }
+
+    return n;
+}
+
+/*
+ * Name:
+ *      capture_uart_stream
+ * Description:
+ *      capture the bytes just read into receive ring, if -sim-capture is on
+ * PARAMETERS:
+ *      port_id: array id number
+ *      ring: receive ring of port
+ *      n: bytes read
+ * Return:
+ *      NULL
+ */
+static void capture_uart_stream(int port_id, struct uart_ring *ring, int n)
+{
+    uint32_t off = (ring->wr - n) & RX_RING_MASK;
+    int len = RX_RING_SIZE - off;
+
+    if (g_sim_capture <= 0) {
+        return;
+    }
+
+    if (len > n) {
+        len = n;
+    }
+    sim_capture_data(port_id, ring->data + off, len);
+    if (n > len) {
+        sim_capture_data(port_id, ring->data, n - len);
+    }
+}
+
+/*
+ * Name:
+ *      match_uart_head
+ * Description:
+ *      check if the data at read index of ring is a packet head or stop sign
+ * PARAMETERS:
+ *      ring:receive ring of port, 5 bytes available at least
+ * Return:
+ *      1: matched
+ *      0: not matched
+ */
+static int match_uart_head(struct uart_ring *ring)
+{
+    uint8_t c;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        c = ring->data[(ring->rd + i) & RX_RING_MASK];
+        if (c != head[i] && c != stop_sign[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Name:
+ *      parse_uart_stream
+ * Description:
+ *      pull all complete packets out of receive ring and check them, the
+ *      bytes before a packet head are skipped and counted
+ * PARAMETERS:
+ *      ring:receive ring of port
+ *      attr:attribute of port
+ * Return:
+ *      0: OK
+ *      -1: received stop signal
+ */
+static int parse_uart_stream(struct uart_ring *ring, struct uart_attr *attr)
+{
+    int port_id = attr->port_id;
+    struct uart_rx_stats *rx = &_uart_stats[port_id].rx;
+    struct uart_tx_stats *tx = &_uart_stats[port_id].tx;
+    uint8_t frame[BUFF_SIZE];
+    uint8_t *buff;
+    uint32_t off;
+    uint32_t len;
+    int log_fd = test_mod_sim.log_fd;
+
+    while (ring->wr - ring->rd >= 5) {
+        /*matching head*/
+        if (!match_uart_head(ring)) {
+            ring->rd++;
+            ring->skipped++;
+            continue;
+        }
+
+        if (ring->skipped > 0) {
+            STAT_UPDATE(rx, STAT_ADD(rx->skip_count, ring->skipped));
+            if (sim_is_running()) {
+                log_print(log_fd, "%s skipped %u bytes to resync\n",
+                        port_list[port_id], ring->skipped);
+            }
+            ring->skipped = 0;
+        }
+
+        if (ring->data[(ring->rd + 4) & RX_RING_MASK] == stop_sign[4]) {
+            ring->rd += 5;
+            log_print(log_fd,"%s received stop signal, sim test will be stop\n",
+                    port_list[port_id]);
+            return -1;/* means will be stop test*/
+        }
+
+        if (ring->wr - ring->rd < frame_len) {
+            break;
+        }
+
+        /* Copy the packet out only if it wraps around the end of ring */
+        off = ring->rd & RX_RING_MASK;
+        if (off + frame_len <= RX_RING_SIZE) {
+            buff = ring->data + off;
+        } else {
+            len = RX_RING_SIZE - off;
+            memcpy(frame, ring->data + off, len);
+            memcpy(frame + len, ring->data, frame_len - len);
+            buff = frame;
+        }
+        ring->rd += frame_len;
+
+        /* Packet Reception count +1*/
+        STAT_UPDATE(rx, STAT_ADD(rx->recv_count, 1));
+        process_uart_packet(buff, port_id);
+
+        /* Machine B sends every packet back for round trip latency */
+        if (g_sim_latency == SIM_LATENCY_ECHO && g_machine == 'B') {
+            uint8_t *echo = buff;
+            uint8_t echo_esc[BUFF_SIZE * 2];
+            int echo_len = frame_len;
+
+            if (g_sim_flow == SIM_FLOW_XONXOFF) {
+                echo_len = escape_xonxoff(buff, frame_len, echo_esc);
+                echo = echo_esc;
+            }
+            if (write_uart_all(attr->uart_fd, echo, echo_len) == echo_len) {
+                STAT_UPDATE(tx, STAT_ADD(tx->send_count, 1);
+                        STAT_ADD(tx->tx_bytes, echo_len));
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Name:
+ *      count_rx_timeout
+ * Description:
+ *      count a receive timeout (no data in get_rx_timeout_ms()) of port
+ * PARAMETERS:
+ *      port_id:array id number
+ * Return:
+ *      NULL
+ */
+static void count_rx_timeout(int port_id)
+{
+    struct uart_rx_stats *rx = &_uart_stats[port_id].rx;
+
+    STAT_UPDATE(rx, STAT_ADD(rx->timeout_count, 1));
+    DBG_PRINT("%s received timeout\n", port_list[port_id]);
+
+    if (rx->timeout_count > MAX_RETRY_COUNT && sim_is_running()) {
+        if (rx->timeout_count == MAX_RETRY_COUNT + 1) {
+            log_print(test_mod_sim.log_fd,
+                    "COM-%d timeout, please check the port connection\n",
+                    port_id+1);
+            sim_capture_event(port_id, SIMCAP_REC_TIMEOUT);
+        }
+        test_mod_sim.pass = 0;
+    }
+}
+
+/*
+ * Name:
+ *      analysis_packet
+ * Description:
+ *      check packet
+ * PARAMETERS:
+ *      recv_packet: packet
+ *      buff:data
+ *      port_id:array id number
+ * Return:
+ *      0: packet ok
+ *      -1: packet error
+ *      1: packet from a port not wired to this port
+ *
+ */
+static int analysis_packet(uint8_t *buff, int port_id)
+{
+    struct uart_rx_stats *rx = &_uart_stats[port_id].rx;
+    uint32_t crc_check;
+    uint64_t bit_err;
+    uint32_t lost;
+    int seq_class;
+    int i;
+    int log_fd;
+
+    struct uart_package *recv_packet;
+    struct uart_trailer *recv_trailer;
+    recv_packet = (struct uart_package *)buff;
+    recv_trailer = (struct uart_trailer *)(buff + TAIL_OFFSET);
+
+    log_fd = test_mod_sim.log_fd;
+
+    /*
+     * check crc and printf which data is error
+     */
+    crc_check = calc_packet_crc(buff, port_id);
+    bit_err = count_bit_errors(buff, port_id,
+            crc_check == recv_trailer->crc_err);
+    if ((uint32_t)crc_check != (uint32_t)recv_trailer->crc_err) {
+        if (sim_is_running()) {
+            /*means received error packet*/
+            log_print(log_fd, "%s Received \"%d\"packet error\n",
+                    port_list[port_id], rx->recv_count);
+            /*dump received data, unless it is in the capture file*/
+            if (g_sim_capture > 0) {
+                sim_capture_event(port_id, SIMCAP_REC_CRC_ERROR);
+            } else {
+                write_file(log_fd, "    ");
+                for (i = 0; i < NUM_OFFSET; i++) {/*print received pack_head & port_id &pack_data*/
+                    write_file(log_fd, " %02X", *((uint8_t *)buff + i));
+                    if (((i+1) % 16) == 0) {
+                        write_file(log_fd, "\n");
+                        write_file(log_fd, "    ");
+                    }
+                }
+                write_file(log_fd, "\n");
+            }
+            write_file(log_fd, "    Received pack_num = %u\n", (uint32_t)recv_trailer->pack_num);
+            write_file(log_fd, "    Received crc = %08X\n", (uint32_t)recv_trailer->crc_err);
+            write_file(log_fd, "    Calculated crc = %08X\n", (uint32_t)crc_check);
+            write_file(log_fd, "    Bit errors = %llu\n",
+                    (unsigned long long)bit_err);
+
+            STAT_UPDATE(rx, STAT_ADD(rx->err_count, 1));
+            test_mod_sim.pass = 0;
+        }
+
+        return -1;
+    } else {
+        //Check UART ID, only SIM test fails on wrong wiring
+        int sender_id = recv_packet->port_id;
+        if (_uart_peer[port_id].sender != sender_id) {
+            STAT_UPDATE(rx, STAT_ADD(rx->err_count, 1));
+            test_mod_sim.pass = 0;
+            if (!_uart_peer[port_id].mismatch) {
+                _uart_peer[port_id].mismatch = 1;
+                log_print(log_fd,
+                        "Mismatched port: sender COM-%d, receiver COM-%d\n",
+                        sender_id+1, port_id+1);
+            }
+            return 1;
+        }
+
+        seq_class = track_sequence(port_id, recv_trailer->pack_num);
+        lost = _uart_seq[port_id].lost;
+
+        STAT_UPDATE(rx,
+                STAT_SET(rx->target_send_num, _uart_seq[port_id].highest);
+                STAT_SET(rx->lost_count, lost));
+
+        switch (seq_class) {
+        case SEQ_GAP_FILL:
+            STAT_UPDATE(rx, STAT_ADD(rx->reorder_count, 1));
+            log_print(log_fd, "%s received packet %u out of order\n",
+                    port_list[port_id], recv_trailer->pack_num);
+            break;
+        case SEQ_DUPLICATE:
+            STAT_UPDATE(rx, STAT_ADD(rx->dup_count, 1));
+            log_print(log_fd, "%s received packet %u again\n",
+                    port_list[port_id], recv_trailer->pack_num);
+            break;
+        case SEQ_LATE:
+            STAT_UPDATE(rx, STAT_ADD(rx->late_count, 1));
+            log_print(log_fd, "%s received packet %u too late\n",
+                    port_list[port_id], recv_trailer->pack_num);
+            break;
+        default:
+            if (lost != _uart_seq[port_id].lost_logged) {
+                log_print(log_fd, "%s lost %u package\n",
+                        port_list[port_id], lost);
+            }
+            break;
+        }
+        _uart_seq[port_id].lost_logged = lost;
+
+        if (seq_class != SEQ_IN_ORDER || lost > 0) {
+            test_mod_sim.pass = 0;
+        }
+    }
+
+    record_latency(buff, port_id);
+
+    return 0;
+}
+
+/*
+ * Name:
+ *      record_latency
+ * Description:
+ *      record latency and jitter of a good packet from its TX timestamp. The
+ *      latency is one way on loopback, and round trip on machine A in echo
+ *      mode.
+ * PARAMETERS:
+ *      buff: packet data
+ *      port_id: array id number
+ * Return:
+ *      NULL
+ */
+static void record_latency(uint8_t *buff, int port_id)
+{
+    struct uart_latency *lat;
+    uint64_t ts;
+    uint64_t now;
+    uint64_t ns;
+
+    if (_uart_latency == NULL) {
+        return;
+    }
+    if (g_sim_latency == SIM_LATENCY_ECHO && g_machine != 'A') {
+        return;
+    }
+
+    now = get_time_ns();
+    memcpy(&ts, buff + TS_OFFSET, sizeof(ts));
+    if (ts > now) {
+        return;
+    }
+    ns = now - ts;
+
+    lat = &_uart_latency[port_id];
+    hist_add(&lat->latency, ns);
+    if (lat->has_last) {
+        hist_add(&lat->jitter,
+                (ns > lat->last_ns) ? ns - lat->last_ns : lat->last_ns - ns);
+    }
+    lat->last_ns = ns;
+    lat->has_last = 1;
+}
+
+
+/*
+ * Name:
+ *      process_uart_packet
+ * Description:
+ *      check a received packet and update the log
+ * PARAMETERS:
+ *      buff: packet data
+ *      port_id: array id number
+ * Return:
+ *      NULL
+ */
+static void process_uart_packet(uint8_t *buff, int port_id)
+{
+    int log_fd = test_mod_sim.log_fd;
+    int ret;
+
+    ret = analysis_packet(buff, port_id);
+    if (ret < 0) {
+        if (sim_is_running()) {
+            test_mod_sim.pass = 0;
+            log_print(log_fd, "Analyze packet fail\n");
+        }
+    } else if (ret == 0) {
+        if (_uart_stats[port_id].rx.recv_count % 1000 == 0) {
+            log_print(log_fd,"%s received %d packet successfully\n",
+                port_list[port_id],
+                (uint32_t)_uart_stats[port_id].rx.recv_count);
+        }
+    }
+}
+
+/*
+ * Name:
+ *      send_stop_sign
+ * Description:
+ *      send stop mark to other machine
+ * PARAMETERS:
+ *      fd: file point
+ * Return:
+ *      NULL
+ */
+static void send_stop_sign(int fd)
+{
+    /* The data held by flow control may never be sent */
+    if (g_sim_flow != SIM_FLOW_NONE) {
+        tcflush(fd, TCOFLUSH);
+    }
+
+    write_uart_all(fd, stop_sign, sizeof(stop_sign));
+}
+
+/*
+ * Name:
+ *      write_uart_all
+ * Description:
+ *      write the whole buffer to port, wait if the TX queue is full
+ * PARAMETERS:
+ *      fd: file point
+ *      buff: data
+ *      len: data length
+ * Return:
+ *      send bytes
+ */
+static int write_uart_all(int fd, const uint8_t *buff, int len)
+{
+    int i;
+    int n;
+
+    for (i=0; i<len; ) {
+        n = write(fd, buff + i, len - i);
+        COUNT_IO_CALL();
+        if (n == -1) {
+            if (errno == EAGAIN) {
+                sleep_ms(SEG_INTERVAL_MS);
+            } else {
+                sleep(1);
+            }
+            continue;
+        } else {
+            i += n;
+        }
+    }
+
+    return i;
+}
+
+/*
+ * Name:
+ *      reset_rx_timeout
+ * Description:
+ *      clear receive timeout count of port on data received
+ * PARAMETERS:
+ *      port_id: array id number
+ * Return:
+ *      NULL
+ */
+static void reset_rx_timeout(int port_id)
+{
+    struct uart_rx_stats *rx = &_uart_stats[port_id].rx;
+
+    if (rx->timeout_count != 0) {
+        STAT_UPDATE(rx, STAT_SET(rx->timeout_count, 0));
+    }
+}
+
+/*
+ * Name:
+ *      log_port_count
+ * Description:
+ *      log counters of port at the end of test
+ * PARAMETERS:
+ *      port_id: array id number
+ * Return:
+ *      NULL
+ */
+static void log_port_count(int port_id)
+{
+    struct uart_count_list count;
+
+    sim_get_count(port_id, &count);
+    log_print(test_mod_sim.log_fd,
+            "COM-%d: send: %u, recv: %u, error: %u, skip: %u\n",
+            port_id+1,
+            count.send_count,
+            count.recv_count,
+            count.err_count,
+            count.skip_count);
+
+    if (count.hw_valid) {
+        log_print(test_mod_sim.log_fd,
+                "COM-%d: hw rx: %u, tx: %u, overrun: %u, buf_overrun: %u, "
+                "frame: %u, parity: %u, brk: %u\n",
+                port_id+1,
+                count.hw_rx,
+                count.hw_tx,
+                count.hw_overrun,
+                count.hw_buf_overrun,
+                count.hw_frame,
+                count.hw_parity,
+                count.hw_brk);
+    }
+}
+
+/*
+ * Name:
+ *      port_recv_event
+ * Description:
+ *      The thread routine to read data from serial port and verify them
+ * PARAMETERS:
+ *      uart_param: Argument of thread routine
+ * Return:
+ *      Exit code of thread
+ *
+ */
+static void *port_recv_event(void *args)
+{
+    struct uart_attr *uart_param;
+    struct uart_ring *ring;
+    int fd;
+    int log_fd;
+
+    int port_id;
+
+    int n;
+
+    uart_param = (struct uart_attr *)args;
+
+    fd = uart_param->uart_fd;
+    if (fd < 0) {
+        pthread_exit((void *)-1);
+    }
+
+    port_id = uart_param->port_id;
+
+    log_fd = test_mod_sim.log_fd;
+
+    ring = calloc(1, sizeof(struct uart_ring));
+    if (ring == NULL) {
+        log_print(log_fd, "Out of memory\n");
+        test_mod_sim.pass = 0;
+        pthread_exit((void *)-1);
+    }
+    ring->esc_on = (g_sim_flow == SIM_FLOW_XONXOFF);
+
+    while (sim_is_running()) {
+        n = recv_uart_stream(fd, ring);
+        if (n < 0) {
+            log_print(log_fd,"%s read error\n", port_list[port_id]);
+            test_mod_sim.pass = 0;
+            sleep(1);
+            continue;
+        } else if (n == 0) {
+            count_rx_timeout(port_id);
+            continue;
+        }
+
+        reset_rx_timeout(port_id);
+        capture_uart_stream(port_id, ring, n);
+
+        if (parse_uart_stream(ring, uart_param) < 0) {
+            /*received stop signal*/
+            sim_stop();
+            break;
+        }
+    } /*end while(sim_is_running())*/
+
+    free(ring);
+
+    STAT_UPDATE(&_uart_stats[port_id].rx,
+            STAT_SET(_uart_stats[port_id].rx.rx_cpu_ns, get_thread_cpu_ns()));
+    flush_io_calls();
+
+    log_port_count(port_id);
+
+    pthread_exit((void *)0);
+}
+
+/*
+ * Name:
+ *      port_send_event
+ * Description:
+ *      The thread routine to write data to serial port
+ * PARAMETERS:
+ *      uart_param: Argument of thread routine
+ * Return:
+ *      Exit code of thread
+ *
+ */
+static void *port_send_event(void *args)
+{
+    struct uart_attr *uart_param;
+
+    int fd;
+    int log_fd;
+
+    int port_id;
+    int target;
+
+    struct uart_tx_stats *tx;
+
+    int n;
+
+    struct uart_frame uart_frame;
+    uint8_t tx_esc[BUFF_SIZE * 2];
+    uint8_t *tx_buf;
+    int tx_len;
+
+    uart_param = (struct uart_attr *)args;
+
+    log_fd = test_mod_sim.log_fd;
+
+    fd = uart_param->uart_fd;
+
+    if (fd < 0) {
+        pthread_exit((void *)-1);
+    }
+
+    port_id = uart_param->port_id;
+    tx = &_uart_stats[port_id].tx;
+
+    sleep_ms(SEND_DELAY_MS);/* waiting received thread ready */
+
+    init_uart_frame(&uart_frame, port_id);
+    target = get_outq_target(uart_param->baudrate);
+
+    /* In echo mode, machine B only sends back what it receives */
+    while (sim_is_running() && g_sim_latency == SIM_LATENCY_ECHO
+            && g_machine == 'B') {
+        sleep_ms(100);
+    }
+
+    while (sim_is_running()) {
+        STAT_UPDATE(tx, STAT_ADD(tx->send_count, 1));
+        update_uart_frame(&uart_frame, tx->send_count);
+
+        tx_buf = uart_frame.wire;
+        tx_len = frame_len;
+        if (g_sim_flow == SIM_FLOW_XONXOFF) {
+            tx_len = escape_xonxoff(uart_frame.wire, frame_len, tx_esc);
+            tx_buf = tx_esc;
+        }
+
+        if (g_sim_pacing == SIM_PACING_OUTQ) {
+            n = send_uart_packet_outq(fd, tx_buf, tx_len, target,
+                    uart_param->baudrate);
+        } else if (g_sim_pacing == SIM_PACING_NONE) {
+            n = send_uart_packet_flow(fd, tx_buf, tx_len);
+        } else {
+            n = send_uart_packet(fd, tx_buf, tx_len);
+        }
+        if (n > 0) {
+            STAT_UPDATE(tx, STAT_ADD(tx->tx_bytes, n));
+        }
+        if (n != tx_len && sim_is_running()) {
+            log_print(log_fd, "%s send data error\n", port_list[port_id]);
+            test_mod_sim.pass = 0;
+        } else {
+            if (tx->send_count % 1000 == 0) {
+                log_print(log_fd,"%s send %d packet ok\n", port_list[port_id],
+                    (uint32_t)tx->send_count);
+            }
+        }
+    }
+    flush_io_calls();
+
+    /*if test is stopped, send stop mark to other machine*/
+    if(!sim_is_running()) {
+        send_stop_sign(fd);
+    }
+
+    pthread_exit((void *)0);
+}
+
+/*
+ * Name:
+ *      init_hw_count
+ * Description:
+ *      save the hardware counters of UART at test start, as the base of
+ *      later samples
+ * PARAMETERS:
+ *      fd: file point
+ *      port_id: array id number
+ * Return:
+ *      NULL
+ */
+static void init_hw_count(int fd, int port_id)
+{
+    struct uart_hw_stats *hw = &_uart_stats[port_id].hw;
+
+    /* Not all drivers (e.g. pty, USB serial) support TIOCGICOUNT */
+    if (ioctl(fd, TIOCGICOUNT, &hw->base) < 0) {
+        DBG_PRINT("%s TIOCGICOUNT is not supported\n", port_list[port_id]);
+        return;
+    }
+
+    STAT_UPDATE(hw, STAT_SET(hw->valid, 1));
+}
+
+/*
+ * Name:
+ *      sample_hw_count
+ * Description:
+ *      read the hardware counters of UART, save the deltas since test start
+ *      and log the new line errors
+ * PARAMETERS:
+ *      fd: file point
+ *      port_id: array id number
+ * Return:
+ *      NULL
+ */
+static void sample_hw_count(int fd, int port_id)
+{
+    struct uart_hw_stats *hw = &_uart_stats[port_id].hw;
+    struct serial_icounter_struct ic;
+    uint32_t overrun;
+    uint32_t buf_overrun;
+    uint32_t frame;
+    uint32_t parity;
+    uint32_t brk;
+
+    if (!hw->valid || ioctl(fd, TIOCGICOUNT, &ic) < 0) {
+        return;
+    }
+
+    overrun = ic.overrun - hw->base.overrun;
+    buf_overrun = ic.buf_overrun - hw->base.buf_overrun;
+    frame = ic.frame - hw->base.frame;
+    parity = ic.parity - hw->base.parity;
+    brk = ic.brk - hw->base.brk;
+
+    if (g_running && (overrun != hw->overrun
+                || buf_overrun != hw->buf_overrun
+                || frame != hw->frame
+                || parity != hw->parity
+                || brk != hw->brk)) {
+        log_print(test_mod_sim.log_fd,
+                "%s line error: overrun %u, buf_overrun %u, frame %u, "
+                "parity %u, brk %u\n",
+                port_list[port_id], overrun - hw->overrun,
+                buf_overrun - hw->buf_overrun, frame - hw->frame,
+                parity - hw->parity, brk - hw->brk);
+    }
+
+    STAT_UPDATE(hw,
+            STAT_SET(hw->rx, ic.rx - hw->base.rx);
+            STAT_SET(hw->tx, ic.tx - hw->base.tx);
+            STAT_SET(hw->frame, frame);
+            STAT_SET(hw->parity, parity);
+            STAT_SET(hw->brk, brk);
+            STAT_SET(hw->overrun, overrun);
+            STAT_SET(hw->buf_overrun, buf_overrun);
+            STAT_SET(hw->cts, ic.cts - hw->base.cts));
+}
+
+/*
+ * Name:
+ *      port_icount_event
+ * Description:
+ *      The thread routine to sample the hardware counters of all ports
+ *      every ICOUNT_INTERVAL_MS
+ * PARAMETERS:
+ *      uart_param: Argument of thread routine, attribute of all ports
+ * Return:
+ *      Exit code of thread
+ */
+static void *port_icount_event(void *args)
+{
+    struct uart_attr *uart_param = (struct uart_attr *)args;
+    int i;
+
+    while (g_running) {
+        sleep_ms(ICOUNT_INTERVAL_MS);
+
+        for (i = 0; i < sim_port_num; i++) {
+            if (uart_param[i].uart_fd >= 0) {
+                sample_hw_count(uart_param[i].uart_fd, i);
+            }
+        }
+    }
+
+    /* The last sample covers the end of test */
+    for (i = 0; i < sim_port_num; i++) {
+        if (uart_param[i].uart_fd >= 0) {
+            sample_hw_count(uart_param[i].uart_fd, i);
+        }
+    }
+
+    pthread_exit((void *)0);
+}
+
+/*
+ * Name:
+ *      get_time_ms
+ * Description:
+ *      get time of monotonic clock in milliseconds
+ * PARAMETERS:
+ *      NULL
+ * Return:
+ *      time in milliseconds
+ */
+static uint64_t get_time_ms(void)
+{
+    return get_time_ns() / 1000000;
+}
+
+/*
+ * Name:
+ *      get_rx_timeout_ms
+ * Description:
+ *      get the time without data of a receive timeout, the VTIME of
+ *      -sim-vtime, or RX_TIMEOUT_MS if it is not given or 0
+ * PARAMETERS:
+ *      NULL
+ * Return:
+ *      timeout in milliseconds
+ */
+static int get_rx_timeout_ms(void)
+{
+    return (g_sim_vtime > 0) ? g_sim_vtime * 100 : RX_TIMEOUT_MS;
+}
+
+/*
+ * Name:
+ *      get_process_cpu_ns
+ * Description:
+ *      get CPU time of the process, which includes the kernel workers of
+ *      io_uring
+ * PARAMETERS:
+ *      NULL
+ * Return:
+ *      CPU time in nanoseconds
+ */
+static uint64_t get_process_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Name:
+ *      flush_io_calls
+ * Description:
+ *      add the I/O system calls counted by current thread to io_calls
+ * PARAMETERS:
+ *      NULL
+ * Return:
+ *      NULL
+ */
+static void flush_io_calls(void)
+{
+    __atomic_add_fetch(&io_calls, thread_io_calls, __ATOMIC_RELAXED);
+    thread_io_calls = 0;
+}
+
+/*
+ * Name:
+ *      sim_is_running
+ * Description:
+ *      check if current run is going on, a step of baud sweep ends at
+ *      sim_stop_ms
+ * PARAMETERS:
+ *      NULL
+ * Return:
+ *      1: running
+ *      0: stopped
+ */
+static int sim_is_running(void)
+{
+    if (sim_stop_ms != 0 && sim_running && get_time_ms() >= sim_stop_ms) {
+        sim_running = 0;
+    }
+
+    return g_running && sim_running;
+}
+
+/*
+ * Name:
+ *      sim_stop
+ * Description:
+ *      stop current run on stop signal from other machine. It stops the
+ *      whole test, except in baud sweep where it only ends the step.
+ * PARAMETERS:
+ *      NULL
+ * Return:
+ *      NULL
+ */
+static void sim_stop(void)
+{
+    sim_running = 0;
+
+    if (sim_stop_ms == 0) {
+        g_running = 0;
+    }
+}
+
+/*
+ * Name:
+ *      get_tx_room
+ * Description:
+ *      get the bytes the engine may write to port on this tick: a segment,
+ *      the room below the target fill level of TX queue with TIOCOUTQ
+ *      pacing, or no limit without pacing (the TX queue is filled up and
+ *      flow control holds it)
+ * PARAMETERS:
+ *      io: port state
+ * Return:
+ *      bytes to write, 0 or less for none
+ */
+static int get_tx_room(struct uart_io *io)
+{
+    int queued;
+
+    if (g_sim_pacing == SIM_PACING_OUTQ) {
+        if (ioctl(io->attr->uart_fd, TIOCOUTQ, &queued) < 0) {
+            queued = 0;
+        }
+        COUNT_IO_CALL();
+        return io->outq_target - queued;
+    } else if (g_sim_pacing == SIM_PACING_NONE) {
+        return INT_MAX;
+    }
+
+    return SEG_LEN;
+}
+
+/*
+ * Name:
+ *      load_tx_packet
+ * Description:
+ *      create the next packet of port to send, escaped for XON/XOFF flow
+ *      control if it is on
+ * PARAMETERS:
+ *      io: port state
+ * Return:
+ *      NULL
+ */
+static void load_tx_packet(struct uart_io *io)
+{
+    struct uart_tx_stats *tx = &_uart_stats[io->attr->port_id].tx;
+
+    STAT_UPDATE(tx, STAT_ADD(tx->send_count, 1));
+    update_uart_frame(&io->tx, tx->send_count);
+    io->tx_buf = io->tx.wire;
+    io->tx_len = frame_len;
+    if (g_sim_flow == SIM_FLOW_XONXOFF) {
+        io->tx_buf = io->tx_esc;
+        io->tx_len = escape_xonxoff(io->tx.wire, frame_len, io->tx_esc);
+    }
+    io->tx_off = 0;
+}
+
+/*
+ * Name:
+ *      advance_tx_packet
+ * Description:
+ *      account the bytes of current packet written to port
+ * PARAMETERS:
+ *      io: port state
+ *      n: bytes written
+ * Return:
+ *      NULL
+ */
+static void advance_tx_packet(struct uart_io *io, int n)
+{
+    int port_id = io->attr->port_id;
+    struct uart_tx_stats *tx = &_uart_stats[port_id].tx;
+
+    io->tx_off += n;
+    STAT_UPDATE(tx, STAT_ADD(tx->tx_bytes, n));
+
+    if (io->tx_off == io->tx_len && tx->send_count % 1000 == 0) {
+        log_print(test_mod_sim.log_fd, "%s send %d packet ok\n",
+                port_list[port_id], (uint32_t)tx->send_count);
+    }
+}
+
+/*
+ * Name:
+ *      reactor_tx
+ * Description:
+ *      write next segment of current packet, create a new packet when the
+ *      current one has been sent completely. With TIOCOUTQ pacing, write
+ *      until the TX queue of UART reaches the target fill level.
+ * PARAMETERS:
+ *      io: port state
+ * Return:
+ *      NULL
+ */
+static void reactor_tx(struct uart_io *io)
+{
+    int room;
+    int seg_len;
+    int n;
+
+    room = get_tx_room(io);
+
+    while (room > 0) {
+        if (io->tx_off >= io->tx_len) {
+            load_tx_packet(io);
+        }
+
+        seg_len = io->tx_len - io->tx_off;
+        if (seg_len > room) {
+            seg_len = room;
+        }
+
+        n = write(io->attr->uart_fd, io->tx_buf + io->tx_off, seg_len);
+        COUNT_IO_CALL();
+        if (n < 0) {
+            /* The TX queue is full, try again on next tick */
+            if (errno != EAGAIN) {
+                DBG_PRINT("%s write error\n", port_list[io->attr->port_id]);
+            }
+            return;
+        }
+
+        room -= n;
+        advance_tx_packet(io, n);
+
+        if (io->tx_off == io->tx_len) {
+            /* A segment never crosses the end of packet */
+            if (g_sim_pacing == SIM_PACING_SEGMENT) {
+                break;
+            }
+        }
+
+        if (n < seg_len) {
+            break;
+        }
+    }
+}
+
+/*
+ * Name:
+ *      reactor_rx
+ * Description:
+ *      read all available data of port and check the received packets
+ * PARAMETERS:
+ *      io: port state
+ *      now_ms: current time in milliseconds
+ * Return:
+ *      0: OK
+ *      -1: received stop signal
+ */
+static int reactor_rx(struct uart_io *io, uint64_t now_ms)
+{
+    int port_id = io->attr->port_id;
+    struct uart_rx_stats *rx = &_uart_stats[port_id].rx;
+    uint64_t cpu_ns = get_thread_cpu_ns();
+    int ret = 0;
+    int n;
+
+    while (1) {
+        n = recv_uart_stream(io->attr->uart_fd, &io->rx);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                log_print(test_mod_sim.log_fd, "%s read error\n",
+                        port_list[port_id]);
+                test_mod_sim.pass = 0;
+            }
+            break;
+        } else if (n == 0) {
+            break;
+        }
+
+        io->last_rx_ms = now_ms;
+        reset_rx_timeout(port_id);
+        capture_uart_stream(port_id, &io->rx, n);
+
+        if (parse_uart_stream(&io->rx, io->attr) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    STAT_UPDATE(rx, STAT_ADD(rx->rx_cpu_ns, get_thread_cpu_ns() - cpu_ns));
+
+    return ret;
+}
+
+/*
+ * Name:
+ *      reactor_check_timeout
+ * Description:
+ *      count receive timeout of port, works like VTIME of blocking read
+ * PARAMETERS:
+ *      io: port state
+ *      now_ms: current time in milliseconds
+ * Return:
+ *      NULL
+ */
+static void reactor_check_timeout(struct uart_io *io, uint64_t now_ms)
+{
+    if (now_ms - io->last_rx_ms < get_rx_timeout_ms()) {
+        return;
+    }
+
+    io->last_rx_ms = now_ms;
+    count_rx_timeout(io->attr->port_id);
+}
+
+/*
+ * Name:
+ *      sim_reactor_run
+ * Description:
+ *      Drive TX and RX of all ports from one thread with epoll. The TX
+ *      pacing is the same as port_send_event(), driven by a timerfd.
+ * PARAMETERS:
+ *      uart_param: attribute of ports
+ *      port_num: number of ports
+ * Return:
+ *      NULL
+ */
+static void sim_reactor_run(struct uart_attr *uart_param, int port_num)
+{
+    struct epoll_event ev;
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    struct itimerspec its;
+    struct uart_io *io;
+    uint64_t start_ms;
+    uint64_t now_ms;
+    uint64_t expired;
+    int log_fd = test_mod_sim.log_fd;
+    int epfd;
+    int tfd;
+    int tick;
+    int echo;
+    int n;
+    int i;
+
+    /* In echo mode, machine B only sends back what it receives */
+    echo = (g_sim_latency == SIM_LATENCY_ECHO && g_machine == 'B');
+
+    io = calloc(port_num, sizeof(struct uart_io));
+    if (io == NULL) {
+        log_print(log_fd, "Out of memory\n");
+        test_mod_sim.pass = 0;
+        return;
+    }
+
+    epfd = epoll_create1(0);
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (epfd < 0 || tfd < 0) {
+        log_print(log_fd, "Create epoll/timerfd error\n");
+        test_mod_sim.pass = 0;
+        goto exit;
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = SEG_INTERVAL_MS * 1000000;
+    its.it_interval.tv_nsec = SEG_INTERVAL_MS * 1000000;
+    timerfd_settime(tfd, 0, &its, NULL);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+    start_ms = get_time_ms();
+
+    for (i = 0; i < port_num; i++) {
+        io[i].attr = &uart_param[i];
+        io[i].last_rx_ms = start_ms;
+        io[i].rx.esc_on = (g_sim_flow == SIM_FLOW_XONXOFF);
+        init_uart_frame(&io[i].tx, i);
+        io[i].outq_target = get_outq_target(uart_param[i].baudrate);
+
+        if (uart_param[i].uart_fd < 0) {
+            continue;
+        }
+
+        fcntl(uart_param[i].uart_fd, F_SETFL,
+                fcntl(uart_param[i].uart_fd, F_GETFL) | O_NONBLOCK);
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = &io[i];
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, uart_param[i].uart_fd, &ev) < 0) {
+            log_print(log_fd, "%s add to epoll error\n", port_list[i]);
+            test_mod_sim.pass = 0;
+        }
+    }
+
+    while (sim_is_running()) {
+        n = epoll_wait(epfd, events, EPOLL_MAX_EVENTS, get_rx_timeout_ms());
+        COUNT_IO_CALL();
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_print(log_fd, "epoll_wait error\n");
+            test_mod_sim.pass = 0;
+            break;
+        }
+
+        now_ms = get_time_ms();
+        tick = 0;
+
+        for (i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                read(tfd, &expired, sizeof(expired));
+                COUNT_IO_CALL();
+                tick = 1;
+                continue;
+            }
+
+            if (reactor_rx(events[i].data.ptr, now_ms) < 0) {
+                /*received stop signal*/
+                sim_stop();
+            }
+        }
+
+        if (!tick) {
+            continue;
+        }
+
+        /* One TX segment per port on every tick of timer */
+        for (i = 0; i < port_num; i++) {
+            if (io[i].attr->uart_fd < 0) {
+                continue;
+            }
+
+            if (now_ms - start_ms >= SEND_DELAY_MS && !echo) {
+                reactor_tx(&io[i]);
+            }
+            reactor_check_timeout(&io[i], now_ms);
+        }
+    }
+
+    /*test is stopped, send stop mark to other machine*/
+    for (i = 0; i < port_num; i++) {
+        if (uart_param[i].uart_fd < 0) {
+            continue;
+        }
+
+        send_stop_sign(uart_param[i].uart_fd);
+
+        log_port_count(i);
+    }
+
+exit:
+    if (tfd >= 0) {
+        close(tfd);
+    }
+    if (epfd >= 0) {
+        close(epfd);
+    }
+    free(io);
+}
+
+/*
+ * Name:
+ *      uring_prep_rw
+ * Description:
+ *      fill an SQE to read or write a port, with the registered file and
+ *      buffer if they are available
+ * PARAMETERS:
+ *      u: io_uring engine
+ *      sqe: SQE to fill
+ *      op: IORING_OP_READ or IORING_OP_WRITE
+ *      port_id: array id number
+ *      buf: data in registered buffer
+ *      len: data length
+ * Return:
+ *      NULL
+ */
+static void uring_prep_rw(struct sim_uring *u, struct io_uring_sqe *sqe,
+        int op, int port_id, void *buf, int len)
+{
+    sqe->opcode = op;
+    sqe->fd = u->port[port_id].io.attr->uart_fd;
+    if (u->fixed_files) {
+        sqe->fd = port_id;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    }
+    if (u->fixed_bufs) {
+        sqe->opcode = (op == IORING_OP_READ) ?
+            IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = 0;
+    }
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    /* A tty has no position, read and write at the current one */
+    sqe->off = (uint64_t)-1;
+}
+
+/*
+ * Name:
+ *      uring_submit_rx
+ * Description:
+ *      queue a read of port, linked with a timeout of get_rx_timeout_ms() which
+ *      cancels the read if no data comes. The data is read into the free
+ *      space of receive ring up to its end, or into a staging buffer to be
+ *      unescaped with XON/XOFF flow control.
+ * PARAMETERS:
+ *      u: io_uring engine
+ *      uio: port state
+ * Return:
+ *      NULL
+ */
+static void uring_submit_rx(struct sim_uring *u, struct uring_io *uio)
+{
+    struct uart_ring *ring = &uio->io.rx;
+    struct io_uring_sqe *sqe;
+    uint32_t space;
+    uint32_t off;
+    uint8_t *buf;
+    int port_id = uio->io.attr->port_id;
+
+    space = RX_RING_SIZE - (ring->wr - ring->rd);
+    off = ring->wr & RX_RING_MASK;
+    buf = ring->data + off;
+    if (space > RX_RING_SIZE - off) {
+        space = RX_RING_SIZE - off;
+    }
+    if (ring->esc_on) {
+        buf = uio->rx_tmp;
+    }
+
+    /* The read and its linked timeout shall be submitted together */
+    if (uring_sq_space(&u->ring) < 2) {
+        uring_enter(&u->ring, 0);
+    }
+
+    sqe = uring_get_sqe(&u->ring);
+    if (sqe == NULL) {
+        return;
+    }
+    uring_prep_rw(u, sqe, IORING_OP_READ, port_id, buf, space);
+    sqe->flags |= IOSQE_IO_LINK;
+    sqe->user_data = URING_DATA(port_id, URING_RX);
+
+    sqe = uring_get_sqe(&u->ring);
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&u->rx_timeout;
+    sqe->len = 1;
+    sqe->user_data = URING_DATA(port_id, URING_LINK_TIMEOUT);
+
+    uio->rx_busy = 1;
+}
+
+/*
+ * Name:
+ *      uring_submit_tx
+ * Description:
+ *      queue a write of the next segment of port, create a new packet when
+ *      the current one has been sent completely. Only one write of a port
+ *      is in flight.
+ * PARAMETERS:
+ *      u: io_uring engine
+ *      uio: port state
+ * Return:
+ *      NULL
+ */
+static void uring_submit_tx(struct sim_uring *u, struct uring_io *uio)
+{
+    struct uart_io *io = &uio->io;
+    struct io_uring_sqe *sqe;
+    int room;
+    int seg_len;
+
+    if (uio->tx_busy) {
+        return;
+    }
+
+    room = get_tx_room(io);
+    if (room <= 0) {
+        return;
+    }
+
+    if (io->tx_off >= io->tx_len) {
+        load_tx_packet(io);
+    }
+
+    seg_len = io->tx_len - io->tx_off;
+    if (seg_len > room) {
+        seg_len = room;
+    }
+
+    sqe = uring_get_sqe(&u->ring);
+    if (sqe == NULL) {
+        return;
+    }
+    uring_prep_rw(u, sqe, IORING_OP_WRITE, io->attr->port_id,
+            io->tx_buf + io->tx_off, seg_len);
+    sqe->user_data = URING_DATA(io->attr->port_id, URING_TX);
+
+    uio->tx_busy = 1;
+}
+
+/*
+ * Name:
+ *      uring_submit_tick
+ * Description:
+ *      queue the timeout of next TX tick, which also wakes up the engine to
+ *      check the end of run
+ * PARAMETERS:
+ *      u: io_uring engine
+ * Return:
+ *      NULL
+ */
+static void uring_submit_tick(struct sim_uring *u)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = uring_get_sqe(&u->ring);
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&u->tick;
+    sqe->len = 1;
+    sqe->user_data = URING_DATA(0, URING_TICK);
+}
+
+/*
+ * Name:
+ *      uring_complete_rx
+ * Description:
+ *      handle a completed read of port: check the received packets, or
+ *      count a receive timeout if the read is canceled by its linked
+ *      timeout. The next read is queued.
+ * PARAMETERS:
+ *      u: io_uring engine
+ *      uio: port state
+ *      res: result of read
+ *      now_ms: current time in milliseconds
+ * Return:
+ *      0: OK
+ *      -1: received stop signal
+ */
+static int uring_complete_rx(struct sim_uring *u, struct uring_io *uio,
+        int res, uint64_t now_ms)
+{
+    struct uart_io *io = &uio->io;
+    int port_id = io->attr->port_id;
+    int ret = 0;
+
+    uio->rx_busy = 0;
+
+    if (res > 0) {
+        if (io->rx.esc_on) {
+            res = unescape_xonxoff(&io->rx, uio->rx_tmp, res);
+        } else {
+            io->rx.wr += res;
+        }
+
+        io->last_rx_ms = now_ms;
+        reset_rx_timeout(port_id);
+        capture_uart_stream(port_id, &io->rx, res);
+
+        if (parse_uart_stream(&io->rx, io->attr) < 0) {
+            ret = -1;
+        }
+    } else if (res == -ECANCELED || res == -EINTR || res == -ETIME) {
+        reactor_check_timeout(io, now_ms);
+    } else if (res < 0 && res != -EAGAIN) {
+        /* Not queued again, so that a broken port doesn't spin */
+        log_print(test_mod_sim.log_fd, "%s read error: %s\n",
+                port_list[port_id], strerror(-res));
+        test_mod_sim.pass = 0;
+        return ret;
+    }
+
+    if (ret == 0 && sim_is_running()) {
+        uring_submit_rx(u, uio);
+    }
+
+    return ret;
+}
+
+/*
+ * Name:
+ *      uring_complete_tx
+ * Description:
+ *      handle a completed write of port. Without pacing, the next write is
+ *      queued at once, otherwise on next tick.
+ * PARAMETERS:
+ *      u: io_uring engine
+ *      uio: port state
+ *      res: result of write
+ * Return:
+ *      NULL
+ */
+static void uring_complete_tx(struct sim_uring *u, struct uring_io *uio,
+        int res)
+{
+    uio->tx_busy = 0;
+
+    if (res < 0) {
+        if (res != -EAGAIN && res != -ECANCELED) {
+            DBG_PRINT("%s write error\n", port_list[uio->io.attr->port_id]);
+        }
+        return;
+    }
+
+    advance_tx_packet(&uio->io, res);
+
+    if (g_sim_pacing == SIM_PACING_NONE && sim_is_running()) {
+        uring_submit_tx(u, uio);
+    }
+}
+
+/*
+ * Name:
+ *      uring_drain
+ * Description:
+ *      cancel the reads and writes in flight and wait for them to complete,
+ *      so that no request of this run is left on the ports, or on the
+ *      buffers freed after it. Wait up to URING_DRAIN_MS.
+ * PARAMETERS:
+ *      u: io_uring engine
+ *      port_num: number of ports
+ * Return:
+ *      NULL
+ */
+static void uring_drain(struct sim_uring *u, int port_num)
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    uint64_t deadline = get_time_ms() + URING_DRAIN_MS;
+    struct uring_io *uio;
+    uint64_t data;
+    int busy = 0;
+    int i;
+
+    for (i = 0; i < port_num; i++) {
+        uio = &u->port[i];
+        if (uio->rx_busy && (sqe = uring_get_sqe(&u->ring)) != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = URING_DATA(i, URING_RX);
+            sqe->user_data = URING_DATA(i, URING_CANCEL);
         }
+        if (uio->tx_busy && (sqe = uring_get_sqe(&u->ring)) != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = URING_DATA(i, URING_TX);
+            sqe->user_data = URING_DATA(i, URING_CANCEL);
+        }
+    }
 
-        return -1;
-    } else {
-        _uart_array[port_id].target_send_num = recv_packet->pack_num;
-        tmp = _uart_array[port_id].target_send_num - _uart_array[port_id].recv_count;
-        if (tmp > 0) {
-            test_mod_sim.pass = 0;
-            if (tmp != _uart_array[port_id].lost_count) {
-                _uart_array[port_id].lost_count = tmp;
-                log_print(log_fd, "%s lost %d package\n",
-                        port_list[port_id],
-                        _uart_array[port_id].lost_count);
+    do {
+        /* The tick in flight wakes up the wait */
+        if (uring_enter(&u->ring, 1) < 0 && errno != EINTR) {
+            break;
+        }
+
+        while ((cqe = uring_peek_cqe(&u->ring)) != NULL) {
+            data = cqe->user_data;
+            uring_cqe_seen(&u->ring);
+
+            if (URING_TYPE(data) == URING_RX) {
+                u->port[URING_PORT(data)].rx_busy = 0;
+            } else if (URING_TYPE(data) == URING_TX) {
+                u->port[URING_PORT(data)].tx_busy = 0;
+            } else if (URING_TYPE(data) == URING_TICK) {
+                uring_submit_tick(u);
             }
         }
+
+        busy = 0;
+        for (i = 0; i < port_num; i++) {
+            busy += u->port[i].rx_busy + u->port[i].tx_busy;
+        }
+    } while (busy > 0 && get_time_ms() < deadline);
+
+    if (busy > 0) {
+        log_print(test_mod_sim.log_fd, "%d I/O requests are not canceled\n",
+                busy);
     }
+}
+
+/*
+ * Name:
+ *      sim_uring_run
+ * Description:
+ *      Drive TX and RX of all ports from one thread with io_uring. A read
+ *      with a linked timeout is always in flight on each port, so the wait
+ *      is by the linked timeout instead of VTIME. All reads and writes are
+ *      submitted in a batch by one io_uring_enter() per loop, on registered
+ *      files and buffers. The TX pacing is the same as sim_reactor_run(),
+ *      driven by a timeout request. Fall back to the epoll engine if
+ *      io_uring is not available.
+ * PARAMETERS:
+ *      uart_param: attribute of ports
+ *      port_num: number of ports
+ * Return:
+ *      NULL
+ */
+static void sim_uring_run(struct uart_attr *uart_param, int port_num)
+{
+    struct sim_uring *u;
+    struct io_uring_cqe *cqe;
+    struct iovec iov;
+    struct uring_io *uio;
+    uint64_t start_ms;
+    uint64_t now_ms;
+    uint64_t data;
+    int log_fd = test_mod_sim.log_fd;
+    int *fds;
+    int echo;
+    int res;
+    int fd;
+    int i;
 
-    //Check UART ID
-    int sender_id = recv_packet->port_id;
-    if (port_id != sender_id) {
+    /* In echo mode, machine B only sends back what it receives */
+    echo = (g_sim_latency == SIM_LATENCY_ECHO && g_machine == 'B');
+
+    u = calloc(1, sizeof(struct sim_uring));
+    fds = calloc(port_num, sizeof(int));
+    if (u != NULL) {
+        u->port = calloc(port_num, sizeof(struct uring_io));
+    }
+    if (u == NULL || u->port == NULL || fds == NULL) {
+        log_print(log_fd, "Out of memory\n");
         test_mod_sim.pass = 0;
-        log_print(log_fd,
-                "Mismatched port: sender COM-%d, receiver COM-%d\n",
-                sender_id+1, port_id+1);
-        g_running = 0;
-        return -1;
+        goto exit;
     }
 
-    return 0;
-}
+    /*
+     * Read, its linked timeout and write of each port, and the tick. The
+     * reads and writes at current position (off -1) need kernel 5.6.
+     */
+    if (uring_init(&u->ring, port_num * 3 + 2) < 0
+            || !(u->ring.features & IORING_FEAT_RW_CUR_POS)) {
+        log_print(log_fd, "io_uring is not available (%s), use epoll engine\n",
+                (u->ring.fd < 0) ? strerror(errno) : "kernel before 5.6");
+        uring_exit(&u->ring);
+        free(fds);
+        free(u->port);
+        free(u);
+        /* Also for the next steps of baud sweep, and in the report */
+        g_sim_engine = SIM_ENGINE_EPOLL;
+        sim_reactor_run(uart_param, port_num);
+        return;
+    }
+
+    for (i = 0; i < port_num; i++) {
+        fds[i] = uart_param[i].uart_fd;
+    }
+    u->fixed_files = (uring_register_files(&u->ring, fds, port_num) == 0);
+
+    /* All port state is one buffer, the reads and writes are in it */
+    iov.iov_base = u->port;
+    iov.iov_len = port_num * sizeof(struct uring_io);
+    u->fixed_bufs = (uring_register_buffers(&u->ring, &iov, 1) == 0);
+
+    if (!u->fixed_files || !u->fixed_bufs) {
+        log_print(log_fd, "io_uring without registered %s%s%s\n",
+                u->fixed_files ? "" : "files",
+                (!u->fixed_files && !u->fixed_bufs) ? " and " : "",
+                u->fixed_bufs ? "" : "buffers");
+    }
+
+    u->tick.tv_nsec = SEG_INTERVAL_MS * 1000000;
+    u->rx_timeout.tv_sec = get_rx_timeout_ms() / 1000;
+    u->rx_timeout.tv_nsec = (get_rx_timeout_ms() % 1000) * 1000000;
+
+    start_ms = get_time_ms();
+
+    for (i = 0; i < port_num; i++) {
+        uio = &u->port[i];
+        uio->io.attr = &uart_param[i];
+        uio->io.last_rx_ms = start_ms;
+        uio->io.rx.esc_on = (g_sim_flow == SIM_FLOW_XONXOFF);
+        init_uart_frame(&uio->io.tx, i);
+        uio->io.outq_target = get_outq_target(uart_param[i].baudrate);
+
+        fd = uart_param[i].uart_fd;
+        if (fd < 0) {
+            continue;
+        }
+
+        /* Blocking reads return on the first byte, or the linked timeout */
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        tc_set_timeout(fd, 1, 0);
+
+        uring_submit_rx(u, uio);
+    }
+    uring_submit_tick(u);
+
+    while (sim_is_running()) {
+        if (uring_enter(&u->ring, 1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_print(log_fd, "io_uring_enter error: %s\n", strerror(errno));
+            test_mod_sim.pass = 0;
+            break;
+        }
+
+        now_ms = get_time_ms();
+
+        while ((cqe = uring_peek_cqe(&u->ring)) != NULL) {
+            data = cqe->user_data;
+            res = cqe->res;
+            uring_cqe_seen(&u->ring);
+
+            uio = &u->port[URING_PORT(data)];
+            switch (URING_TYPE(data)) {
+            case URING_RX:
+                if (uring_complete_rx(u, uio, res, now_ms) < 0) {
+                    /*received stop signal*/
+                    sim_stop();
+                }
+                break;
+            case URING_TX:
+                uring_complete_tx(u, uio, res);
+                break;
+            case URING_TICK:
+                uring_submit_tick(u);
+
+                /* One TX segment per port on every tick */
+                for (i = 0; i < port_num; i++) {
+                    if (uart_param[i].uart_fd < 0) {
+                        continue;
+                    }
+
+                    if (now_ms - start_ms >= SEND_DELAY_MS && !echo
+                            && sim_is_running()) {
+                        uring_submit_tx(u, &u->port[i]);
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    uring_drain(u, port_num);
+    thread_io_calls += u->ring.enters;
+    uring_exit(&u->ring);
+
+    /*test is stopped, send stop mark to other machine*/
+    for (i = 0; i < port_num; i++) {
+        fd = uart_param[i].uart_fd;
+        if (fd < 0) {
+            continue;
+        }
+
+        /* Back to the VMIN/VTIME of the other engines */
+        tc_set_timeout(fd, (g_sim_vmin >= 0) ? g_sim_vmin : 0,
+                (g_sim_vtime >= 0) ? g_sim_vtime : 20);
+        send_stop_sign(fd);
 
+        log_port_count(i);
+    }
+
+exit:
+    free(fds);
+    if (u != NULL) {
+        free(u->port);
+    }
+    free(u);
+}
 
 /*
  * Name:
- *      port_recv_event
+ *      sim_run_engine
  * Description:
- *      The thread routine to read data from serial port and verify them
+ *      run the selected engine on all ports until current run is stopped
  * PARAMETERS:
- *      uart_param: Argument of thread routine
+ *      uart_param: attribute of ports
+ *      port_num: number of ports
  * Return:
- *      Exit code of thread
- *
+ *      NULL
  */
-static void *port_recv_event(void *args)
+static void sim_run_engine(struct uart_attr *uart_param, int port_num)
 {
-    struct uart_attr *uart_param;
-    uint8_t buff[BUFF_SIZE];
-    int fd;
-    int log_fd;
+    pthread_t *th_send_id;
+    pthread_t *th_recv_id;
 
-    int port_id;
+    int i;
 
-    int n;
-    int status;
+    if (g_sim_engine == SIM_ENGINE_EPOLL) {
+        sim_reactor_run(uart_param, port_num);
+        flush_io_calls();
+        return;
+    } else if (g_sim_engine == SIM_ENGINE_URING) {
+        sim_uring_run(uart_param, port_num);
+        flush_io_calls();
+        return;
+    }
 
-    uart_param = (struct uart_attr *)args;
+    th_send_id = calloc(port_num * 2, sizeof(pthread_t));
+    if (th_send_id == NULL) {
+        log_print(test_mod_sim.log_fd, "Out of memory\n");
+        test_mod_sim.pass = 0;
+        return;
+    }
+    th_recv_id = th_send_id + port_num;
 
-    fd = uart_param->uart_fd;
-    if (fd < 0) {
-        pthread_exit((void *)-1);
+    /*creat pthread for received*/
+    for (i=0; i<port_num; i++) {
+        pthread_create(&th_recv_id[i], NULL, port_recv_event, &uart_param[i]);
     }
 
-    port_id = uart_param->port_id;
+    for (i=0; i<port_num; i++) {
+        pthread_create(&th_send_id[i], NULL, port_send_event, &uart_param[i]);
+    }
 
-    log_fd = test_mod_sim.log_fd;
+    for (i=0; i<port_num; i++) {
+        pthread_join(th_recv_id[i], NULL);
+        pthread_join(th_send_id[i], NULL);
+    }
 
-    while (g_running) {
-        n = recv_uart_packet(fd, buff, BUFF_SIZE, port_id);
-        if (n != BUFF_SIZE) {
-            if (n == -1) { /*received stop signal*/
-                g_running = 0;
-                pthread_exit((void *)0);
-            } else if (n == 0) {
-                continue; //Fix unexpect error count increase
+    free(th_send_id);
+}
+
+/*
+ * Name:
+ *      reset_port_count
+ * Description:
+ *      clear the traffic counters of port before a step of baud sweep
+ * PARAMETERS:
+ *      port_id: array id number
+ * Return:
+ *      NULL
+ */
+static void reset_port_count(int port_id)
+{
+    struct uart_tx_stats *tx = &_uart_stats[port_id].tx;
+    struct uart_rx_stats *rx = &_uart_stats[port_id].rx;
+
+    STAT_UPDATE(tx,
+            STAT_SET(tx->send_count, 0);
+            STAT_SET(tx->tx_bytes, 0));
+
+    STAT_UPDATE(rx,
+            STAT_SET(rx->err_count, 0);
+            STAT_SET(rx->recv_count, 0);
+            STAT_SET(rx->target_send_num, 0);
+            STAT_SET(rx->lost_count, 0);
+            STAT_SET(rx->timeout_count, 0);
+            STAT_SET(rx->skip_count, 0);
+            STAT_SET(rx->rx_cpu_ns, 0);
+            STAT_SET(rx->bit_count, 0);
+            STAT_SET(rx->bit_err, 0);
+            STAT_SET(rx->dup_count, 0);
+            STAT_SET(rx->reorder_count, 0);
+            STAT_SET(rx->late_count, 0));
+}
+
+/*
+ * Name:
+ *      sim_sweep
+ * Description:
+ *      step all ports through the baudrates of sweep_baudrate, or the packet
+ *      lengths of sweep_frame, g_sim_sweep or g_sim_frame_sweep seconds per
+ *      step, and save goodput, packet rate, loss, CRC errors, UART overruns
+ *      and RX CPU time of each step. The stop sign of the machine ending a
+ *      step first also ends the step on the other machine, so the steps of
+ *      both machines are kept aligned.
+ * PARAMETERS:
+ *      uart_param: attribute of ports
+ *      port_num: number of ports
+ * Return:
+ *      NULL
+ */
+static void sim_sweep(struct uart_attr *uart_param, int port_num)
+{
+    struct uart_count_list *before;
+    struct uart_count_list after;
+    struct sim_sweep_result *res;
+    uint64_t elapsed_ms;
+    uint32_t good;
+    int log_fd = test_mod_sim.log_fd;
+    int pass = test_mod_sim.pass;
+    int frame_sweep = (g_sim_frame_sweep > 0);
+    int steps = frame_sweep ? SWEEP_FRAME_COUNT : SWEEP_RATE_COUNT;
+    int seconds = frame_sweep ? g_sim_frame_sweep : g_sim_sweep;
+    int baudrate = g_baudrate;
+    int found;
+    int step;
+    int i;
+
+    before = calloc(port_num, sizeof(struct uart_count_list));
+    if (before == NULL) {
+        log_print(log_fd, "Out of memory\n");
+        test_mod_sim.pass = 0;
+        return;
+    }
+
+    log_print(log_fd, "%s sweep, %d seconds per step\n",
+            frame_sweep ? "Frame" : "Baud", seconds);
+
+    for (step = 0; step < steps && g_running; step++) {
+        if (frame_sweep) {
+            /* Both machines skip the same steps, as latency is the same */
+            if (g_sim_latency != SIM_LATENCY_OFF
+                    && sweep_frame[step] < SIM_FRAME_TS_MIN) {
+                continue;
             }
-            DBG_PRINT("recv_uart_packet data error\n");
+            frame_len = sweep_frame[step];
+        } else {
+            baudrate = sweep_baudrate[step];
         }
 
-        status = analysis_packet(buff, port_id);
-        if (status != 0) {
-            if (g_running) {
-                test_mod_sim.pass = 0;
-                log_print(log_fd, "Analyze packet fail\n");
+        for (i = 0; i < port_num; i++) {
+            uart_param[i].baudrate = baudrate;
+            if (uart_param[i].uart_fd < 0) {
+                continue;
             }
+
+            tc_set_baudrate(uart_param[i].uart_fd, baudrate);
+            reset_port_count(i);
+            init_uart_frame(&_uart_frame[i], _uart_peer[i].sender);
+            init_uart_ber(i);
+            init_uart_seq(i);
+            sim_get_count(i, &before[i]);
+        }
+
+        if (frame_sweep) {
+            log_print(log_fd, "Sweep packet length %d\n", frame_len);
         } else {
-            if (_uart_array[port_id].recv_count % 1000 == 0) {
-                log_print(log_fd,"%s received %d packet successfully\n",
-                    port_list[port_id],
-                    (uint32_t)_uart_array[port_id].recv_count);
+            log_print(log_fd, "Sweep baudrate %d\n", baudrate);
+        }
+
+        tx_start_ms = get_time_ms() + SEND_DELAY_MS;
+        sim_stop_ms = tx_start_ms + (uint64_t)seconds * 1000;
+        sim_running = 1;
+        sim_run_engine(uart_param, port_num);
+        tx_end_ms = get_time_ms();
+
+        elapsed_ms = (tx_end_ms > tx_start_ms) ? tx_end_ms - tx_start_ms : 0;
+
+        for (i = 0; i < port_num; i++) {
+            if (uart_param[i].uart_fd < 0) {
+                continue;
             }
+
+            sim_get_count(i, &after);
+            good = after.recv_count - after.err_count;
+
+            res = &_sweep_result[i][step];
+            res->done = 1;
+            res->frames = (elapsed_ms == 0) ? 0 :
+                (uint64_t)good * 1000 / elapsed_ms;
+            res->goodput = res->frames * (frame_sweep ?
+                    (uint64_t)(TAIL_OFFSET - PAYLOAD_OFFSET) : frame_len);
+            res->recv = after.recv_count;
+            res->lost = after.lost_count;
+            res->err = after.err_count;
+            res->overrun = (after.hw_overrun + after.hw_buf_overrun)
+                - (before[i].hw_overrun + before[i].hw_buf_overrun);
+            res->rx_cpu_ns = after.rx_cpu_ns;
         }
-    } /*end while(g_running)*/
 
-    log_print(log_fd, "COM-%d: send: %lu, recv: %lu, error: %lu\n",
-            port_id+1,
-            _uart_array[port_id].send_count,
-            _uart_array[port_id].recv_count,
-            _uart_array[port_id].err_count);
+        /*
+         * Wait the stop sign to be sent, and discard the data of this step
+         * received after the receiver exits
+         */
+        for (i = 0; i < port_num; i++) {
+            if (uart_param[i].uart_fd >= 0) {
+                tcdrain(uart_param[i].uart_fd);
+            }
+        }
+        sleep_ms(SWEEP_GAP_MS);
+        for (i = 0; i < port_num; i++) {
+            if (uart_param[i].uart_fd >= 0) {
+                tcflush(uart_param[i].uart_fd, TCIFLUSH);
+            }
+        }
+    }
 
-    pthread_exit((void *)0);
+    sim_stop_ms = 0;
+    free(before);
+
+    /*
+     * Errors at high baudrates are expected, pass if each port has a rate.
+     * The baudrate is fixed in frame sweep, every packet length must pass.
+     */
+    for (i = 0; i < port_num; i++) {
+        found = 0;
+        for (step = 0; step < steps; step++) {
+            res = &_sweep_result[i][step];
+            if (!res->done) {
+                continue;
+            }
+            if (res->goodput > 0 && res->lost == 0 && res->err == 0) {
+                found = 1;
+            } else if (frame_sweep) {
+                pass = 0;
+            }
+        }
+        if (!found) {
+            pass = 0;
+        }
+    }
+    test_mod_sim.pass = pass;
 }
 
 /*
  * Name:
- *      port_send_event
+ *      make_probe
  * Description:
- *      The thread routine to write data to serial port
+ *      create the probe of topology discovery for port
  * PARAMETERS:
- *      uart_param: Argument of thread routine
+ *      buff: save probe, PROBE_LEN bytes
+ *      port_id: array id number
  * Return:
- *      Exit code of thread
- *
+ *      NULL
  */
-static void *port_send_event(void *args)
+static void make_probe(uint8_t *buff, int port_id)
 {
-    struct uart_attr *uart_param;
+    uint32_t crc;
 
-    int fd;
-    int log_fd;
+    memcpy(buff, probe_sign, sizeof(probe_sign));
+    buff[4] = g_machine;
+    buff[5] = port_id;
 
-    int port_id;
+    crc = crc32(0, buff, 6);
+    memcpy(buff + 6, &crc, sizeof(crc));
+}
 
-    int n;
+/*
+ * Name:
+ *      parse_probes
+ * Description:
+ *      pull the probes out of receive ring, other data are dropped
+ * PARAMETERS:
+ *      ring: receive ring of port
+ *      heard: count probes of each sender port
+ *      machine: save machine of the last probe
+ *      port_num: number of ports
+ * Return:
+ *      NULL
+ */
+static void parse_probes(struct uart_ring *ring, uint32_t *heard, char *machine,
+        int port_num)
+{
+    uint8_t probe[PROBE_LEN];
+    uint32_t crc;
     int i;
 
-    struct uart_package uart_pack = {{0}};
+    while (ring->wr - ring->rd >= PROBE_LEN) {
+        for (i = 0; i < PROBE_LEN; i++) {
+            probe[i] = ring->data[(ring->rd + i) & RX_RING_MASK];
+        }
 
-    uart_param = (struct uart_attr *)args;
+        memcpy(&crc, probe + 6, sizeof(crc));
+        if (memcmp(probe, probe_sign, sizeof(probe_sign)) != 0
+                || crc != (uint32_t)crc32(0, probe, 6)
+                || probe[5] >= port_num) {
+            ring->rd++;
+            continue;
+        }
 
-    log_fd = test_mod_sim.log_fd;
+        heard[probe[5]]++;
+        *machine = probe[4];
+        ring->rd += PROBE_LEN;
+    }
+}
 
-    fd = uart_param->uart_fd;
+/*
+ * Name:
+ *      sim_discover
+ * Description:
+ *      find which sender port is wired to each port by probes, log the
+ *      wiring matrix, and remap the expected sender of each port if
+ *      g_sim_topology is SIM_TOPOLOGY_REMAP
+ * PARAMETERS:
+ *      uart_param: attribute of ports
+ *      port_num: number of ports
+ * Return:
+ *      number of ports wired to another port than expected, a port which
+ *      received no probe is reported as unknown but not counted
+ */
+static int sim_discover(struct uart_attr *uart_param, int port_num)
+{
+    uint32_t *heard;    /* Probes of port j received by port i at [i*n + j] */
+    uint32_t *row;
+    char *machine;
+    int *sender;
+    struct pollfd *pfd;
+    struct uart_ring *ring;
+    uint8_t probe[PROBE_LEN];
+    uint64_t start_ms;
+    uint64_t now_ms;
+    uint64_t next_ms;
+    int log_fd = test_mod_sim.log_fd;
+    int per_board = get_sim_board_ports();
+    int miswired = 0;
+    int unknown = 0;
+    int i;
+    int j;
 
-    if (fd < 0) {
-        pthread_exit((void *)-1);
+    ring = calloc(port_num, sizeof(struct uart_ring));
+    heard = calloc(port_num * port_num, sizeof(uint32_t));
+    machine = calloc(port_num, sizeof(char));
+    sender = calloc(port_num, sizeof(int));
+    pfd = calloc(port_num, sizeof(struct pollfd));
+    if (!ring || !heard || !machine || !sender || !pfd) {
+        log_print(log_fd, "Out of memory\n");
+        goto exit;
+    }
+
+    for (i = 0; i < port_num; i++) {
+        pfd[i].fd = uart_param[i].uart_fd;
+        pfd[i].events = POLLIN;
+    }
+
+    start_ms = get_time_ms();
+    next_ms = start_ms;
+    while (g_running && (now_ms = get_time_ms()) < start_ms + DISCOVERY_MS) {
+        if (now_ms >= next_ms && now_ms < start_ms + PROBE_SEND_MS) {
+            for (i = 0; i < port_num; i++) {
+                if (uart_param[i].uart_fd >= 0) {
+                    make_probe(probe, i);
+                    write_uart_all(uart_param[i].uart_fd, probe, PROBE_LEN);
+                }
+            }
+            next_ms += PROBE_INTERVAL_MS;
+        }
+
+        if (poll(pfd, port_num, PROBE_INTERVAL_MS / 4) <= 0) {
+            continue;
+        }
+
+        for (i = 0; i < port_num; i++) {
+            if (pfd[i].revents & POLLIN) {
+                recv_uart_stream(pfd[i].fd, &ring[i]);
+                parse_probes(&ring[i], heard + i * port_num, &machine[i],
+                        port_num);
+            }
+        }
+    }
+
+    /* Drop the data left, e.g. probes sent late by other machine */
+    for (i = 0; i < port_num; i++) {
+        if (uart_param[i].uart_fd >= 0) {
+            tcflush(uart_param[i].uart_fd, TCIFLUSH);
+        }
+    }
+
+    /* The sender heard most is wired to the port */
+    for (i = 0; i < port_num; i++) {
+        row = heard + i * port_num;
+        sender[i] = -1;
+        for (j = 0; j < port_num; j++) {
+            if (row[j] > 0 && (sender[i] < 0 || row[j] > row[sender[i]])) {
+                sender[i] = j;
+            }
+        }
+        /* Nothing heard, e.g. the other machine did not probe in time */
+        if (sender[i] < 0) {
+            unknown++;
+        } else if (sender[i] != i) {
+            miswired++;
+        }
+    }
+
+    if (miswired == 0 && unknown == 0) {
+        log_print(log_fd, "SIM wiring OK\n");
+        goto exit;
     }
 
-    port_id = uart_param->port_id;
+    log_print(log_fd, "SIM wiring matrix of %d board(s) "
+            "(X: probes of TX port received):\n", get_sim_board_num());
+    write_file(log_fd, "    RX\\TX ");
+    for (j = 0; j < port_num; j++) {
+        write_file(log_fd, "%3d", j+1);
+    }
+    write_file(log_fd, "\n");
+    for (i = 0; i < port_num; i++) {
+        row = heard + i * port_num;
+        write_file(log_fd, "    COM-%-3d", i+1);
+        for (j = 0; j < port_num; j++) {
+            write_file(log_fd, "%3s", row[j] ? "X" : ".");
+        }
+        write_file(log_fd, "\n");
+    }
 
-    sleep(3);/* waiting received thread ready */
+    for (i = 0; i < port_num; i++) {
+        if (sender[i] == i) {
+            continue;
+        }
 
-    _uart_array[port_id].send_count = 0;
+        if (sender[i] < 0) {
+            write_file(log_fd, "    COM-%d (board %d): no probe received, "
+                    "wiring unknown\n", i+1, i/per_board+1);
+            continue;
+        }
 
-    while (g_running) {
-        _uart_array[port_id].send_count++;
-        creat_uart_pack(&uart_pack, _uart_array[port_id].send_count, port_id);
+        write_file(log_fd, "    COM-%d (board %d) <- COM-%d (board %d) of %c\n",
+                i+1, i/per_board+1, sender[i]+1, sender[i]/per_board+1,
+                machine[i] ? machine[i] : '?');
 
-        n = send_uart_packet(fd, &uart_pack, BUFF_SIZE);
-        if (n != BUFF_SIZE) {
-            log_print(log_fd, "%s send data error\n", port_list[port_id]);
-            test_mod_sim.pass = 0;
-        } else {
-            if (_uart_array[port_id].send_count % 1000 == 0) {
-                log_print(log_fd,"%s send %d packet ok\n", port_list[port_id],
-                    (uint32_t)_uart_array[port_id].send_count);
-            }
+        /* Machine A receives its own packets back in echo mode */
+        if (g_sim_topology == SIM_TOPOLOGY_REMAP
+                && !(g_sim_latency == SIM_LATENCY_ECHO && g_machine == 'A')) {
+            _uart_peer[i].sender = sender[i];
         }
     }
 
-    /*if g_running == 0, send stop mark to other machine*/
-    if(g_running == 0) {
-        for (i=0; i<5; ) {
-            n = write(fd, stop_sign + i, 5 - i);
-            if (n == -1) {
-                sleep(1);
-                continue;
-            } else {
-                i += n;
-            }
-        }
+    if (g_sim_topology == SIM_TOPOLOGY_REMAP) {
+        log_print(log_fd, "Test with the SIM ports remapped\n");
     }
 
-    pthread_exit((void *)0);
+exit:
+    free(ring);
+    free(heard);
+    free(machine);
+    free(sender);
+    free(pfd);
+    return miswired;
 }
 
 void hsm_switch2b(int log_fd)
@@ -617,6 +3461,50 @@ void hsm_switch2b(int log_fd)
     close(fd);
 }
 
+/*
+ * Name:
+ *      sim_alloc_ports
+ * Description:
+ *      allocate the per-port state for port_num ports, and set sim_port_num
+ *      at last, so the main thread reads the counters only after they are
+ *      ready
+ * PARAMETERS:
+ *      port_num: number of ports
+ * Return:
+ *      0: OK
+ *      -1: out of memory
+ */
+static int sim_alloc_ports(int port_num)
+{
+    void *stats;
+
+    if (g_sim_port_list) {
+        port_list = g_sim_port_list;
+    }
+
+    if (posix_memalign(&stats, CACHE_LINE_SIZE,
+                port_num * sizeof(struct uart_stats)) != 0) {
+        return -1;
+    }
+    memset(stats, 0, port_num * sizeof(struct uart_stats));
+
+    _uart_frame = calloc(port_num, sizeof(struct uart_frame));
+    _uart_ber = calloc(port_num, sizeof(struct uart_ber));
+    _uart_seq = calloc(port_num, sizeof(struct uart_seq));
+    _uart_peer = calloc(port_num, sizeof(struct uart_peer));
+    _sweep_result = calloc(port_num, sizeof(*_sweep_result));
+    if (!_uart_frame || !_uart_ber || !_uart_seq || !_uart_peer
+            || !_sweep_result) {
+        free(stats);
+        return -1;
+    }
+
+    _uart_stats = stats;
+    __atomic_store_n(&sim_port_num, port_num, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
 /*
  * Name:
  *      sim_test
@@ -630,12 +3518,11 @@ void hsm_switch2b(int log_fd)
 static void *sim_test(void *args)
 {
 
-    struct uart_attr uart_param[16];
-    pthread_t th_send_id[16];
-    long th_send_stat[16];
+    struct uart_attr *uart_param;
+
+    pthread_t th_icount_id;
 
-    pthread_t th_recv_id[16];
-    long th_recv_stat[16];
+    char capture_dir[PATH_MAX] = "";
 
     int port_num;
 
@@ -662,11 +3549,27 @@ static void *sim_test(void *args)
     //Sleep 2 seconds before start testing
     sleep(2);
 
-    /*init global _uart_array*/
-    memset(_uart_array, 0, sizeof(struct uart_count_list));
-
     port_num = g_port_num;
 
+    uart_param = calloc(port_num, sizeof(struct uart_attr));
+    if (uart_param == NULL || sim_alloc_ports(port_num) < 0) {
+        log_print(log_fd, "Out of memory for %d ports\n", port_num);
+        test_mod_sim.pass = 0;
+        pthread_exit(NULL);
+    }
+
+    if (g_sim_latency != SIM_LATENCY_OFF && _uart_latency == NULL) {
+        _uart_latency = calloc(port_num, sizeof(struct uart_latency));
+        if (_uart_latency == NULL) {
+            log_print(log_fd, "Out of memory, latency is not measured\n");
+        } else {
+            for (i = 0; i < port_num; i++) {
+                hist_init(&_uart_latency[i].latency);
+                hist_init(&_uart_latency[i].jitter);
+            }
+        }
+    }
+
     /*init uart_param*/
     for (i=0; i<port_num; i++) {
         fd = tc_init(port_list[i]);
@@ -686,7 +3589,22 @@ static void *sim_test(void *args)
             log_print(log_fd, "Set port fail\n");
         }
 
-        tc_set_baudrate(fd, g_baudrate);
+        if (tc_set_baudrate(fd, g_baudrate) < 0) {
+            test_mod_sim.pass = 0;
+            log_print(log_fd, "Set baudrate %d of %s fail\n",
+                    g_baudrate, port_list[i]);
+        }
+
+        if (g_ser_low_latency && tc_set_low_latency(fd, TRUE) < 0) {
+            log_print(log_fd, "Set low latency of %s fail\n", port_list[i]);
+        }
+
+        if (g_sim_vmin >= 0 || g_sim_vtime >= 0) {
+            tc_set_timeout(fd, (g_sim_vmin >= 0) ? g_sim_vmin : 0,
+                    (g_sim_vtime >= 0) ? g_sim_vtime : 20);
+        }
+
+        init_hw_count(fd, i);
 
         /*assigned value to a struct uart_attr*/
         uart_param[i].uart_fd = fd;
@@ -694,22 +3612,84 @@ static void *sim_test(void *args)
         uart_param[i].port_id = i;
     }
 
-    log_print(log_fd, "Begin test!\n\n");
+    for (i = 0; i < port_num; i++) {
+        _uart_peer[i].sender = i;
+        _uart_peer[i].mismatch = 0;
+    }
 
-    /*creat pthread for received*/
-    for (i=0; i<port_num; i++) {
-        pthread_create(&th_recv_id[i], NULL, port_recv_event, &uart_param[i]);
+    if (g_sim_topology != SIM_TOPOLOGY_OFF) {
+        if (sim_discover(uart_param, port_num) > 0
+                && g_sim_topology == SIM_TOPOLOGY_REPORT) {
+            test_mod_sim.pass = 0;
+            log_print(log_fd, "SIM ports are miswired, skip the test\n");
+            /* The other machine stops its test too, not waiting timeouts */
+            for (i = 0; i < port_num; i++) {
+                if (uart_param[i].uart_fd >= 0) {
+                    send_stop_sign(uart_param[i].uart_fd);
+                }
+                tc_deinit(uart_param[i].uart_fd);
+            }
+            free(uart_param);
+            log_print(log_fd, "Test FAIL\n");
+            log_print(log_fd, "Test end\n\n");
+            pthread_exit(NULL);
+        }
     }
 
-    for (i=0; i<port_num; i++) {
-        pthread_create(&th_send_id[i], NULL, port_send_event, &uart_param[i]);
+    /* After discovery, the probes are not escaped for XON/XOFF */
+    if (g_sim_flow != SIM_FLOW_NONE) {
+        for (i = 0; i < port_num; i++) {
+            if (uart_param[i].uart_fd >= 0 && tc_set_flow_control(
+                        uart_param[i].uart_fd, (g_sim_flow == SIM_FLOW_RTSCTS)
+                        ? TC_FLOW_RTSCTS : TC_FLOW_XONXOFF) < 0) {
+                log_print(log_fd, "Set flow control of %s fail\n",
+                        port_list[i]);
+                test_mod_sim.pass = 0;
+            }
+        }
     }
 
-    for (i=0; i<port_num; i++) {
-        pthread_join(th_recv_id[i], (void *)&th_recv_stat[i]);
-        pthread_join(th_send_id[i], (void *)&th_send_stat[i]);
+    /* Expected packets of each port, from the sender wired to it */
+    frame_len = g_sim_frame;
+    for (i = 0; i < port_num; i++) {
+        init_uart_frame(&_uart_frame[i], _uart_peer[i].sender);
+        init_uart_ber(i);
+        init_uart_seq(i);
     }
 
+    if (g_sim_capture > 0) {
+        strncpy(capture_dir, test_mod_sim.log_file, sizeof(capture_dir) - 1);
+        if (sim_capture_start(port_num, g_sim_capture, port_list,
+                    dirname(capture_dir)) < 0) {
+            log_print(log_fd, "Start RX capture error\n");
+        }
+    }
+
+    log_print(log_fd, "Begin test!\n\n");
+
+    if (g_sim_engine == SIM_ENGINE_EPOLL) {
+        log_print(log_fd, "Use epoll engine\n");
+    } else if (g_sim_engine == SIM_ENGINE_URING) {
+        log_print(log_fd, "Use io_uring engine\n");
+    }
+
+    pthread_create(&th_icount_id, NULL, port_icount_event, uart_param);
+
+    if (g_sim_sweep > 0 || g_sim_frame_sweep > 0) {
+        sim_sweep(uart_param, port_num);
+    } else {
+        tx_start_ms = get_time_ms() + SEND_DELAY_MS;
+        sim_running = 1;
+        io_calls = 0;
+        engine_cpu_ns = get_process_cpu_ns();
+        sim_run_engine(uart_param, port_num);
+        engine_cpu_ns = get_process_cpu_ns() - engine_cpu_ns;
+        tx_end_ms = get_time_ms();
+    }
+
+    pthread_join(th_icount_id, NULL);
+    sim_capture_stop();
+
     /* Waiting read end, not use pthread_join,
      * because it will be blocking and not exits successfully */
     sleep(1);
@@ -717,12 +3697,333 @@ static void *sim_test(void *args)
     for (i = 0; i < port_num; i++) {
         tc_deinit(uart_param[i].uart_fd);
     }
+    free(uart_param);
+
+    sim_print_throughput(log_fd);
+    sim_print_sweep(log_fd);
+    sim_print_frame_sweep(log_fd);
+    sim_print_seq(log_fd);
+    sim_print_ber(log_fd);
+    sim_print_errmap(log_fd);
+    sim_print_latency(log_fd);
 
     log_print(log_fd, "Test %s\n", test_mod_sim.pass?"PASS":"FAIL");
     log_print(log_fd, "Test end\n\n");
     pthread_exit(NULL);
 }
 
+/*
+ * Name:
+ *      sim_print_throughput
+ * Description:
+ *      print achieved TX throughput of each port against the line rate
+ * PARAMETERS:
+ *      fd: log file point
+ * Return:
+ *      NULL
+ */
+static void sim_print_throughput(int fd)
+{
+    static const char *flow_name[] = {"none", "rtscts", "xonxoff"};
+    static const char *pacing_name[] = {"segment", "outq", "none"};
+    static const char *engine_name[] = {"thread", "epoll", "io_uring"};
+    struct uart_count_list count;
+    double mbytes = 0;
+    uint64_t elapsed_ms;
+    uint64_t rate;
+    uint64_t line_rate;
+    uint64_t goodput;
+    uint64_t busy_ms;
+    uint64_t stall_ms;
+    int i;
+
+    /* The result of sweep is printed by sim_print_(frame_)sweep() */
+    if (g_sim_sweep > 0 || g_sim_frame_sweep > 0 || tx_end_ms <= tx_start_ms) {
+        return;
+    }
+    elapsed_ms = tx_end_ms - tx_start_ms;
+
+    /* 8N1: 10 bits per byte on the line */
+    line_rate = g_baudrate / 10;
+
+    write_file(fd, "    Flow control: %s, pacing: %s\n",
+            flow_name[g_sim_flow], pacing_name[g_sim_pacing]);
+
+    /* Cost of the engine per MB moved, TX and RX of all ports */
+    for (i = 0; i < sim_port_num; i++) {
+        sim_get_count(i, &count);
+        mbytes += (count.tx_bytes + (uint64_t)count.recv_count * frame_len)
+            / 1048576.0;
+    }
+    if (mbytes > 0) {
+        write_file(fd, "    Engine: %s, %llu I/O syscalls (%.0f per MB), "
+                "CPU %llu ms (%.1f ms per MB)\n",
+                engine_name[g_sim_engine], (unsigned long long)io_calls,
+                io_calls / mbytes,
+                (unsigned long long)(engine_cpu_ns / 1000000),
+                engine_cpu_ns / 1000000.0 / mbytes);
+    }
+
+    for (i = 0; i < sim_port_num; i++) {
+        sim_get_count(i, &count);
+        rate = count.tx_bytes * 1000 / elapsed_ms;
+        write_file(fd, "    COM-%d: TX %llu B/s, line rate %llu B/s (%.1f%%)\n",
+                i+1, (unsigned long long)rate,
+                (unsigned long long)line_rate,
+                rate * 100.0 / line_rate);
+
+        /* Stall: time the TX line is idle, held by pacing or flow control */
+        goodput = (uint64_t)(count.recv_count - count.err_count) * frame_len
+            * 1000 / elapsed_ms;
+        busy_ms = count.tx_bytes * 1000 / line_rate;
+        stall_ms = (elapsed_ms > busy_ms) ? elapsed_ms - busy_ms : 0;
+        write_file(fd, "        goodput %llu B/s, stall %llu ms (%.1f%%)",
+                (unsigned long long)goodput, (unsigned long long)stall_ms,
+                stall_ms * 100.0 / elapsed_ms);
+        if (count.hw_valid) {
+            write_file(fd, ", overrun %u, CTS changes %u\n",
+                    count.hw_overrun + count.hw_buf_overrun, count.hw_cts);
+        } else {
+            write_file(fd, "\n");
+        }
+    }
+}
+
+/*
+ * Name:
+ *      sim_print_latency
+ * Description:
+ *      print latency and jitter percentiles of each port
+ * PARAMETERS:
+ *      fd: log file point
+ * Return:
+ *      NULL
+ */
+static void sim_print_latency(int fd)
+{
+    char name[32];
+    int i;
+
+    if (_uart_latency == NULL) {
+        return;
+    }
+
+    for (i = 0; i < sim_port_num; i++) {
+        snprintf(name, sizeof(name), "COM-%d latency", i+1);
+        hist_print(fd, name, &_uart_latency[i].latency);
+        snprintf(name, sizeof(name), "COM-%d jitter", i+1);
+        hist_print(fd, name, &_uart_latency[i].jitter);
+    }
+}
+
+/*
+ * Name:
+ *      sim_print_sweep
+ * Description:
+ *      print the result of baud sweep as a table per port, and the highest
+ *      error-free baudrate of each port
+ * PARAMETERS:
+ *      fd: log file point
+ * Return:
+ *      NULL
+ */
+static void sim_print_sweep(int fd)
+{
+    struct sim_sweep_result *res;
+    int best;
+    int step;
+    int i;
+
+    if (g_sim_sweep <= 0) {
+        return;
+    }
+
+    for (i = 0; i < sim_port_num; i++) {
+        write_file(fd, "    COM-%d baud sweep:\n", i+1);
+        write_file(fd, "        %-8s %-14s %-8s %-8s %-8s %s\n",
+                "BAUD", "GOODPUT(B/s)", "LOST", "ERROR", "OVERRUN",
+                "RX CPU(ms)");
+
+        best = 0;
+        for (step = 0; step < SWEEP_RATE_COUNT; step++) {
+            res = &_sweep_result[i][step];
+            if (!res->done) {
+                continue;
+            }
+
+            write_file(fd, "        %-8d %-14llu %-8u %-8u %-8u %llu\n",
+                    sweep_baudrate[step],
+                    (unsigned long long)res->goodput,
+                    res->lost, res->err, res->overrun,
+                    (unsigned long long)(res->rx_cpu_ns / 1000000));
+
+            if (res->goodput > 0 && res->lost == 0 && res->err == 0) {
+                best = sweep_baudrate[step];
+            }
+        }
+
+        if (best > 0) {
+            write_file(fd, "    COM-%d: highest error-free baudrate %d\n",
+                    i+1, best);
+        } else {
+            write_file(fd, "    COM-%d: no error-free baudrate\n", i+1);
+        }
+    }
+}
+
+/*
+ * Name:
+ *      sim_print_frame_sweep
+ * Description:
+ *      print the result of frame sweep as a table per port. The payload
+ *      goodput against the packet rate shows the cost of head, tail and CRC,
+ *      the RX CPU per packet the cost of wakeups and parsing per packet.
+ * PARAMETERS:
+ *      fd: log file point
+ * Return:
+ *      NULL
+ */
+static void sim_print_frame_sweep(int fd)
+{
+    struct sim_sweep_result *res;
+    int step;
+    int i;
+
+    if (g_sim_frame_sweep <= 0) {
+        return;
+    }
+
+    for (i = 0; i < sim_port_num; i++) {
+        write_file(fd, "    COM-%d frame sweep at baudrate %d:\n", i+1,
+                g_baudrate);
+        write_file(fd, "        %-8s %-10s %-14s %-8s %-8s %-8s %s\n",
+                "LENGTH", "PACKETS/s", "GOODPUT(B/s)", "LOST", "ERROR",
+                "OVERRUN", "RX CPU(us/packet)");
+
+        for (step = 0; step < SWEEP_FRAME_COUNT; step++) {
+            res = &_sweep_result[i][step];
+            if (!res->done) {
+                continue;
+            }
+
+            write_file(fd, "        %-8d %-10llu %-14llu %-8u %-8u %-8u %.1f\n",
+                    sweep_frame[step],
+                    (unsigned long long)res->frames,
+                    (unsigned long long)res->goodput,
+                    res->lost, res->err, res->overrun,
+                    res->recv ? res->rx_cpu_ns / 1000.0 / res->recv : 0.0);
+        }
+    }
+}
+
+/*
+ * Name:
+ *      sim_print_seq
+ * Description:
+ *      print exact lost, duplicated, reordered and late packets of each
+ *      port, and the distance of reordered packets
+ * PARAMETERS:
+ *      fd: log file point
+ * Return:
+ *      NULL
+ */
+static void sim_print_seq(int fd)
+{
+    struct uart_count_list count;
+    hist_t *h;
+    int i;
+
+    for (i = 0; i < sim_port_num; i++) {
+        sim_get_count(i, &count);
+        write_file(fd, "    COM-%d: lost %u, duplicate %u, reordered %u, "
+                "late %u\n", i+1, count.lost_count, count.dup_count,
+                count.reorder_count, count.late_count);
+
+        h = &_uart_seq[i].reorder;
+        if (h->count > 0) {
+            write_file(fd, "    COM-%d reorder distance(packets): "
+                    "p50 %llu, p99 %llu, max %llu\n", i+1,
+                    (unsigned long long)hist_percentile(h, 50),
+                    (unsigned long long)hist_percentile(h, 99),
+                    (unsigned long long)h->max);
+        }
+    }
+}
+
+/*
+ * Name:
+ *      sim_print_ber
+ * Description:
+ *      print bit error rate of each port, with its 95% confidence interval.
+ *      Bit errors are taken as Poisson distributed, the upper bound is 3/N
+ *      if no error in N bits.
+ * PARAMETERS:
+ *      fd: log file point
+ * Return:
+ *      NULL
+ */
+static void sim_print_ber(int fd)
+{
+    struct uart_count_list count;
+    double bits;
+    double errs;
+    double low;
+    double high;
+    int i;
+
+    for (i = 0; i < sim_port_num; i++) {
+        sim_get_count(i, &count);
+        if (count.bit_count == 0) {
+            continue;
+        }
+
+        bits = (double)count.bit_count;
+        errs = (double)count.bit_err;
+        if (count.bit_err == 0) {
+            low = 0;
+            high = 3.0 / bits;
+        } else {
+            low = (errs - 1.96 * sqrt(errs)) / bits;
+            high = (errs + 1.96 * sqrt(errs)) / bits;
+            if (low < 0) {
+                low = 0;
+            }
+        }
+
+        write_file(fd, "    COM-%d: BER %.2e (95%% CI %.2e ~ %.2e), "
+                "%llu bit errors in %llu bits\n",
+                i+1, errs / bits, low, high,
+                (unsigned long long)count.bit_err,
+                (unsigned long long)count.bit_count);
+    }
+}
+
+/*
+ * Name:
+ *      sim_print_errmap
+ * Description:
+ *      print the histograms of bit errors of each port with errors, by bit
+ *      of byte, burst length and byte offset in packet
+ * PARAMETERS:
+ *      fd: log file point
+ * Return:
+ *      NULL
+ */
+static void sim_print_errmap(int fd)
+{
+    char name[32];
+    int i;
+
+    for (i = 0; i < sim_port_num; i++) {
+        if (_uart_ber[i].map.frames == 0) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "COM-%d", i+1);
+        errmap_print(fd, name, &_uart_ber[i].map);
+    }
+}
+
 /*
  * Name:
  *      sim_print_result
@@ -744,6 +4045,68 @@ static void sim_print_result(int fd)
     } else {
         write_file(fd, "SIM: FAIL\n");
     }
+
+    sim_print_throughput(fd);
+    sim_print_sweep(fd);
+    sim_print_frame_sweep(fd);
+    sim_print_seq(fd);
+    sim_print_ber(fd);
+    sim_print_errmap(fd);
+    sim_print_latency(fd);
+}
+
+/*
+ * Name:
+ *      sim_get_count
+ * Description:
+ *      get a consistent snapshot of the counters of port
+ * PARAMETERS:
+ *      port_id: array id number
+ *      count: save the snapshot
+ * Return:
+ *      NULL
+ */
+static void sim_get_count(int port_id, struct uart_count_list *count)
+{
+    struct uart_tx_stats *tx = &_uart_stats[port_id].tx;
+    struct uart_rx_stats *rx = &_uart_stats[port_id].rx;
+    struct uart_hw_stats *hw = &_uart_stats[port_id].hw;
+    uint32_t seq;
+
+    do {
+        seq = stat_read_begin(&tx->seq);
+        count->send_count = STAT_GET(tx->send_count);
+        count->tx_bytes = STAT_GET(tx->tx_bytes);
+    } while (stat_read_retry(&tx->seq, seq));
+
+    do {
+        seq = stat_read_begin(&rx->seq);
+        count->err_count = STAT_GET(rx->err_count);
+        count->recv_count = STAT_GET(rx->recv_count);
+        count->target_send_num = STAT_GET(rx->target_send_num);
+        count->lost_count = STAT_GET(rx->lost_count);
+        count->timeout_count = STAT_GET(rx->timeout_count);
+        count->skip_count = STAT_GET(rx->skip_count);
+        count->rx_cpu_ns = STAT_GET(rx->rx_cpu_ns);
+        count->bit_count = STAT_GET(rx->bit_count);
+        count->bit_err = STAT_GET(rx->bit_err);
+        count->dup_count = STAT_GET(rx->dup_count);
+        count->reorder_count = STAT_GET(rx->reorder_count);
+        count->late_count = STAT_GET(rx->late_count);
+    } while (stat_read_retry(&rx->seq, seq));
+
+    do {
+        seq = stat_read_begin(&hw->seq);
+        count->hw_valid = STAT_GET(hw->valid);
+        count->hw_rx = STAT_GET(hw->rx);
+        count->hw_tx = STAT_GET(hw->tx);
+        count->hw_frame = STAT_GET(hw->frame);
+        count->hw_parity = STAT_GET(hw->parity);
+        count->hw_brk = STAT_GET(hw->brk);
+        count->hw_overrun = STAT_GET(hw->overrun);
+        count->hw_buf_overrun = STAT_GET(hw->buf_overrun);
+        count->hw_cts = STAT_GET(hw->cts);
+    } while (stat_read_retry(&hw->seq, seq));
 }
 
 /*
@@ -758,8 +4121,9 @@ static void sim_print_result(int fd)
  */
 static void sim_print_status(void)
 {
+    struct uart_count_list count;
     int i;
-    int port_num = g_port_num;
+    int port_num = sim_port_num;
 
     if (g_hsm_switching) {
         printf("%-*s %s\n",
@@ -770,17 +4134,28 @@ static void sim_print_status(void)
     printf("%-*s %s\n",
         COL_FIX_WIDTH, "SIM", (test_mod_sim.pass) ? STR_MOD_OK : STR_MOD_ERROR);
     for (i=0; i<port_num; i++) {
-        if (_uart_array[i].timeout_count > 0) {
-            printf("%-*s SENT(PKT):%-*u TIMEOUT(%us)\n",
+        sim_get_count(i, &count);
+        if (count.timeout_count > 0) {
+            printf("%-*s SENT(PKT):%-*u TIMEOUT(%.1fs)\n",
                 COL_FIX_WIDTH, port_list[i],
-                COL_FIX_WIDTH-10, _uart_array[i].send_count,
-                _uart_array[i].timeout_count * 2);
+                COL_FIX_WIDTH-10, count.send_count,
+                count.timeout_count * get_rx_timeout_ms() / 1000.0);
         } else {
-            printf("%-*s SENT(PKT):%-*u LOST(PKT):%-*u ERR(PKT):%-*u\n",
+            printf("%-*s SENT(PKT):%-*u LOST(PKT):%-*u ERR(PKT):%-*u SKIP(B):%u\n",
                 COL_FIX_WIDTH, port_list[i],
-                COL_FIX_WIDTH-10, _uart_array[i].send_count,
-                COL_FIX_WIDTH-10, _uart_array[i].lost_count,
-                COL_FIX_WIDTH-9, _uart_array[i].err_count);
+                COL_FIX_WIDTH-10, count.send_count,
+                COL_FIX_WIDTH-10, count.lost_count,
+                COL_FIX_WIDTH-9, count.err_count,
+                count.skip_count);
+        }
+        if (count.hw_valid) {
+            printf("%-*s OVERRUN:%-*u BUF_OVERRUN:%-*u FRAME:%u PARITY:%u BRK:%u\n",
+                COL_FIX_WIDTH, "",
+                COL_FIX_WIDTH-10, count.hw_overrun,
+                COL_FIX_WIDTH-14, count.hw_buf_overrun,
+                count.hw_frame,
+                count.hw_parity,
+                count.hw_brk);
         }
     }
 }
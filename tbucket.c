@@ -0,0 +1,155 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     tbucket.c
+ *
+ * DESCRIPTION:
+ *     Define functions of token bucket for rate control
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#include "tbucket.h"
+
+#define NS_PER_SEC          1000000000ULL
+
+/* Add the tokens from last_ns to now_ns, up to burst */
+static void tbucket_fill(tbucket_t *b, uint64_t now_ns)
+{
+    uint64_t full = b->burst * NS_PER_SEC;
+    uint64_t elapsed;
+
+    if (now_ns <= b->last_ns) {
+        return;
+    }
+    elapsed = now_ns - b->last_ns;
+    b->last_ns = now_ns;
+
+    if (b->rate == 0 || b->credit >= full) {
+        return;
+    }
+
+    /* Also no overflow of elapsed * rate after a long idle */
+    if (elapsed >= (full - b->credit) / b->rate + 1) {
+        b->credit = full;
+    } else {
+        b->credit += elapsed * b->rate;
+    }
+}
+
+/******************************************************************************
+ * NAME:
+ *      tbucket_init
+ *
+ * DESCRIPTION:
+ *      Initialize an empty token bucket.
+ *
+ * PARAMETERS:
+ *      b      - The token bucket
+ *      rate   - Tokens per second
+ *      burst  - Max tokens in bucket, the largest take
+ *      now_ns - Current time of CLOCK_MONOTONIC
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void tbucket_init(tbucket_t *b, uint64_t rate, uint64_t burst, uint64_t now_ns)
+{
+    b->rate = rate;
+    b->burst = burst;
+    b->credit = 0;
+    b->last_ns = now_ns;
+}
+
+/******************************************************************************
+ * NAME:
+ *      tbucket_set_rate
+ *
+ * DESCRIPTION:
+ *      Change the rate, the tokens until now are added at the old rate.
+ *
+ * PARAMETERS:
+ *      b      - The token bucket
+ *      rate   - Tokens per second
+ *      now_ns - Current time of CLOCK_MONOTONIC
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void tbucket_set_rate(tbucket_t *b, uint64_t rate, uint64_t now_ns)
+{
+    if (rate == b->rate) {
+        return;
+    }
+
+    tbucket_fill(b, now_ns);
+    b->rate = rate;
+}
+
+/******************************************************************************
+ * NAME:
+ *      tbucket_take
+ *
+ * DESCRIPTION:
+ *      Take the tokens in bucket, want at most.
+ *
+ * PARAMETERS:
+ *      b      - The token bucket
+ *      want   - Tokens wanted
+ *      now_ns - Current time of CLOCK_MONOTONIC
+ *
+ * RETURN:
+ *      Tokens taken, 0 ~ want
+ ******************************************************************************/
+uint64_t tbucket_take(tbucket_t *b, uint64_t want, uint64_t now_ns)
+{
+    uint64_t tokens;
+
+    tbucket_fill(b, now_ns);
+
+    tokens = b->credit / NS_PER_SEC;
+    if (tokens > want) {
+        tokens = want;
+    }
+    b->credit -= tokens * NS_PER_SEC;
+
+    return tokens;
+}
+
+/******************************************************************************
+ * NAME:
+ *      tbucket_wait_ns
+ *
+ * DESCRIPTION:
+ *      Get the time until the bucket has the tokens wanted (burst at most).
+ *
+ * PARAMETERS:
+ *      b      - The token bucket
+ *      want   - Tokens wanted
+ *      now_ns - Current time of CLOCK_MONOTONIC
+ *
+ * RETURN:
+ *      Nanoseconds to wait, 0 if the tokens are there, UINT64_MAX if the
+ *      rate is 0
+ ******************************************************************************/
+uint64_t tbucket_wait_ns(tbucket_t *b, uint64_t want, uint64_t now_ns)
+{
+    uint64_t need;
+
+    tbucket_fill(b, now_ns);
+
+    if (want > b->burst) {
+        want = b->burst;
+    }
+    need = want * NS_PER_SEC;
+    if (b->credit >= need) {
+        return 0;
+    }
+    if (b->rate == 0) {
+        return UINT64_MAX;
+    }
+
+    return (need - b->credit + b->rate - 1) / b->rate;
+}
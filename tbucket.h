@@ -0,0 +1,36 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     tbucket.h
+ *
+ * DESCRIPTION:
+ *     Define token bucket for rate control on CLOCK_MONOTONIC
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#ifndef _TBUCKET_H_
+#define _TBUCKET_H_
+
+#include <stdint.h>
+
+/*
+ * Tokens are kept in nano-tokens, so a rate of any tokens per second is
+ * added exactly per nanosecond. The bucket holds burst tokens at most, time
+ * idle or overslept beyond that is not made up.
+ */
+typedef struct _tbucket {
+    uint64_t rate;                      /* Tokens per second */
+    uint64_t burst;                     /* Max tokens */
+    uint64_t credit;                    /* Nano-tokens */
+    uint64_t last_ns;
+} tbucket_t;
+
+void tbucket_init(tbucket_t *b, uint64_t rate, uint64_t burst, uint64_t now_ns);
+void tbucket_set_rate(tbucket_t *b, uint64_t rate, uint64_t now_ns);
+uint64_t tbucket_take(tbucket_t *b, uint64_t want, uint64_t now_ns);
+uint64_t tbucket_wait_ns(tbucket_t *b, uint64_t want, uint64_t now_ns);
+
+#endif /* _TBUCKET_H_ */
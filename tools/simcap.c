@@ -0,0 +1,174 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     simcap.c
+ *
+ * DESCRIPTION:
+ *     Decoder of SIM capture files (sim_COM-<n>_<k>.cap), which are saved by
+ *     lirc-itest -sim-capture around a CRC error or timeout of a port.
+ *
+ *     simcap <file>        print the records, with hex dump of data
+ *     simcap -r <file>     write the raw bytes received to stdout, e.g. to
+ *                          replay them into a port: simcap -r x.cap > /dev/ttyS3
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+#include "sim_capture.h"
+
+static const char *rec_name[] = {
+    "DATA",
+    "CRC ERROR",
+    "TIMEOUT",
+    "DROP",
+};
+
+static void print_usage(char *name)
+{
+    printf("Usage: %s [-r] <capture file>\n"
+            "  -r  write the raw bytes received to stdout\n", name);
+}
+
+static void dump_data(const uint8_t *data, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if (i % 16 == 0) {
+            printf("    %04X:", i);
+        }
+        printf(" %02X", data[i]);
+        if (i % 16 == 15 || i == len - 1) {
+            printf("\n");
+        }
+    }
+}
+
+/* Print or write the records of an inflated chunk */
+static int decode_chunk(const uint8_t *buf, uint32_t len, uint32_t trigger_ms,
+        int raw)
+{
+    struct simcap_rec rec;
+    uint32_t off = 0;
+    uint32_t dropped;
+
+    while (off + sizeof(rec) <= len) {
+        memcpy(&rec, buf + off, sizeof(rec));
+        off += sizeof(rec);
+        if (off + rec.len > len) {
+            fprintf(stderr, "Truncated record\n");
+            return -1;
+        }
+
+        if (raw) {
+            if (rec.type == SIMCAP_REC_DATA
+                    && fwrite(buf + off, 1, rec.len, stdout) != rec.len) {
+                return -1;
+            }
+            off += rec.len;
+            continue;
+        }
+
+        printf("%+8.3fs %s",
+                ((double)rec.ms - (double)trigger_ms) / 1000,
+                (rec.type < sizeof(rec_name) / sizeof(rec_name[0])) ?
+                rec_name[rec.type] : "UNKNOWN");
+
+        if (rec.type == SIMCAP_REC_DATA) {
+            printf(" %u bytes\n", rec.len);
+            dump_data(buf + off, rec.len);
+        } else if (rec.type == SIMCAP_REC_DROP && rec.len == sizeof(dropped)) {
+            memcpy(&dropped, buf + off, sizeof(dropped));
+            printf(" %u bytes not captured\n", dropped);
+        } else {
+            printf("\n");
+        }
+        off += rec.len;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct simcap_file_hdr hdr;
+    struct simcap_chunk_hdr chunk;
+    uint8_t *zbuf = NULL;
+    uint8_t *buf = NULL;
+    uLongf len;
+    FILE *fp;
+    int raw = 0;
+    int ret = 0;
+
+    if (argc == 3 && strcmp(argv[1], "-r") == 0) {
+        raw = 1;
+    } else if (argc != 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    fp = fopen(argv[argc - 1], "rb");
+    if (fp == NULL) {
+        perror(argv[argc - 1]);
+        return 1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+            || memcmp(hdr.magic, SIMCAP_MAGIC, sizeof(SIMCAP_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a SIM capture file\n", argv[argc - 1]);
+        fclose(fp);
+        return 1;
+    }
+
+    hdr.device[sizeof(hdr.device) - 1] = '\0';
+    if (!raw) {
+        printf("COM-%u (%.*s) of machine %c, baudrate %u\n",
+                hdr.port_id, (int)sizeof(hdr.device), hdr.device,
+                hdr.machine, hdr.baudrate);
+        printf("Triggered by %s at %u ms, times below are relative to it\n\n",
+                (hdr.trigger < sizeof(rec_name) / sizeof(rec_name[0])) ?
+                rec_name[hdr.trigger] : "UNKNOWN", hdr.trigger_ms);
+    }
+
+    while (fread(&chunk, sizeof(chunk), 1, fp) == 1) {
+        zbuf = realloc(zbuf, chunk.zlen);
+        buf = realloc(buf, chunk.raw_len);
+        if (zbuf == NULL || buf == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            ret = 1;
+            break;
+        }
+
+        if (fread(zbuf, 1, chunk.zlen, fp) != chunk.zlen) {
+            fprintf(stderr, "Truncated chunk\n");
+            ret = 1;
+            break;
+        }
+
+        len = chunk.raw_len;
+        if (uncompress(buf, &len, zbuf, chunk.zlen) != Z_OK
+                || len != chunk.raw_len) {
+            fprintf(stderr, "Corrupted chunk\n");
+            ret = 1;
+            break;
+        }
+
+        if (decode_chunk(buf, len, hdr.trigger_ms, raw) < 0) {
+            ret = 1;
+            break;
+        }
+    }
+
+    free(zbuf);
+    free(buf);
+    fclose(fp);
+
+    return ret;
+}
@@ -0,0 +1,346 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     uring.c
+ *
+ * DESCRIPTION:
+ *     Define functions of a minimal io_uring ring, without liburing
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+#ifdef __NR_io_uring_setup
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned wait_nr,
+        unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags,
+            NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg,
+        unsigned nr)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+#else
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned wait_nr,
+        unsigned flags)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg,
+        unsigned nr)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif /* __NR_io_uring_setup */
+
+/******************************************************************************
+ * NAME:
+ *      uring_init
+ *
+ * DESCRIPTION:
+ *      Create an io_uring and map its rings.
+ *
+ * PARAMETERS:
+ *      r       - The ring
+ *      entries - Entries of SQ at least, the CQ has twice of SQ
+ *
+ * RETURN:
+ *      0 - OK, -1 - io_uring is not available (errno is set)
+ ******************************************************************************/
+int uring_init(uring_t *r, unsigned entries)
+{
+    struct io_uring_params p;
+    unsigned *array;
+    size_t sqes_len;
+    unsigned i;
+    char *sq;
+    char *cq;
+
+    memset(r, 0, sizeof(uring_t));
+    memset(&p, 0, sizeof(p));
+
+    r->fd = sys_io_uring_setup(entries, &p);
+    if (r->fd < 0) {
+        return -1;
+    }
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len) {
+            r->sq_len = r->cq_len;
+        }
+        r->cq_len = 0;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        goto fail;
+    }
+
+    r->cq_ptr = r->sq_ptr;
+    if (r->cq_len > 0) {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            goto fail;
+        }
+    }
+
+    sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, sqes_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        goto fail;
+    }
+
+    sq = r->sq_ptr;
+    cq = r->cq_ptr;
+    r->features = p.features;
+    r->sq_entries = p.sq_entries;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_local = *r->sq_tail;
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    array = (unsigned *)(sq + p.sq_off.array);
+    for (i = 0; i < p.sq_entries; i++) {
+        array[i] = i;
+    }
+
+    return 0;
+
+fail:
+    uring_exit(r);
+    errno = ENOMEM;
+    return -1;
+}
+
+/******************************************************************************
+ * NAME:
+ *      uring_exit
+ *
+ * DESCRIPTION:
+ *      Unmap the rings and close the io_uring. The requests in flight are
+ *      canceled by the kernel.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void uring_exit(uring_t *r)
+{
+    if (r->sqes != NULL && r->sqes != MAP_FAILED) {
+        munmap(r->sqes, r->sq_entries * sizeof(struct io_uring_sqe));
+    }
+    if (r->cq_len > 0 && r->cq_ptr != NULL && r->cq_ptr != MAP_FAILED) {
+        munmap(r->cq_ptr, r->cq_len);
+    }
+    if (r->sq_ptr != NULL && r->sq_ptr != MAP_FAILED) {
+        munmap(r->sq_ptr, r->sq_len);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+
+    memset(r, 0, sizeof(uring_t));
+    r->fd = -1;
+}
+
+/******************************************************************************
+ * NAME:
+ *      uring_register_files
+ *
+ * DESCRIPTION:
+ *      Register files, an SQE with IOSQE_FIXED_FILE takes the index of file
+ *      in fds instead of a file descriptor.
+ *
+ * PARAMETERS:
+ *      r   - The ring
+ *      fds - The files, -1 for an empty slot
+ *      nr  - Number of files
+ *
+ * RETURN:
+ *      0 - OK, -1 - failed (errno is set)
+ ******************************************************************************/
+int uring_register_files(uring_t *r, const int *fds, unsigned nr)
+{
+    return sys_io_uring_register(r->fd, IORING_REGISTER_FILES, fds, nr);
+}
+
+/******************************************************************************
+ * NAME:
+ *      uring_register_buffers
+ *
+ * DESCRIPTION:
+ *      Register buffers, which are pinned for IORING_OP_READ_FIXED and
+ *      IORING_OP_WRITE_FIXED. The pinned memory is limited by
+ *      RLIMIT_MEMLOCK on older kernels.
+ *
+ * PARAMETERS:
+ *      r   - The ring
+ *      iov - The buffers
+ *      nr  - Number of buffers
+ *
+ * RETURN:
+ *      0 - OK, -1 - failed (errno is set)
+ ******************************************************************************/
+int uring_register_buffers(uring_t *r, const struct iovec *iov, unsigned nr)
+{
+    return sys_io_uring_register(r->fd, IORING_REGISTER_BUFFERS, iov, nr);
+}
+
+/******************************************************************************
+ * NAME:
+ *      uring_get_sqe
+ *
+ * DESCRIPTION:
+ *      Get a cleared SQE to fill. If the SQ is full, the SQEs filled are
+ *      submitted first.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *
+ * RETURN:
+ *      The SQE, NULL if the SQ is still full
+ ******************************************************************************/
+struct io_uring_sqe *uring_get_sqe(uring_t *r)
+{
+    struct io_uring_sqe *sqe;
+
+    if (uring_sq_space(r) == 0) {
+        uring_enter(r, 0);
+        if (uring_sq_space(r) == 0) {
+            return NULL;
+        }
+    }
+
+    sqe = &r->sqes[r->sq_local & r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_local++;
+
+    return sqe;
+}
+
+/******************************************************************************
+ * NAME:
+ *      uring_sq_space
+ *
+ * DESCRIPTION:
+ *      Get the number of SQEs which can be got without submitting.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *
+ * RETURN:
+ *      Number of free SQEs
+ ******************************************************************************/
+unsigned uring_sq_space(uring_t *r)
+{
+    return r->sq_entries
+        - (r->sq_local - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE));
+}
+
+/******************************************************************************
+ * NAME:
+ *      uring_enter
+ *
+ * DESCRIPTION:
+ *      Submit the SQEs filled, and wait for completions.
+ *
+ * PARAMETERS:
+ *      r       - The ring
+ *      wait_nr - Number of CQEs to wait for, 0 to submit only
+ *
+ * RETURN:
+ *      Number of SQEs submitted, -1 on error (errno is set)
+ ******************************************************************************/
+int uring_enter(uring_t *r, unsigned wait_nr)
+{
+    unsigned to_submit = r->sq_local - *r->sq_tail;
+
+    __atomic_store_n(r->sq_tail, r->sq_local, __ATOMIC_RELEASE);
+    r->enters++;
+
+    return sys_io_uring_enter(r->fd, to_submit, wait_nr,
+            wait_nr ? IORING_ENTER_GETEVENTS : 0);
+}
+
+/******************************************************************************
+ * NAME:
+ *      uring_peek_cqe
+ *
+ * DESCRIPTION:
+ *      Get the next CQE without waiting. Call uring_cqe_seen() when done
+ *      with it.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *
+ * RETURN:
+ *      The CQE, NULL if there is none
+ ******************************************************************************/
+struct io_uring_cqe *uring_peek_cqe(uring_t *r)
+{
+    unsigned head = *r->cq_head;
+
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    return &r->cqes[head & r->cq_mask];
+}
+
+/******************************************************************************
+ * NAME:
+ *      uring_cqe_seen
+ *
+ * DESCRIPTION:
+ *      Release the CQE got by uring_peek_cqe() to the kernel.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void uring_cqe_seen(uring_t *r)
+{
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,57 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     uring.h
+ *
+ * DESCRIPTION:
+ *     Define a minimal io_uring ring on the raw system calls
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/*
+ * The SQ array maps slot i to SQE i for ever, so an SQE is filled in place
+ * and made visible by moving the tail. SQEs are submitted by uring_enter(),
+ * or by uring_get_sqe() when the SQ is full.
+ */
+typedef struct _uring {
+    int fd;
+    unsigned features;                  /* IORING_FEAT_* of kernel */
+    unsigned sq_entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_local;                  /* Tail of SQEs filled */
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    uint64_t enters;                    /* io_uring_enter() calls */
+} uring_t;
+
+int uring_init(uring_t *r, unsigned entries);
+void uring_exit(uring_t *r);
+int uring_register_files(uring_t *r, const int *fds, unsigned nr);
+int uring_register_buffers(uring_t *r, const struct iovec *iov, unsigned nr);
+struct io_uring_sqe *uring_get_sqe(uring_t *r);
+unsigned uring_sq_space(uring_t *r);
+int uring_enter(uring_t *r, unsigned wait_nr);
+struct io_uring_cqe *uring_peek_cqe(uring_t *r);
+void uring_cqe_seen(uring_t *r);
+
+#endif /* _URING_H_ */
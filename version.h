@@ -2,6 +2,6 @@
 #define _VERSION_H_ 1
 
 /* Version of the program */
-#define PROGRAM_VERSION     "0.25"
+#define PROGRAM_VERSION     "0.26"
 
 #endif /* ifndef _VERSION_H_ */
@@ -0,0 +1,549 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     xsk.c
+ *
+ * DESCRIPTION:
+ *     Define functions of a minimal AF_XDP socket, without libbpf
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "xsk.h"
+
+#ifndef AF_XDP
+#define AF_XDP              44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP             283
+#endif
+
+/* Entries of XSKMAP, the queue of socket is below it */
+#define XSK_MAX_QUEUES      64
+
+#define XSK_INSN(c, d, s, o, i) \
+    ((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int xsk_map_create(void)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(int);
+    attr.value_size = sizeof(int);
+    attr.max_entries = XSK_MAX_QUEUES;
+
+    return sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+/*
+ * The XDP program redirects the frames of ethertype to the socket of RX
+ * queue in XSKMAP, and passes the others to the stack:
+ *
+ *      if (data + 14 > data_end || eth->h_proto != htons(ethertype))
+ *          return XDP_PASS;
+ *      return bpf_redirect_map(map, ctx->rx_queue_index, XDP_PASS);
+ */
+static int xsk_prog_load(int map_fd, uint16_t ethertype)
+{
+    struct bpf_insn insns[] = {
+        XSK_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0),
+        XSK_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0),
+        XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        XSK_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, 14),
+        XSK_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 8, 0),
+        XSK_INSN(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_4, BPF_REG_2, 12, 0),
+        XSK_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 6, htons(ethertype)),
+        XSK_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, rx_queue_index), 0),
+        XSK_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+        XSK_INSN(0, 0, 0, 0, 0),
+        XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+        XSK_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        XSK_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+        XSK_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)(unsigned long)insns;
+    attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+    attr.license = (uint64_t)(unsigned long)"GPL";
+
+    return sys_bpf(BPF_PROG_LOAD, &attr);
+}
+
+/* Attach an XDP program to an interface by RTM_SETLINK, -1 to detach */
+static int xsk_link_set(int ifindex, int prog_fd, uint32_t flags)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+        char attrs[64];
+    } req;
+    struct {
+        struct nlmsghdr nh;
+        struct nlmsgerr err;
+    } ack;
+    struct nlattr *xdp;
+    struct nlattr *nla;
+    int sock;
+    int ret = -1;
+
+    sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (sock < 0) {
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    req.nh.nlmsg_type = RTM_SETLINK;
+    req.ifi.ifi_family = AF_UNSPEC;
+    req.ifi.ifi_index = ifindex;
+
+    xdp = (struct nlattr *)((char *)&req + NLMSG_ALIGN(req.nh.nlmsg_len));
+    xdp->nla_type = NLA_F_NESTED | IFLA_XDP;
+    xdp->nla_len = NLA_HDRLEN;
+
+    nla = (struct nlattr *)((char *)xdp + xdp->nla_len);
+    nla->nla_type = IFLA_XDP_FD;
+    nla->nla_len = NLA_HDRLEN + sizeof(int);
+    memcpy((char *)nla + NLA_HDRLEN, &prog_fd, sizeof(int));
+    xdp->nla_len += nla->nla_len;
+
+    nla = (struct nlattr *)((char *)xdp + xdp->nla_len);
+    nla->nla_type = IFLA_XDP_FLAGS;
+    nla->nla_len = NLA_HDRLEN + sizeof(uint32_t);
+    memcpy((char *)nla + NLA_HDRLEN, &flags, sizeof(uint32_t));
+    xdp->nla_len += nla->nla_len;
+
+    req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len) + xdp->nla_len;
+
+    if (send(sock, &req, req.nh.nlmsg_len, 0) < 0) {
+        goto out;
+    }
+    if (recv(sock, &ack, sizeof(ack), 0) < (int)sizeof(ack)) {
+        goto out;
+    }
+    if (ack.nh.nlmsg_type == NLMSG_ERROR && ack.err.error != 0) {
+        errno = -ack.err.error;
+        goto out;
+    }
+    ret = 0;
+
+out:
+    close(sock);
+    return ret;
+}
+
+/* Map a ring of socket at its offsets */
+static int xsk_ring_map(int fd, xsk_ring_t *r, struct xdp_ring_offset *off,
+        size_t entry_size, off_t pgoff)
+{
+    uint8_t *map;
+
+    r->map_len = off->desc + XSK_RING_SIZE * entry_size;
+    map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    r->map = map;
+    r->producer = (uint32_t *)(map + off->producer);
+    r->consumer = (uint32_t *)(map + off->consumer);
+    r->flags = (uint32_t *)(map + off->flags);
+    r->entries = map + off->desc;
+    r->mask = XSK_RING_SIZE - 1;
+
+    return 0;
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_open
+ *
+ * DESCRIPTION:
+ *      Attach the XDP program to an interface, in driver mode if supported
+ *      or in generic mode, and open an AF_XDP socket on a queue of it with
+ *      the UMEM and four rings mapped. The socket is zero-copy if the
+ *      driver supports it, or copies the frames.
+ *
+ * PARAMETERS:
+ *      x         - The socket
+ *      ifname    - The interface
+ *      queue     - The queue of interface
+ *      ethertype - Frames of this EtherType are redirected to the socket
+ *
+ * RETURN:
+ *      0 - OK, -1 - failed (errno is set)
+ ******************************************************************************/
+int xsk_open(xsk_t *x, const char *ifname, int queue, uint16_t ethertype)
+{
+    static const uint16_t bind_flags[] = {
+        XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP,
+        XDP_COPY | XDP_USE_NEED_WAKEUP,
+        XDP_COPY,
+    };
+    struct xdp_mmap_offsets off;
+    struct xdp_umem_reg reg;
+    struct sockaddr_xdp sxdp;
+    socklen_t optlen;
+    int size = XSK_RING_SIZE;
+    int err;
+    int i;
+
+    memset(x, 0, sizeof(xsk_t));
+    x->fd = -1;
+    x->prog_fd = -1;
+    x->map_fd = -1;
+    x->queue = queue;
+
+    x->ifindex = if_nametoindex(ifname);
+    if (x->ifindex == 0 || queue < 0 || queue >= XSK_MAX_QUEUES) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    x->map_fd = xsk_map_create();
+    if (x->map_fd < 0) {
+        goto fail;
+    }
+    x->prog_fd = xsk_prog_load(x->map_fd, ethertype);
+    if (x->prog_fd < 0) {
+        goto fail;
+    }
+
+    x->xdp_flags = XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_DRV_MODE;
+    if (xsk_link_set(x->ifindex, x->prog_fd, x->xdp_flags) < 0) {
+        x->xdp_flags = XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_SKB_MODE;
+        if (xsk_link_set(x->ifindex, x->prog_fd, x->xdp_flags) < 0) {
+            x->xdp_flags = 0;
+            goto fail;
+        }
+    }
+
+    x->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (x->fd < 0) {
+        goto fail;
+    }
+
+    x->umem_len = (size_t)XSK_FRAMES * XSK_FRAME_SIZE;
+    x->umem = mmap(NULL, x->umem_len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (x->umem == MAP_FAILED) {
+        x->umem = NULL;
+        goto fail;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (uint64_t)(unsigned long)x->umem;
+    reg.len = x->umem_len;
+    reg.chunk_size = XSK_FRAME_SIZE;
+    if (setsockopt(x->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0
+            || setsockopt(x->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) < 0
+            || setsockopt(x->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) < 0
+            || setsockopt(x->fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) < 0
+            || setsockopt(x->fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) < 0) {
+        goto fail;
+    }
+
+    optlen = sizeof(off);
+    if (getsockopt(x->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        goto fail;
+    }
+    if (xsk_ring_map(x->fd, &x->fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) < 0
+            || xsk_ring_map(x->fd, &x->comp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) < 0
+            || xsk_ring_map(x->fd, &x->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0
+            || xsk_ring_map(x->fd, &x->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0) {
+        goto fail;
+    }
+
+    /* Zero-copy first, then copy mode, then without the wakeup flags */
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = x->ifindex;
+    sxdp.sxdp_queue_id = queue;
+    for (i = 0; i < (int)(sizeof(bind_flags) / sizeof(bind_flags[0])); i++) {
+        sxdp.sxdp_flags = bind_flags[i];
+        if (bind(x->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) == 0) {
+            x->bind_flags = bind_flags[i];
+            break;
+        }
+    }
+    if (x->bind_flags == 0) {
+        goto fail;
+    }
+
+    {
+        union bpf_attr attr;
+        int key = queue;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = x->map_fd;
+        attr.key = (uint64_t)(unsigned long)&key;
+        attr.value = (uint64_t)(unsigned long)&x->fd;
+        if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+            goto fail;
+        }
+    }
+
+    return 0;
+
+fail:
+    err = errno;
+    xsk_close(x);
+    errno = err;
+    return -1;
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_close
+ *
+ * DESCRIPTION:
+ *      Close the socket, unmap the UMEM and rings, and detach the XDP
+ *      program from the interface.
+ *
+ * PARAMETERS:
+ *      x - The socket
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void xsk_close(xsk_t *x)
+{
+    xsk_ring_t *rings[] = {&x->fill, &x->comp, &x->rx, &x->tx};
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (rings[i]->map != NULL) {
+            munmap(rings[i]->map, rings[i]->map_len);
+        }
+    }
+    if (x->fd >= 0) {
+        close(x->fd);
+    }
+    if (x->umem != NULL) {
+        munmap(x->umem, x->umem_len);
+    }
+    if (x->xdp_flags != 0) {
+        xsk_link_set(x->ifindex, -1, x->xdp_flags & ~XDP_FLAGS_UPDATE_IF_NOEXIST);
+    }
+    if (x->prog_fd >= 0) {
+        close(x->prog_fd);
+    }
+    if (x->map_fd >= 0) {
+        close(x->map_fd);
+    }
+
+    memset(x, 0, sizeof(xsk_t));
+    x->fd = -1;
+    x->prog_fd = -1;
+    x->map_fd = -1;
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_ring_ready
+ *
+ * DESCRIPTION:
+ *      Get the number of entries to consume of the RX or completion ring,
+ *      from index *r->consumer.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *
+ * RETURN:
+ *      Number of entries
+ ******************************************************************************/
+uint32_t xsk_ring_ready(xsk_ring_t *r)
+{
+    return __atomic_load_n(r->producer, __ATOMIC_ACQUIRE) - *r->consumer;
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_ring_free
+ *
+ * DESCRIPTION:
+ *      Get the number of entries to produce of the fill or TX ring, from
+ *      index *r->producer.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *
+ * RETURN:
+ *      Number of entries
+ ******************************************************************************/
+uint32_t xsk_ring_free(xsk_ring_t *r)
+{
+    return XSK_RING_SIZE - (*r->producer - __atomic_load_n(r->consumer, __ATOMIC_ACQUIRE));
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_ring_submit
+ *
+ * DESCRIPTION:
+ *      Hand the entries filled to the kernel.
+ *
+ * PARAMETERS:
+ *      r - The fill or TX ring
+ *      n - Number of entries from index *r->producer
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void xsk_ring_submit(xsk_ring_t *r, uint32_t n)
+{
+    __atomic_store_n(r->producer, *r->producer + n, __ATOMIC_RELEASE);
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_ring_release
+ *
+ * DESCRIPTION:
+ *      Give the entries consumed back to the kernel.
+ *
+ * PARAMETERS:
+ *      r - The RX or completion ring
+ *      n - Number of entries from index *r->consumer
+ *
+ * RETURN:
+ *      None
+ ******************************************************************************/
+void xsk_ring_release(xsk_ring_t *r, uint32_t n)
+{
+    __atomic_store_n(r->consumer, *r->consumer + n, __ATOMIC_RELEASE);
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_ring_desc
+ *
+ * DESCRIPTION:
+ *      Get a descriptor of the RX or TX ring.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *      i - Index of entry, free running
+ *
+ * RETURN:
+ *      The descriptor
+ ******************************************************************************/
+struct xdp_desc *xsk_ring_desc(xsk_ring_t *r, uint32_t i)
+{
+    return &((struct xdp_desc *)r->entries)[i & r->mask];
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_ring_addr
+ *
+ * DESCRIPTION:
+ *      Get a frame address of the fill or completion ring.
+ *
+ * PARAMETERS:
+ *      r - The ring
+ *      i - Index of entry, free running
+ *
+ * RETURN:
+ *      The address of frame in UMEM
+ ******************************************************************************/
+uint64_t *xsk_ring_addr(xsk_ring_t *r, uint32_t i)
+{
+    return &((uint64_t *)r->entries)[i & r->mask];
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_kick_tx
+ *
+ * DESCRIPTION:
+ *      Wake the kernel up to send the TX ring, if it asks to. In copy mode
+ *      a call sends a budget of frames, so it is called again while the
+ *      frames are taken.
+ *
+ * PARAMETERS:
+ *      x - The socket
+ *
+ * RETURN:
+ *      Number of sendto() calls, -1 - failed (errno is set)
+ ******************************************************************************/
+int xsk_kick_tx(xsk_t *x)
+{
+    uint32_t consumer;
+    int calls = 0;
+
+    for (;;) {
+        if ((x->bind_flags & XDP_USE_NEED_WAKEUP)
+                && !(__atomic_load_n(x->tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)) {
+            return calls;
+        }
+
+        consumer = __atomic_load_n(x->tx.consumer, __ATOMIC_ACQUIRE);
+        calls++;
+        if (sendto(x->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) >= 0) {
+            return calls;
+        }
+        if (errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+            return -1;
+        }
+
+        /* Out of budget, or the ring is stuck */
+        if (errno != EAGAIN || (x->bind_flags & XDP_ZEROCOPY)
+                || consumer == __atomic_load_n(x->tx.consumer, __ATOMIC_ACQUIRE)
+                || xsk_ring_free(&x->tx) == XSK_RING_SIZE) {
+            return calls;
+        }
+    }
+}
+
+/******************************************************************************
+ * NAME:
+ *      xsk_wait_rx
+ *
+ * DESCRIPTION:
+ *      Wait for frames in the RX ring, which also wakes the driver up to
+ *      take the frames of fill ring.
+ *
+ * PARAMETERS:
+ *      x          - The socket
+ *      timeout_ms - Milliseconds to wait at most, 0 to wake the driver only
+ *
+ * RETURN:
+ *      1 - Frames ready, 0 - timeout, -1 - failed (errno is set)
+ ******************************************************************************/
+int xsk_wait_rx(xsk_t *x, int timeout_ms)
+{
+    struct pollfd pfd;
+
+    pfd.fd = x->fd;
+    pfd.events = POLLIN;
+
+    return poll(&pfd, 1, timeout_ms);
+}
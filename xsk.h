@@ -0,0 +1,75 @@
+/******************************************************************************
+ *
+ * FILENAME:
+ *     xsk.h
+ *
+ * DESCRIPTION:
+ *     Define a minimal AF_XDP socket with its UMEM and XDP program, on the
+ *     raw system calls
+ *
+ * REVISION(MM/DD/YYYY):
+ *     10/17/2026
+ *     - Initial version
+ *
+ ******************************************************************************/
+#ifndef _XSK_H_
+#define _XSK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+/* Bytes of a frame of UMEM, and entries of each ring */
+#define XSK_FRAME_SIZE      2048
+#define XSK_RING_SIZE       4096
+
+/*
+ * Frames of UMEM: the first XSK_RING_SIZE are for RX, given to the kernel
+ * by the fill ring; the others are for TX, back by the completion ring.
+ */
+#define XSK_FRAMES          (XSK_RING_SIZE * 2)
+#define XSK_TX_ADDR(i)      ((uint64_t)(XSK_RING_SIZE + (i)) * XSK_FRAME_SIZE)
+
+/*
+ * A ring shared with the kernel. The producer and consumer run freely,
+ * an entry is at (index & mask).
+ */
+typedef struct _xsk_ring {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *entries;
+    uint32_t mask;
+    void *map;
+    size_t map_len;
+} xsk_ring_t;
+
+typedef struct _xsk {
+    int fd;
+    int ifindex;
+    int queue;
+    int prog_fd;
+    int map_fd;
+    uint32_t xdp_flags;                 /* XDP_FLAGS_* of program attached */
+    uint16_t bind_flags;                /* XDP_ZEROCOPY or XDP_COPY */
+    uint8_t *umem;
+    size_t umem_len;
+    xsk_ring_t fill;
+    xsk_ring_t comp;
+    xsk_ring_t rx;
+    xsk_ring_t tx;
+} xsk_t;
+
+int xsk_open(xsk_t *x, const char *ifname, int queue, uint16_t ethertype);
+void xsk_close(xsk_t *x);
+uint32_t xsk_ring_ready(xsk_ring_t *r);
+uint32_t xsk_ring_free(xsk_ring_t *r);
+void xsk_ring_submit(xsk_ring_t *r, uint32_t n);
+void xsk_ring_release(xsk_ring_t *r, uint32_t n);
+struct xdp_desc *xsk_ring_desc(xsk_ring_t *r, uint32_t i);
+uint64_t *xsk_ring_addr(xsk_ring_t *r, uint32_t i);
+int xsk_kick_tx(xsk_t *x);
+int xsk_wait_rx(xsk_t *x, int timeout_ms);
+
+#endif /* _XSK_H_ */